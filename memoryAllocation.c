@@ -1,572 +1,8009 @@
+#ifdef MEMORY_ALLOCATION_PRELOAD
+#define _GNU_SOURCE // For memfd_create and fallocate
+#ifndef MEMORY_ALLOCATION_LIBRARY
+#define MEMORY_ALLOCATION_LIBRARY // the malloc shim has no main
+#endif
+#endif
 #include <string.h> // for strcmp
 #include <stdlib.h>  // for exit
 #include <stdio.h>   // For IO
 #include <stdbool.h> // For bool type
+#include <stdint.h>  // For fixed-width cell types
+#include <limits.h>  // For INT_MAX
+#include <fcntl.h>     // For open
+#include <unistd.h>    // For close
+#include <sys/mman.h>  // For mapping the request trace into memory
+#include <sys/stat.h>  // For the size of the request trace
+#include <pthread.h>   // For running simulations side by side
+#include <time.h>      // For timing each run of a sweep
+#include <dirent.h>    // For listing a directory of traces
+#include <errno.h>     // For EINTR, and the errors of the malloc shim
+#include "memoryAllocation.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h> // For the AVX2 bitmap scan
+#define HAVE_AVX2_SCAN 1
+#endif
+#ifdef MEMORY_ALLOCATION_PRELOAD
+// The shared object exports only malloc and its relatives,
+// so the simulator's function names cannot clash with those of the program it is loaded into
+#pragma GCC visibility push(hidden)
+#endif
 
-// Number of memory blocks
-#define MEM_SIZE 128
-// Each frame/page takes two memory blocks
-#define FRAME_SIZE 2
+/**
+ * How much a simulation prints is its LogLevel (see memoryAllocation.h), chosen
+ * with --log on the command line.
+ * Events are not printed with printf. They are formatted by hand into a large
+ * buffer that is written out in bulk. With --event-log=FILE, events are instead
+ * written to FILE as fixed-size binary records, and --decode=FILE turns such a
+ * file back into the text that full mode prints.
+ */
+
+// Kinds of event that the simulation reports
+typedef enum EventType { EVENT_REQUEST, EVENT_ALLOCATE, EVENT_VACATE, EVENT_COMPACTION, EVENT_NO_FIT, EVENT_FREE, EVENT_RESIZE, EVENT_RELEASE, EVENT_SWITCH } EventType;
+
+// Fits the auto policy switches between, and why it switched; an EVENT_SWITCH has the fit as id and the reason as second
+typedef enum AutoFit { AUTO_NEXT_FIT, AUTO_FIRST_FIT, AUTO_BEST_FIT, AUTO_WORST_FIT } AutoFit;
+typedef enum AutoReason { AUTO_CALM, AUTO_COMPACTING, AUTO_FRAGMENTED, AUTO_EVICTING, AUTO_UNIFORM } AutoReason;
+const char *autoFitNames[] = {"next-fit", "first-fit", "best-fit", "worst-fit"};
+const char *autoReasons[] = {
+	"memory is not fragmented",
+	"memory was compacted",
+	"most free blocks are outside the longest free extent",
+	"processes are vacated while memory is not fragmented",
+	"requests are all about the same size",
+};
+
+// One event as stored in a binary event log
+typedef struct EventRecord {
+	int32_t type; // an EventType
+	int32_t id; // process id the event is about, 0 for compaction
+	int64_t first; // requested blocks, or first allocated or released block
+	int64_t second; // last allocated or released block
+} EventRecord;
+
+// Every binary event log starts with these 8 bytes
+const char eventLogMagic[8] = "MEMEVT1";
+
+// Size of the buffer for the text of full mode, and of the buffer for binary records
+#define LOG_BUFFER_SIZE (4 << 20)
+#define EVENT_BUFFER_RECORDS 65536
+
+/**
+ * Where the events of one simulation go. Each simulation has its own, so
+ * simulations running side by side do not share buffers.
+ */
+typedef struct Log {
+	LogLevel level; // how much is printed
+	char *buffer; // text of full mode waiting to be written to stdout
+	size_t used; // characters in buffer
+	FILE *events; // binary event log file, or NULL to log as text
+	EventRecord *eventBuffer; // records waiting to be written to events
+	size_t eventsBuffered; // records in eventBuffer
+} Log;
+
+/**
+ * Write out everything logged so far. Call this before anything else is printed,
+ * so the output stays in order.
+ */
+void flushLog(Log *log) {
+	if(log->used > 0) {
+		fwrite(log->buffer, 1, log->used, stdout);
+		log->used = 0;
+	}
+	if(log->eventsBuffered > 0) {
+		fwrite(log->eventBuffer, sizeof(EventRecord), log->eventsBuffered, log->events);
+		log->eventsBuffered = 0;
+	}
+	if(log->level > LOG_OFF) {
+		fflush(stdout);
+	}
+}
+
+/**
+ * Write the decimal digits of value to out.
+ *
+ * @return number of characters written.
+ */
+int formatNumber(char *out, long long value) {
+	char digits[24];
+	int count = 0;
+	int length = 0;
+	unsigned long long magnitude = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+	if(value < 0) {
+		out[length++] = '-';
+	}
+	do { // digits come out lowest first
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while(magnitude > 0);
+	while(count > 0) {
+		out[length++] = digits[--count];
+	}
+	return length;
+}
+
+/**
+ * Write text to out.
+ *
+ * @return number of characters written.
+ */
+int formatText(char *out, const char *text) {
+	int length = strlen(text);
+	memcpy(out, text, length);
+	return length;
+}
+
+/**
+ * Write the line that full mode prints for an event. The text is exactly what
+ * the simulation used to print with printf, so existing output stays the same.
+ *
+ * @param out room for at least 128 characters.
+ * @param event the event to describe.
+ * @return number of characters written.
+ */
+int formatEvent(char *out, const EventRecord *event) {
+	int length = 0;
+	switch(event->type) {
+	case EVENT_REQUEST:
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, " requested ");
+		length += formatNumber(out + length, event->first);
+		length += formatText(out + length, " blocks\n");
+		break;
+	case EVENT_ALLOCATE:
+		length += formatText(out + length, "Allocate ");
+		length += formatNumber(out + length, event->first);
+		length += formatText(out + length, " through ");
+		length += formatNumber(out + length, event->second);
+		length += formatText(out + length, " to ");
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, "\n");
+		break;
+	case EVENT_VACATE:
+		length += formatText(out + length, "vacate ");
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, "\n");
+		break;
+	case EVENT_COMPACTION:
+		length += formatText(out + length, "Memory Compacted");
+		break;
+	case EVENT_NO_FIT:
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, " does not fit in memory\n");
+		break;
+	case EVENT_FREE:
+		length += formatText(out + length, "free ");
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, "\n");
+		break;
+	case EVENT_RESIZE:
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, " resized to ");
+		length += formatNumber(out + length, event->first);
+		length += formatText(out + length, " blocks\n");
+		break;
+	case EVENT_SWITCH:
+		length += formatText(out + length, "Switch to ");
+		length += formatText(out + length, autoFitNames[event->id]);
+		length += formatText(out + length, " at event ");
+		length += formatNumber(out + length, event->first);
+		length += formatText(out + length, ": ");
+		length += formatText(out + length, autoReasons[event->second]);
+		length += formatText(out + length, "\n");
+		break;
+	case EVENT_RELEASE:
+		length += formatText(out + length, "Release ");
+		length += formatNumber(out + length, event->first);
+		length += formatText(out + length, " through ");
+		length += formatNumber(out + length, event->second);
+		length += formatText(out + length, " from ");
+		length += formatNumber(out + length, event->id);
+		length += formatText(out + length, "\n");
+		break;
+	}
+	return length;
+}
+
+/**
+ * Report an event, as text in full mode or as a record in the binary event log.
+ *
+ * @param log where the event goes.
+ * @param type what happened.
+ * @param id process id the event is about.
+ * @param first requested blocks, or first allocated or released block.
+ * @param second last allocated or released block.
+ */
+void logEvent(Log *log, EventType type, int id, long long first, long long second) {
+	EventRecord event = {type, id, first, second};
+	if(log->events != NULL) {
+		log->eventBuffer[log->eventsBuffered++] = event;
+		if(log->eventsBuffered == EVENT_BUFFER_RECORDS) {
+			flushLog(log);
+		}
+	} else if(log->level == LOG_FULL) {
+		if(log->used + 128 > LOG_BUFFER_SIZE) {
+			flushLog(log);
+		}
+		log->used += formatEvent(log->buffer + log->used, &event);
+	}
+}
+
+/**
+ * Set up a log, allocating only the buffer it needs, and open the binary event
+ * log if one was asked for.
+ *
+ * @param log the log to set up.
+ * @param level how much is printed.
+ * @param eventLogName file for binary event records, or NULL to log as text.
+ * @return false if the event log cannot be created.
+ */
+bool openLog(Log *log, LogLevel level, const char *eventLogName) {
+	memset(log, 0, sizeof(Log));
+	log->level = level;
+	if(eventLogName != NULL) {
+		log->eventBuffer = malloc(EVENT_BUFFER_RECORDS * sizeof(EventRecord));
+	} else if(level == LOG_FULL) {
+		log->buffer = malloc(LOG_BUFFER_SIZE);
+	}
+	if((eventLogName != NULL && log->eventBuffer == NULL) || (eventLogName == NULL && level == LOG_FULL && log->buffer == NULL)) {
+		printf("ERROR! Out of memory for the log buffers\n");
+		exit(1); // Exit with error
+	}
+	if(eventLogName != NULL) {
+		log->events = fopen(eventLogName, "wb");
+		if(log->events == NULL) {
+			free(log->eventBuffer);
+			log->eventBuffer = NULL;
+			return false;
+		}
+		fwrite(eventLogMagic, 1, sizeof(eventLogMagic), log->events);
+	}
+	return true;
+}
+
+/**
+ * Write out what is left in a log, close its event log and free its buffers.
+ */
+void closeLog(Log *log) {
+	flushLog(log);
+	if(log->events != NULL) {
+		fclose(log->events);
+	}
+	free(log->buffer);
+	free(log->eventBuffer);
+	memset(log, 0, sizeof(Log));
+}
+
+/**
+ * Whether formatEvent can describe a record read from a file, which need not
+ * have been written by the simulation.
+ */
+bool eventInRange(const EventRecord *event) {
+	if(event->type < EVENT_REQUEST || event->type > EVENT_SWITCH) {
+		return false; // formatEvent would print nothing for it
+	}
+	if(event->type == EVENT_SWITCH) { // its fit and reason index the names of them
+		return event->id >= 0 && event->id <= AUTO_WORST_FIT && event->second >= 0 && event->second <= AUTO_UNIFORM;
+	}
+	return true;
+}
+
+/**
+ * Print a binary event log as the text that full mode would have printed.
+ *
+ * @param name binary event log file written with --event-log.
+ * @return 0 on success, 1 if the file cannot be read, holds a record that is
+ *         out of range or ends inside a record.
+ */
+int decodeEventLog(const char *name) {
+	FILE *input = fopen(name, "rb");
+	char magic[8];
+	if(input == NULL || fread(magic, 1, sizeof(magic), input) != sizeof(magic) || memcmp(magic, eventLogMagic, sizeof(magic)) != 0) {
+		printf("Problem reading event log %s\n", name);
+		if(input != NULL) {
+			fclose(input);
+		}
+		return 1; // Error
+	}
+	Log log;
+	openLog(&log, LOG_FULL, NULL);
+	EventRecord *records = malloc(EVENT_BUFFER_RECORDS * sizeof(EventRecord));
+	if(records == NULL) {
+		printf("ERROR! Out of memory for the log buffers\n");
+		exit(1); // Exit with error
+	}
+	size_t bytes;
+	long long record = 0; // records decoded so far
+	bool wellFormed = true;
+	while(wellFormed && (bytes = fread(records, 1, EVENT_BUFFER_RECORDS * sizeof(EventRecord), input)) > 0) {
+		size_t count = bytes / sizeof(EventRecord);
+		size_t i;
+		for(i = 0; i < count && (wellFormed = eventInRange(&records[i])); i++) {
+			if(log.used + 128 > LOG_BUFFER_SIZE) {
+				flushLog(&log);
+			}
+			log.used += formatEvent(log.buffer + log.used, &records[i]);
+			record++;
+		}
+		if(bytes % sizeof(EventRecord) != 0) { // only the end of the file is short of a whole buffer
+			wellFormed = false;
+		}
+	}
+	fclose(input);
+	free(records);
+	closeLog(&log); // the events before a bad record are still printed
+	if(!wellFormed) {
+		printf("Problem reading event log %s: malformed record %lld\n", name, record + 1);
+		return 1; // Error
+	}
+	return 0;
+}
+
+/**
+ * A free extent is a maximal run of empty blocks in memory. Every free extent
+ * is stored in two treaps at the same time: one ordered by starting block, used
+ * by first-fit, and one ordered by length and then starting block, used by
+ * best-fit and worst-fit. Each node of the address treap also remembers the
+ * longest extent in its subtree, so first-fit can skip whole subtrees that are
+ * too small. fillMemory, vacateProcess and compaction keep the index in sync
+ * with the memory array, so the policies never have to scan memory.
+ */
+typedef struct Extent {
+	long long start; // first block of the extent
+	long long length; // number of blocks in the extent
+	unsigned int priority; // random heap priority, shared by both treaps
+	long long maxLength; // longest extent in this node's address subtree
+	int id; // process that owns the run (only used by the run-length store)
+	struct Extent *addrLeft, *addrRight; // children in the address-ordered treap
+	struct Extent *sizeLeft, *sizeRight; // children in the size-ordered treap
+} Extent;
+
+/**
+ * The memory array can be stored in several ways, chosen per run with --store:
+ *   u16  one 16-bit cell per block, for runs with at most 65535 processes
+ *   u32  one 32-bit cell per block (the default)
+ *   rle  one node per allocated run, so the store grows with the number of
+ *        allocations instead of the number of blocks
+ * The rest of the simulator only reads and writes memory through these functions.
+ */
+typedef struct MemoryStore {
+	const char *name; // value of --store that selects this store
+	int maxId; // largest process id a block can hold
+	void (*create)(Simulator *sim); // make an empty memory of memorySize blocks
+	int (*get)(Simulator *sim, long long block); // process id in a block, 0 if it is free
+	void (*fill)(Simulator *sim, long long start, long long length, int id); // give free blocks to a process
+	void (*clear)(Simulator *sim, long long start, long long length); // make blocks free
+	void (*move)(Simulator *sim, long long from, long long to, long long length); // relocate blocks owned by one process
+	long long (*run)(Simulator *sim, long long block, int *id); // end of the run of equal ids that starts at block
+} MemoryStore;
+
+/**
+ * Free-space engines answer the searches of firstFit and nextFit, chosen per run
+ * with --engine:
+ *   extent  the free-extent index (the default)
+ *   bitmap  an occupancy bitmap with one bit per block, scanned a 64-bit word
+ *           (or, with AVX2, four words) at a time
+ * bestFit, worstFit and eviction always use the free-extent index, which is
+ * kept up to date whichever engine is chosen. Paging has a frame bitmap of its own.
+ */
+typedef struct FreeSpaceEngine {
+	const char *name; // value of --engine that selects this engine
+	void (*reset)(Simulator *sim, long long used); // blocks before used are allocated, the rest are free
+	void (*reserve)(Simulator *sim, long long start, long long length); // blocks were allocated
+	void (*release)(Simulator *sim, long long start, long long length); // blocks were freed
+	long long (*findRun)(Simulator *sim, long long block, long long size); // first free run of size blocks at or after block, or -1
+} FreeSpaceEngine;
+
+/**
+ * A run of blocks owned by one process. Contiguous policies give every process
+ * exactly one run; paging may give a process many.
+ */
+typedef struct OwnedExtent {
+	long long start; // first block of the run
+	long long length; // number of blocks in the run
+} OwnedExtent;
+
+/**
+ * Process table entry: everything that is known about a resident process,
+ * so it can be vacated without scanning memory.
+ */
+typedef struct Process {
+	OwnedExtent *extents; // runs owned by the process, ordered by starting block
+	int extentCount; // number of runs in use
+	int extentCapacity; // number of runs the extents array has room for
+	long long size; // total number of blocks owned by the process
+	int heapIndex; // position in largestProcesses, or -1 if the process is not resident
+	long long arrival; // when the process last got memory, counting allocations from 1
+	Extent *sizeNode; // node of the process in processSizeRoot, or NULL
+	long long *pageTable; // frame that holds each page of the process (pages policy only)
+	long long pageCount; // number of pages in the page table
+} Process;
+
+// An entry of the arrival queue of the fifo evictor
+typedef struct Arrival {
+	int id; // process that got memory
+	long long arrival; // its arrival number then; the entry is stale once the process leaves
+} Arrival;
+
+/**
+ * An allocation policy. Each policy has the same signature: a bool is returned
+ * indicating the success of the allocation, and the two inputs are the id number
+ * to reserve the memory for, and the size (number of blocks) to reserve. Which
+ * policy a simulation uses is set when it is created, based on the policy name.
+ */
+typedef struct Policy {
+	const char *name; // policy argument that selects this policy
+	const char *description; // printed when the simulation starts
+	bool (*place)(Simulator *sim, int id, long long size); // try to give the process size blocks
+	void (*reset)(Simulator *sim); // set up the policy's own free lists from the free extents, or NULL
+	void (*release)(Simulator *sim, long long start, long long length); // blocks of a process were freed, or NULL
+	bool (*resize)(Simulator *sim, int id, long long size); // grow or shrink a resident process in place, false if it cannot
+	bool compacts; // true if fragmented memory is compacted before anything is vacated
+	bool paging; // true for the paging policy, whose results depend on the frame size
+	// write the policy's own free blocks to blocks, unless it is NULL, in the order the policy keeps them, and count them;
+	// NULL if reset rebuilds them exactly from the free extents
+	long long (*saveFree)(Simulator *sim, OwnedExtent *blocks);
+	void (*loadFree)(Simulator *sim, const OwnedExtent *blocks, long long count); // replace the free blocks with ones saveFree wrote
+} Policy;
+
+/**
+ * Compaction makes room for a request that fits in the free blocks but not in
+ * any one free extent, chosen per run with --compaction:
+ *   full    slide every allocated run to the front of memory (the default)
+ *   window  empty only the cheapest window of memory the request fits in
+ */
+typedef struct Compactor {
+	const char *name; // value of --compaction that selects this compactor
+	void (*compact)(Simulator *sim, long long size); // leave a free extent of at least size blocks
+} Compactor;
+
+/**
+ * When a request does not fit even after compaction, resident processes are
+ * vacated one at a time until it does. Which one goes is chosen per run with
+ * --eviction:
+ *   largest   the process that owns the most blocks (the default)
+ *   fifo      the process that has been resident longest; processes are never
+ *             touched after they arrive, so this is also least recently used
+ *   smallest  the smallest process whose blocks would cover the shortfall
+ *   adjacent  a process next to the longest free extent, so vacating it
+ *             makes that hole longer without compaction
+ *   plan      whichever of adjacent and smallest loses and moves the fewest blocks
+ * Each evictor keeps its own index up to date through admit and dismiss, so
+ * no victim is found by scanning memory.
+ */
+typedef struct Evictor {
+	const char *name; // value of --eviction that selects this evictor
+	int (*victim)(Simulator *sim, long long size); // process to vacate for a request of size blocks, or -1 if none is resident
+	void (*admit)(Simulator *sim, int id); // a process got all of its memory, or NULL
+	void (*dismiss)(Simulator *sim, int id); // a process is about to lose its memory, or NULL
+} Evictor;
+
+// Levels of the frame bitmap of the pages policy; 64 to the power of this exceeds any frame number
+#define FRAME_LEVELS 11
+// Size of one page-table entry, for the page-table overhead
+#define PAGE_TABLE_ENTRY_BYTES 8
+
+// One entry of the simulated TLB
+typedef struct TlbEntry {
+	long long arrival; // arrival number of the process the page belongs to, 0 if the entry is empty
+	long long page; // logical page of that process
+	long long lastUse; // when the entry was last used, for LRU replacement
+} TlbEntry;
+
+// The tlsf policy splits each power of two into 2^TLSF_SECOND_BITS size classes
+#define TLSF_SECOND_BITS 4
+#define TLSF_SECOND_LEVELS (1 << TLSF_SECOND_BITS)
+// Sizes below TLSF_SECOND_LEVELS have first level 0, larger ones 1 + log2(size) - TLSF_SECOND_BITS
+#define TLSF_FIRST_LEVELS (64 - TLSF_SECOND_BITS)
+
+// A boundary tag of the tlsf policy: the free block with an edge at a block
+typedef struct TlsfTag {
+	long long block; // -1 for an empty slot
+	Extent *extent;
+} TlsfTag;
+
+// Boundary tags kept in an open-addressed hash table, so they take memory for each free block rather than for each block of memory
+typedef struct TlsfTags {
+	TlsfTag *slots;
+	long long capacity; // slots, a power of two
+	long long count; // slots in use
+} TlsfTags;
+
+/**
+ * Everything one simulation knows. Nothing in the simulator is kept in globals,
+ * so any number of simulations can run in one process, each on its own thread.
+ */
+struct Simulator {
+	long long memorySize; // number of memory blocks
+	long long frameSize; // number of memory blocks in each frame/page
+	const Policy *policy; // the memory allocation policy
+	const MemoryStore *memory; // store that simulates memory
+	const FreeSpaceEngine *freeSpace; // engine used by firstFit and nextFit
+	const Compactor *compactor; // how memory is compacted for the contiguous policies
+	const Evictor *evictor; // which process is vacated when a request does not fit
+	Log log; // where events are reported
+
+	// Roots of the two treaps that index the free extents
+	Extent *addressRoot;
+	Extent *sizeRoot;
+	// Number of free extents, and of those whose length has its highest bit at k, for telemetry
+	long long freeExtentCount;
+	long long holeSizes[64];
+	// Nodes that are no longer in use, linked through addrRight so they can be reused
+	Extent *spareExtents;
+	// State of the xorshift generator that hands out treap priorities
+	unsigned int prioritySeed;
+
+	// Cells for the u32 and u16 stores, one per block
+	uint32_t *cells32;
+	uint16_t *cells16;
+	// Allocated runs for the rle store, ordered by starting block. Free blocks have no node.
+	// Neighbouring runs always belong to different processes, because equal neighbours are merged.
+	Extent *runRoot;
+
+	// Occupancy bitmap for the bitmap engine: bit b of word w is block 64 * w + b, 1 if allocated.
+	// The unused bits after the last block are kept at 1, so no search runs past the end of memory.
+	uint64_t *occupied;
+	long long bitmapWords;
+	// Word skipping functions, switched to the AVX2 versions when the processor has it
+	long long (*skipFullWords)(Simulator *sim, long long word);
+	long long (*skipEmptyWords)(Simulator *sim, long long word);
+
+	// Number of free blocks, kept up to date so vacantSpace never has to scan memory
+	long long freeBlocks;
+
+	// Process table indexed by process id; ids start at 1 and grow with every request
+	Process *processTable;
+	int processTableCapacity;
+	/**
+	 * Max-heap of resident process ids, ordered by footprint. Among processes of
+	 * the same size, the one whose first block is lowest comes first, which is the
+	 * process a scan of memory would have found first.
+	 */
+	int *largestProcesses;
+	int residentProcesses;
+	int largestProcessesCapacity;
+	// Number of allocations so far, used to number arrivals
+	long long arrivals;
+	// Resident processes in order of arrival for the fifo evictor; entries from head on are live or stale
+	Arrival *arrivalQueue;
+	long long arrivalHead;
+	long long arrivalCount;
+	long long arrivalCapacity;
+	// Resident processes ordered by size for the smallest and plan evictors: length is the size, start the id
+	Extent *processSizeRoot;
+
+	// Remember last allocation for next-fit algorithm
+	long long lastAllocationPoint;
+	// Increment every time vacateProcess is called
+	int processesVacated;
+	// Number of blocks the vacated processes owned, the resident data eviction threw away
+	long long blocksVacated;
+	// Track the number of compaction events
+	int compactionEvents;
+	// Number of blocks copied to another place by compaction, its cost
+	long long blocksMoved;
+	// Reallocations of resident processes, the ones that could not be done in place, and the blocks those copied
+	long long reallocations;
+	long long reallocationsMoved;
+	long long blocksCopied;
+
+	// Free blocks of the buddy policy: one address treap per order, holding blocks of 2^order blocks
+	Extent *buddyRoots[64];
+	// Bit k is set when buddyRoots[k] is not empty
+	uint64_t buddyOrders;
+	// Blocks handed out by rounding requests up that the processes do not use
+	long long wastedBlocks;
+
+	// Frame bitmap of the pages policy, frameWords[k] words on level k
+	uint64_t *freeFrames[FRAME_LEVELS];
+	long long frameWords[FRAME_LEVELS];
+	int frameLevels;
+	long long wholeFrames; // frames that lie entirely inside memory
+	long long freeFrameCount;
+
+	// Address translation model: page tables of pageTableLevels levels, each table indexed by
+	// pageTableBits bits of the page number, and a TLB of tlbSets sets of tlbWays entries.
+	// Entries are tagged with the arrival number of the process, so a process that leaves
+	// never needs its entries flushed: no later process can match them.
+	int pageTableLevels;
+	int pageTableBits;
+	TlbEntry *tlb;
+	long long tlbSets;
+	int tlbWays;
+	bool tlbRandom; // random replacement instead of LRU
+	unsigned int tlbSeed;
+	long long tlbClock;
+	long long accesses; // accesses translated
+	long long tlbHits; // accesses the TLB translated
+	long long pageWalks; // accesses that walked the page tables
+	long long faults; // accesses to blocks the process does not own
+	long long pageTableBytes; // size of the page tables of the resident processes
+	long long peakPageTableBytes; // largest that size has been
+
+	// Free blocks of the tlsf policy, one list per size class, linked through addrLeft/addrRight
+	Extent *tlsfLists[TLSF_FIRST_LEVELS][TLSF_SECOND_LEVELS];
+	// Bit f is set when some list of first level f is not empty, bit s of tlsfSecond[f] when list s is
+	uint64_t tlsfFirst;
+	uint32_t tlsfSecond[TLSF_FIRST_LEVELS];
+	// Boundary tags: the free block that starts at a block, and the one that ends at it
+	TlsfTags tlsfStarts;
+	TlsfTags tlsfEnds;
+
+	// Telemetry file, or NULL; a sample is written every telemetryEvery steps (allocations, reallocations and frees)
+	FILE *telemetry;
+	bool telemetryJson; // JSON lines instead of CSV
+	long long telemetryEvery;
+	long long steps;
+	// Time spent searching for space, compacting and vacating, only measured while telemetry is written
+	long long searchNanos;
+	long long compactionNanos;
+	long long evictionNanos;
+
+	// Change records of memory (see recordDelta), or NULL
+	FILE *deltas;
+
+	// The auto policy: the fit it uses now, and the signals it chooses the next one by
+	int autoFit; // an AutoFit
+	long long autoWindowStart; // step the current window of requests began at
+	int autoCompactions; // compactionEvents when it began
+	int autoVacated; // processesVacated when it began
+	long long autoSizeStep; // step whose request size was counted last
+	double autoMeanSize; // moving average of the request sizes
+	double autoSizeVariance; // moving average of their squared distance from it
+	long long autoSwitches; // number of times the fit changed
+};
+
+/**
+ * Find the position of the highest one bit of x, which must not be 0.
+ */
+int highestBit(uint64_t x) {
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(x);
+#else
+	int bit = 0;
+	while((x >>= 1) != 0) {
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+/**
+ * Find the smallest order whose blocks can hold size blocks.
+ */
+int orderOf(long long size) {
+	int order = 0;
+	while(order < 63 && (1LL << order) < size) {
+		order++;
+	}
+	return order;
+}
+
+/**
+ * Get a node for a new free extent, reusing a spare node when possible.
+ *
+ * @param start first block of the extent.
+ * @param length number of blocks in the extent.
+ * @return the new node, which is not linked into either treap yet.
+ */
+Extent *newExtent(Simulator *sim, long long start, long long length) {
+	Extent *e = sim->spareExtents;
+	if(e != NULL) {
+		sim->spareExtents = e->addrRight;
+	} else {
+		e = malloc(sizeof(Extent));
+		if(e == NULL) {
+			flushLog(&sim->log);
+			printf("ERROR! Out of memory for the free-extent index\n");
+			exit(1); // Exit with error
+		}
+	}
+	// xorshift keeps the priorities (and so the tree shapes) the same from run to run
+	sim->prioritySeed ^= sim->prioritySeed << 13;
+	sim->prioritySeed ^= sim->prioritySeed >> 17;
+	sim->prioritySeed ^= sim->prioritySeed << 5;
+	e->start = start;
+	e->length = length;
+	e->priority = sim->prioritySeed;
+	e->maxLength = length;
+	e->addrLeft = e->addrRight = NULL;
+	e->sizeLeft = e->sizeRight = NULL;
+	return e;
+}
+
+/**
+ * Recompute the longest extent in the address subtree rooted at e.
+ *
+ * @param e node whose children may have changed.
+ */
+void updateMaxLength(Extent *e) {
+	e->maxLength = e->length;
+	if(e->addrLeft != NULL && e->addrLeft->maxLength > e->maxLength) {
+		e->maxLength = e->addrLeft->maxLength;
+	}
+	if(e->addrRight != NULL && e->addrRight->maxLength > e->maxLength) {
+		e->maxLength = e->addrRight->maxLength;
+	}
+}
+
+/**
+ * Split the address treap t into extents starting before block and extents
+ * starting at or after block.
+ *
+ * @param t root of the treap to split.
+ * @param block the first block that goes to the right half.
+ * @param left receives the extents that start before block.
+ * @param right receives the extents that start at or after block.
+ */
+void splitByAddress(Extent *t, long long block, Extent **left, Extent **right) {
+	if(t == NULL) {
+		*left = *right = NULL;
+	} else if(t->start < block) {
+		splitByAddress(t->addrRight, block, &t->addrRight, right);
+		updateMaxLength(t);
+		*left = t;
+	} else {
+		splitByAddress(t->addrLeft, block, left, &t->addrLeft);
+		updateMaxLength(t);
+		*right = t;
+	}
+}
+
+/**
+ * Join two address treaps where every extent in a starts before every extent in b.
+ *
+ * @return root of the joined treap.
+ */
+Extent *mergeByAddress(Extent *a, Extent *b) {
+	if(a == NULL) {
+		return b;
+	}
+	if(b == NULL) {
+		return a;
+	}
+	if(a->priority > b->priority) {
+		a->addrRight = mergeByAddress(a->addrRight, b);
+		updateMaxLength(a);
+		return a;
+	}
+	b->addrLeft = mergeByAddress(a, b->addrLeft);
+	updateMaxLength(b);
+	return b;
+}
+
+/**
+ * Split the size treap t into extents ordered before (length, start) and the rest.
+ * Extents are ordered by length first, and ties are broken by starting block.
+ *
+ * @param t root of the treap to split.
+ * @param length length of the first extent that goes to the right half.
+ * @param start starting block of the first extent that goes to the right half.
+ * @param left receives the smaller extents.
+ * @param right receives the remaining extents.
+ */
+void splitBySize(Extent *t, long long length, long long start, Extent **left, Extent **right) {
+	if(t == NULL) {
+		*left = *right = NULL;
+	} else if(t->length < length || (t->length == length && t->start < start)) {
+		splitBySize(t->sizeRight, length, start, &t->sizeRight, right);
+		*left = t;
+	} else {
+		splitBySize(t->sizeLeft, length, start, left, &t->sizeLeft);
+		*right = t;
+	}
+}
+
+/**
+ * Join two size treaps where every extent in a is ordered before every extent in b.
+ *
+ * @return root of the joined treap.
+ */
+Extent *mergeBySize(Extent *a, Extent *b) {
+	if(a == NULL) {
+		return b;
+	}
+	if(b == NULL) {
+		return a;
+	}
+	if(a->priority > b->priority) {
+		a->sizeRight = mergeBySize(a->sizeRight, b);
+		return a;
+	}
+	b->sizeLeft = mergeBySize(a, b->sizeLeft);
+	return b;
+}
+
+/**
+ * Add a free extent to both treaps.
+ *
+ * @param start first block of the free extent.
+ * @param length number of free blocks.
+ */
+void insertExtent(Simulator *sim, long long start, long long length) {
+	Extent *e = newExtent(sim, start, length);
+	Extent *left, *right;
+	splitByAddress(sim->addressRoot, start, &left, &right);
+	sim->addressRoot = mergeByAddress(mergeByAddress(left, e), right);
+	splitBySize(sim->sizeRoot, length, start, &left, &right);
+	sim->sizeRoot = mergeBySize(mergeBySize(left, e), right);
+	sim->freeExtentCount++;
+	sim->holeSizes[highestBit(length)]++;
+}
+
+/**
+ * Take a free extent out of both treaps and recycle its node.
+ *
+ * @param e extent currently stored in the index.
+ */
+void removeExtent(Simulator *sim, Extent *e) {
+	Extent *left, *middle, *right;
+	splitByAddress(sim->addressRoot, e->start, &left, &right);
+	splitByAddress(right, e->start + 1, &middle, &right);
+	sim->addressRoot = mergeByAddress(left, right);
+	splitBySize(sim->sizeRoot, e->length, e->start, &left, &right);
+	splitBySize(right, e->length, e->start + 1, &middle, &right);
+	sim->sizeRoot = mergeBySize(left, right);
+	sim->freeExtentCount--;
+	sim->holeSizes[highestBit(e->length)]--;
+	e->addrRight = sim->spareExtents;
+	sim->spareExtents = e;
+}
+
+/**
+ * Recycle every node of an address treap.
+ *
+ * @param t root of the treap to throw away.
+ */
+void discardExtents(Simulator *sim, Extent *t) {
+	if(t != NULL) {
+		discardExtents(sim, t->addrLeft);
+		discardExtents(sim, t->addrRight);
+		t->addrRight = sim->spareExtents;
+		sim->spareExtents = t;
+	}
+}
+
+/**
+ * Replace the whole index with a single free extent (or none at all).
+ *
+ * @param start first free block.
+ * @param length number of free blocks, 0 if memory is full.
+ */
+void resetExtents(Simulator *sim, long long start, long long length) {
+	discardExtents(sim, sim->addressRoot);
+	sim->addressRoot = NULL;
+	sim->sizeRoot = NULL;
+	sim->freeExtentCount = 0;
+	memset(sim->holeSizes, 0, sizeof(sim->holeSizes));
+	if(length > 0) {
+		insertExtent(sim, start, length);
+	}
+}
+
+/**
+ * Add a node to an address treap that is not part of the free-extent index,
+ * such as the runs of the rle store.
+ *
+ * @param root root of the treap, updated in place.
+ * @return the new node.
+ */
+Extent *insertByAddress(Simulator *sim, Extent **root, long long start, long long length) {
+	Extent *e = newExtent(sim, start, length);
+	Extent *left, *right;
+	splitByAddress(*root, start, &left, &right);
+	*root = mergeByAddress(mergeByAddress(left, e), right);
+	return e;
+}
+
+/**
+ * Take a node out of an address treap added to with insertByAddress, and recycle it.
+ *
+ * @param root root of the treap, updated in place.
+ * @param e node currently in the treap.
+ */
+void removeByAddress(Simulator *sim, Extent **root, Extent *e) {
+	Extent *left, *middle, *right;
+	splitByAddress(*root, e->start, &left, &right);
+	splitByAddress(right, e->start + 1, &middle, &right);
+	*root = mergeByAddress(left, right);
+	e->addrRight = sim->spareExtents;
+	sim->spareExtents = e;
+}
+
+/**
+ * Add a node to a size treap that is not part of the free-extent index,
+ * such as the resident processes of the smallest evictor.
+ *
+ * @param root root of the treap, updated in place.
+ * @return the new node.
+ */
+Extent *insertBySize(Simulator *sim, Extent **root, long long start, long long length) {
+	Extent *e = newExtent(sim, start, length);
+	Extent *left, *right;
+	splitBySize(*root, length, start, &left, &right);
+	*root = mergeBySize(mergeBySize(left, e), right);
+	return e;
+}
+
+/**
+ * Take a node out of a size treap added to with insertBySize, and recycle it.
+ *
+ * @param root root of the treap, updated in place.
+ * @param e node currently in the treap.
+ */
+void removeBySize(Simulator *sim, Extent **root, Extent *e) {
+	Extent *left, *middle, *right;
+	splitBySize(*root, e->length, e->start, &left, &right);
+	splitBySize(right, e->length, e->start + 1, &middle, &right);
+	*root = mergeBySize(left, right);
+	e->addrRight = sim->spareExtents;
+	sim->spareExtents = e;
+}
+
+/**
+ * Find the extent with the highest starting block that is not after block.
+ *
+ * @param root address treap to search, such as addressRoot.
+ * @param block block index to search from.
+ * @return the extent, or NULL if every extent starts after block.
+ */
+Extent *extentAtOrBefore(Extent *root, long long block) {
+	Extent *t = root;
+	Extent *found = NULL;
+	while(t != NULL) {
+		if(t->start <= block) {
+			found = t;
+			t = t->addrRight;
+		} else {
+			t = t->addrLeft;
+		}
+	}
+	return found;
+}
+
+/**
+ * Find the extent with the lowest starting block that is not before block.
+ *
+ * @param root address treap to search, such as addressRoot.
+ * @param block block index to search from.
+ * @return the extent, or NULL if every extent starts before block.
+ */
+Extent *extentAtOrAfter(Extent *root, long long block) {
+	Extent *t = root;
+	Extent *found = NULL;
+	while(t != NULL) {
+		if(t->start >= block) {
+			found = t;
+			t = t->addrLeft;
+		} else {
+			t = t->addrRight;
+		}
+	}
+	return found;
+}
+
+/**
+ * Find the lowest-addressed extent in treap t that starts at or after block
+ * and can hold size blocks.
+ *
+ * @param t root of the address treap to search, such as addressRoot.
+ * @param block lowest starting block to accept.
+ * @param size number of blocks needed.
+ * @return the extent, or NULL if no extent qualifies.
+ */
+Extent *firstExtentFrom(Extent *t, long long block, long long size) {
+	if(t == NULL || t->maxLength < size) {
+		return NULL; // nothing in this subtree is large enough
+	}
+	if(t->start < block) {
+		return firstExtentFrom(t->addrRight, block, size); // this extent and its left subtree start too early
+	}
+	Extent *found = firstExtentFrom(t->addrLeft, block, size);
+	if(found != NULL) {
+		return found; // an earlier extent is large enough
+	}
+	if(t->length >= size) {
+		return t;
+	}
+	return firstExtentFrom(t->addrRight, block, size);
+}
+
+/**
+ * Find the shortest free extent that can hold size blocks. Among extents
+ * of the same length, the one with the lowest starting block is returned.
+ *
+ * @param size number of blocks needed.
+ * @return the extent, or NULL if no free extent is large enough.
+ */
+Extent *smallestExtentAtLeast(Simulator *sim, long long size) {
+	Extent *t = sim->sizeRoot;
+	Extent *found = NULL;
+	while(t != NULL) {
+		if(t->length >= size) {
+			found = t;
+			t = t->sizeLeft;
+		} else {
+			t = t->sizeRight;
+		}
+	}
+	return found;
+}
+
+/**
+ * Find the longest free extent. Among extents of the same length, the one
+ * with the lowest starting block is returned.
+ *
+ * @return the extent, or NULL if memory is full.
+ */
+Extent *largestExtent(Simulator *sim) {
+	Extent *t = sim->sizeRoot;
+	if(t == NULL) {
+		return NULL;
+	}
+	while(t->sizeRight != NULL) {
+		t = t->sizeRight;
+	}
+	return smallestExtentAtLeast(sim, t->length);
+}
+
+/**
+ * Record that blocks startBlock through startBlock + size - 1 are no longer free.
+ * The blocks must all lie inside a single free extent.
+ *
+ * @param startBlock first block being allocated.
+ * @param size number of blocks being allocated.
+ */
+void reserveExtent(Simulator *sim, long long startBlock, long long size) {
+	Extent *e = extentAtOrBefore(sim->addressRoot, startBlock);
+	long long before = startBlock - e->start; // free blocks left in front of the allocation
+	long long after = e->start + e->length - startBlock - size; // free blocks left behind it
+	long long end = startBlock + size;
+	removeExtent(sim, e);
+	if(before > 0) {
+		insertExtent(sim, startBlock - before, before);
+	}
+	if(after > 0) {
+		insertExtent(sim, end, after);
+	}
+}
+
+/**
+ * Record that blocks startBlock through startBlock + size - 1 are free. Some of the
+ * blocks may already have been free; the range is merged with every free extent
+ * it overlaps or touches.
+ *
+ * @param startBlock first block being freed.
+ * @param size number of blocks being freed.
+ */
+void releaseExtent(Simulator *sim, long long startBlock, long long size) {
+	long long low = startBlock;
+	long long high = startBlock + size;
+	Extent *e = extentAtOrBefore(sim->addressRoot, startBlock);
+	if(e != NULL && e->start + e->length >= low) { // touches the free extent in front
+		low = e->start;
+		if(e->start + e->length > high) {
+			high = e->start + e->length;
+		}
+		removeExtent(sim, e);
+	}
+	e = extentAtOrAfter(sim->addressRoot, low);
+	while(e != NULL && e->start <= high) { // swallow the free extents that overlap or follow directly
+		if(e->start + e->length > high) {
+			high = e->start + e->length;
+		}
+		removeExtent(sim, e);
+		e = extentAtOrAfter(sim->addressRoot, low);
+	}
+	insertExtent(sim, low, high - low);
+}
+
+void createCells32(Simulator *sim) {
+	free(sim->cells32);
+	sim->cells32 = calloc(sim->memorySize, sizeof(uint32_t)); // calloc hands out zeroed pages lazily
+	if(sim->cells32 == NULL) {
+		flushLog(&sim->log);
+		printf("ERROR! Not enough memory for %lld 32-bit cells\n", sim->memorySize);
+		exit(1); // Exit with error
+	}
+}
+
+int getCell32(Simulator *sim, long long block) {
+	return sim->cells32[block];
+}
+
+void fillCells32(Simulator *sim, long long start, long long length, int id) {
+	long long i;
+	for(i = start; i < start + length; i++) {
+		sim->cells32[i] = id;
+	}
+}
+
+void clearCells32(Simulator *sim, long long start, long long length) {
+	memset(sim->cells32 + start, 0, length * sizeof(uint32_t));
+}
+
+void moveCells32(Simulator *sim, long long from, long long to, long long length) {
+	memmove(sim->cells32 + to, sim->cells32 + from, length * sizeof(uint32_t));
+	if(to < from) { // clear the part of the old location that was not overwritten
+		long long keep = to + length > from ? to + length : from;
+		clearCells32(sim, keep, from + length - keep);
+	} else if(to > from) {
+		clearCells32(sim, from, (to < from + length ? to : from + length) - from);
+	}
+}
+
+long long runCells32(Simulator *sim, long long block, int *id) {
+	uint32_t value = sim->cells32[block];
+	long long end = block + 1;
+	while(end < sim->memorySize && sim->cells32[end] == value) {
+		end++;
+	}
+	*id = value;
+	return end;
+}
+
+void createCells16(Simulator *sim) {
+	free(sim->cells16);
+	sim->cells16 = calloc(sim->memorySize, sizeof(uint16_t)); // calloc hands out zeroed pages lazily
+	if(sim->cells16 == NULL) {
+		flushLog(&sim->log);
+		printf("ERROR! Not enough memory for %lld 16-bit cells\n", sim->memorySize);
+		exit(1); // Exit with error
+	}
+}
+
+int getCell16(Simulator *sim, long long block) {
+	return sim->cells16[block];
+}
+
+void fillCells16(Simulator *sim, long long start, long long length, int id) {
+	long long i;
+	for(i = start; i < start + length; i++) {
+		sim->cells16[i] = id;
+	}
+}
+
+void clearCells16(Simulator *sim, long long start, long long length) {
+	memset(sim->cells16 + start, 0, length * sizeof(uint16_t));
+}
+
+void moveCells16(Simulator *sim, long long from, long long to, long long length) {
+	memmove(sim->cells16 + to, sim->cells16 + from, length * sizeof(uint16_t));
+	if(to < from) { // clear the part of the old location that was not overwritten
+		long long keep = to + length > from ? to + length : from;
+		clearCells16(sim, keep, from + length - keep);
+	} else if(to > from) {
+		clearCells16(sim, from, (to < from + length ? to : from + length) - from);
+	}
+}
+
+long long runCells16(Simulator *sim, long long block, int *id) {
+	uint16_t value = sim->cells16[block];
+	long long end = block + 1;
+	while(end < sim->memorySize && sim->cells16[end] == value) {
+		end++;
+	}
+	*id = value;
+	return end;
+}
+
+void createRuns(Simulator *sim) {
+	discardExtents(sim, sim->runRoot);
+	sim->runRoot = NULL;
+}
+
+/**
+ * Add an allocated run to the run-length store.
+ */
+void insertRun(Simulator *sim, long long start, long long length, int id) {
+	insertByAddress(sim, &sim->runRoot, start, length)->id = id;
+}
+
+/**
+ * Take a run out of the run-length store and recycle its node.
+ */
+void removeRun(Simulator *sim, Extent *e) {
+	removeByAddress(sim, &sim->runRoot, e);
+}
+
+int getRun(Simulator *sim, long long block) {
+	Extent *e = extentAtOrBefore(sim->runRoot, block);
+	if(e != NULL && block < e->start + e->length) {
+		return e->id;
+	}
+	return 0;
+}
+
+void fillRuns(Simulator *sim, long long start, long long length, int id) {
+	// merge with a run of the same process that ends right before or starts right after
+	Extent *e = extentAtOrBefore(sim->runRoot, start - 1);
+	if(e != NULL && e->start + e->length == start && e->id == id) {
+		start = e->start;
+		length += e->length;
+		removeRun(sim, e);
+	}
+	e = extentAtOrAfter(sim->runRoot, start + length);
+	if(e != NULL && e->start == start + length && e->id == id) {
+		length += e->length;
+		removeRun(sim, e);
+	}
+	insertRun(sim, start, length, id);
+}
+
+void clearRuns(Simulator *sim, long long start, long long length) {
+	long long end = start + length;
+	// begin with the run that holds the first cleared block, if any
+	Extent *e = extentAtOrBefore(sim->runRoot, start);
+	if(e == NULL || e->start + e->length <= start) {
+		e = extentAtOrAfter(sim->runRoot, start);
+	}
+	while(e != NULL && e->start < end) {
+		long long runStart = e->start;
+		long long runEnd = e->start + e->length;
+		int id = e->id;
+		removeRun(sim, e);
+		if(runStart < start) { // the run keeps the blocks in front of the cleared ones
+			insertRun(sim, runStart, start - runStart, id);
+		}
+		if(runEnd > end) { // and the blocks behind them
+			insertRun(sim, end, runEnd - end, id);
+			break;
+		}
+		e = extentAtOrAfter(sim->runRoot, start);
+	}
+}
+
+void moveRuns(Simulator *sim, long long from, long long to, long long length) {
+	int id = getRun(sim, from);
+	clearRuns(sim, from, length);
+	fillRuns(sim, to, length, id);
+}
+
+long long runRuns(Simulator *sim, long long block, int *id) {
+	Extent *e = extentAtOrBefore(sim->runRoot, block);
+	if(e != NULL && block < e->start + e->length) {
+		*id = e->id;
+		return e->start + e->length;
+	}
+	// a free gap lasts until the next run starts
+	*id = 0;
+	e = extentAtOrAfter(sim->runRoot, block);
+	return e != NULL ? e->start : sim->memorySize;
+}
+
+// Every store that can be selected with --store
+MemoryStore stores[] = {
+	{"u16", 65535, createCells16, getCell16, fillCells16, clearCells16, moveCells16, runCells16},
+	{"u32", INT_MAX, createCells32, getCell32, fillCells32, clearCells32, moveCells32, runCells32},
+	{"rle", INT_MAX, createRuns, getRun, fillRuns, clearRuns, moveRuns, runRuns},
+};
+
+/**
+ * The extent engine needs no bookkeeping of its own, because fillMemory,
+ * vacateProcess and compaction already update the free-extent index.
+ */
+void resetNothing(Simulator *sim, long long used) {
+}
+
+void markNothing(Simulator *sim, long long start, long long length) {
+}
+
+long long extentFindRun(Simulator *sim, long long block, long long size) {
+	// the free extent that holds block counts from block onwards
+	Extent *e = extentAtOrBefore(sim->addressRoot, block);
+	if(e != NULL && e->start + e->length - block >= size) {
+		return block;
+	}
+	e = firstExtentFrom(sim->addressRoot, block, size);
+	return e != NULL ? e->start : -1;
+}
+
+/**
+ * Count the zero bits below the lowest one bit of x, which must not be 0.
+ */
+int countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	int count = 0;
+	while((x & 1) == 0) {
+		x >>= 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+/**
+ * Set (allocated) or clear (free) the bits for a range of blocks, a word at a time.
+ */
+void setBits(Simulator *sim, long long start, long long length, bool value) {
+	long long end = start + length;
+	while(start < end) {
+		long long word = start / 64;
+		int offset = start % 64;
+		long long count = end - start < 64 - offset ? end - start : 64 - offset;
+		uint64_t mask = (count == 64 ? UINT64_MAX : ((1ULL << count) - 1)) << offset;
+		if(value) {
+			sim->occupied[word] |= mask;
+		} else {
+			sim->occupied[word] &= ~mask;
+		}
+		start += count;
+	}
+}
+
+/**
+ * Skip words in which every block is allocated.
+ *
+ * @param word first word to look at.
+ * @return the first word at or after word with a free block, or bitmapWords.
+ */
+long long skipFullWordsScalar(Simulator *sim, long long word) {
+	while(word < sim->bitmapWords && sim->occupied[word] == UINT64_MAX) {
+		word++;
+	}
+	return word;
+}
+
+/**
+ * Skip words in which every block is free.
+ *
+ * @param word first word to look at.
+ * @return the first word at or after word with an allocated block, or bitmapWords.
+ */
+long long skipEmptyWordsScalar(Simulator *sim, long long word) {
+	while(word < sim->bitmapWords && sim->occupied[word] == 0) {
+		word++;
+	}
+	return word;
+}
+
+#ifdef HAVE_AVX2_SCAN
+// Same as the scalar versions, but compare 256 bits (four words) per step
+__attribute__((target("avx2")))
+long long skipFullWordsAvx2(Simulator *sim, long long word) {
+	__m256i ones = _mm256_set1_epi64x(-1);
+	while(word + 4 <= sim->bitmapWords && _mm256_testc_si256(_mm256_loadu_si256((const __m256i *)(sim->occupied + word)), ones)) {
+		word += 4;
+	}
+	return skipFullWordsScalar(sim, word);
+}
+
+__attribute__((target("avx2")))
+long long skipEmptyWordsAvx2(Simulator *sim, long long word) {
+	while(word + 4 <= sim->bitmapWords) {
+		__m256i bits = _mm256_loadu_si256((const __m256i *)(sim->occupied + word));
+		if(!_mm256_testz_si256(bits, bits)) {
+			break;
+		}
+		word += 4;
+	}
+	return skipEmptyWordsScalar(sim, word);
+}
+#endif
+
+/**
+ * Find the first free block at or after block, or memorySize if there is none.
+ */
+long long nextFreeBlock(Simulator *sim, long long block) {
+	if(block >= sim->memorySize) {
+		return sim->memorySize;
+	}
+	long long word = block / 64;
+	uint64_t free = ~sim->occupied[word] & (UINT64_MAX << (block % 64)); // free blocks at or after block in this word
+	if(free == 0) {
+		word = sim->skipFullWords(sim, word + 1);
+		if(word >= sim->bitmapWords) {
+			return sim->memorySize;
+		}
+		free = ~sim->occupied[word];
+	}
+	return word * 64 + countTrailingZeros(free);
+}
+
+/**
+ * Find the first allocated block at or after block, or memorySize if there is none.
+ */
+long long nextUsedBlock(Simulator *sim, long long block) {
+	if(block >= sim->memorySize) {
+		return sim->memorySize;
+	}
+	long long word = block / 64;
+	uint64_t used = sim->occupied[word] & (UINT64_MAX << (block % 64)); // allocated blocks at or after block in this word
+	if(used == 0) {
+		word = sim->skipEmptyWords(sim, word + 1);
+		if(word >= sim->bitmapWords) {
+			return sim->memorySize;
+		}
+		used = sim->occupied[word];
+	}
+	long long found = word * 64 + countTrailingZeros(used);
+	return found < sim->memorySize ? found : sim->memorySize;
+}
+
+void bitmapReset(Simulator *sim, long long used) {
+	if(sim->occupied == NULL) {
+		sim->bitmapWords = (sim->memorySize + 63) / 64;
+		sim->occupied = malloc(sim->bitmapWords * sizeof(uint64_t));
+		if(sim->occupied == NULL) {
+			flushLog(&sim->log);
+			printf("ERROR! Not enough memory for a %lld-block bitmap\n", sim->memorySize);
+			exit(1); // Exit with error
+		}
+#ifdef HAVE_AVX2_SCAN
+		if(__builtin_cpu_supports("avx2")) {
+			sim->skipFullWords = skipFullWordsAvx2;
+			sim->skipEmptyWords = skipEmptyWordsAvx2;
+		}
+#endif
+	}
+	memset(sim->occupied, 0, sim->bitmapWords * sizeof(uint64_t));
+	setBits(sim, 0, used, true);
+	setBits(sim, sim->memorySize, sim->bitmapWords * 64 - sim->memorySize, true); // the bits past the end of memory
+}
+
+void bitmapReserve(Simulator *sim, long long start, long long length) {
+	setBits(sim, start, length, true);
+}
+
+void bitmapRelease(Simulator *sim, long long start, long long length) {
+	setBits(sim, start, length, false);
+}
+
+long long bitmapFindRun(Simulator *sim, long long block, long long size) {
+	long long start = nextFreeBlock(sim, block);
+	while(start < sim->memorySize) {
+		long long end = nextUsedBlock(sim, start); // the free run is start through end - 1
+		if(end - start >= size) {
+			return start;
+		}
+		start = nextFreeBlock(sim, end);
+	}
+	return -1;
+}
+
+// Every engine that can be selected with --engine
+FreeSpaceEngine engines[] = {
+	{"extent", resetNothing, markNothing, markNothing, extentFindRun},
+	{"bitmap", bitmapReset, bitmapReserve, bitmapRelease, bitmapFindRun},
+};
+
+/**
+ * Fill memory array with zeroes, which represent empty space (available for allocation)
+ */
+void clearMemory(Simulator *sim) {
+	sim->memory->create(sim); // 0 indicates free memory
+	resetExtents(sim, 0, sim->memorySize); // all of memory is one free extent
+	sim->freeSpace->reset(sim, 0);
+	sim->freeBlocks = sim->memorySize;
+	if(sim->policy->reset != NULL) {
+		sim->policy->reset(sim);
+	}
+}
+
+/**
+ * Get the process table entry for id, growing the table if needed.
+ *
+ * @param id process id, at least 1.
+ * @return the table entry.
+ */
+Process *processEntry(Simulator *sim, int id) {
+	if(id >= sim->processTableCapacity) {
+		int capacity = sim->processTableCapacity == 0 ? 1024 : sim->processTableCapacity;
+		while(capacity <= id) {
+			capacity *= 2;
+		}
+		sim->processTable = realloc(sim->processTable, capacity * sizeof(Process));
+		if(sim->processTable == NULL) {
+			flushLog(&sim->log);
+			printf("ERROR! Out of memory for the process table\n");
+			exit(1); // Exit with error
+		}
+		// new entries own nothing and are not in the heap
+		memset(sim->processTable + sim->processTableCapacity, 0, (capacity - sim->processTableCapacity) * sizeof(Process));
+		int i;
+		for(i = sim->processTableCapacity; i < capacity; i++) {
+			sim->processTable[i].heapIndex = -1;
+		}
+		sim->processTableCapacity = capacity;
+	}
+	return &sim->processTable[id];
+}
+
+/**
+ * Compare two resident processes by the order of the largestProcesses heap.
+ *
+ * @return true if process a should be vacated before process b.
+ */
+bool largerProcess(Simulator *sim, int a, int b) {
+	Process *pa = &sim->processTable[a];
+	Process *pb = &sim->processTable[b];
+	if(pa->size != pb->size) {
+		return pa->size > pb->size;
+	}
+	return pa->extents[0].start < pb->extents[0].start;
+}
+
+/**
+ * Put the process stored at heap position i in its place, moving it up or down.
+ *
+ * @param i position in largestProcesses.
+ */
+void siftProcess(Simulator *sim, int i) {
+	int id = sim->largestProcesses[i];
+	// move up while the process is larger than its parent
+	while(i > 0 && largerProcess(sim, id, sim->largestProcesses[(i - 1) / 2])) {
+		sim->largestProcesses[i] = sim->largestProcesses[(i - 1) / 2];
+		sim->processTable[sim->largestProcesses[i]].heapIndex = i;
+		i = (i - 1) / 2;
+	}
+	// move down while one of the children is larger
+	while(2 * i + 1 < sim->residentProcesses) {
+		int child = 2 * i + 1;
+		if(child + 1 < sim->residentProcesses && largerProcess(sim, sim->largestProcesses[child + 1], sim->largestProcesses[child])) {
+			child++;
+		}
+		if(!largerProcess(sim, sim->largestProcesses[child], id)) {
+			break;
+		}
+		sim->largestProcesses[i] = sim->largestProcesses[child];
+		sim->processTable[sim->largestProcesses[i]].heapIndex = i;
+		i = child;
+	}
+	sim->largestProcesses[i] = id;
+	sim->processTable[id].heapIndex = i;
+}
+
+/**
+ * Record that a process now owns blocks startBlock through startBlock + size - 1,
+ * adding it to the heap the first time it gets any memory.
+ *
+ * @param id process id that owns the blocks.
+ * @param startBlock first block of the run.
+ * @param size number of blocks in the run.
+ */
+void addOwnedExtent(Simulator *sim, int id, long long startBlock, long long size) {
+	Process *process = processEntry(sim, id);
+	// find where the run goes; runs usually arrive in address order, so check the end first
+	int position = process->extentCount;
+	while(position > 0 && process->extents[position - 1].start > startBlock) {
+		position--;
+	}
+	if(position > 0 && process->extents[position - 1].start + process->extents[position - 1].length == startBlock) {
+		process->extents[position - 1].length += size; // the run continues the one before it
+		if(position < process->extentCount && process->extents[position].start == startBlock + size) {
+			// and closes the gap to the one after it
+			process->extents[position - 1].length += process->extents[position].length;
+			memmove(process->extents + position, process->extents + position + 1, (process->extentCount - position - 1) * sizeof(OwnedExtent));
+			process->extentCount--;
+		}
+	} else if(position < process->extentCount && process->extents[position].start == startBlock + size) {
+		process->extents[position].start = startBlock; // the run ends right where the next one starts
+		process->extents[position].length += size;
+	} else {
+		if(process->extentCount == process->extentCapacity) {
+			process->extentCapacity = process->extentCapacity == 0 ? 4 : process->extentCapacity * 2;
+			process->extents = realloc(process->extents, process->extentCapacity * sizeof(OwnedExtent));
+			if(process->extents == NULL) {
+				flushLog(&sim->log);
+				printf("ERROR! Out of memory for the process table\n");
+				exit(1); // Exit with error
+			}
+		}
+		memmove(process->extents + position + 1, process->extents + position, (process->extentCount - position) * sizeof(OwnedExtent));
+		process->extents[position].start = startBlock;
+		process->extents[position].length = size;
+		process->extentCount++;
+	}
+	process->size += size;
+
+	if(process->heapIndex == -1) { // newly resident process goes to the bottom of the heap
+		if(sim->residentProcesses == sim->largestProcessesCapacity) {
+			sim->largestProcessesCapacity = sim->largestProcessesCapacity == 0 ? 1024 : sim->largestProcessesCapacity * 2;
+			sim->largestProcesses = realloc(sim->largestProcesses, sim->largestProcessesCapacity * sizeof(int));
+			if(sim->largestProcesses == NULL) {
+				flushLog(&sim->log);
+				printf("ERROR! Out of memory for the process table\n");
+				exit(1); // Exit with error
+			}
+		}
+		sim->largestProcesses[sim->residentProcesses] = id;
+		process->heapIndex = sim->residentProcesses;
+		sim->residentProcesses++;
+	}
+	siftProcess(sim, process->heapIndex);
+}
+
+/**
+ * Size of the page tables of a process with pages pages, numbered from 0. A
+ * table on level 1 maps 2^pageTableBits pages, one on level 2 maps that many
+ * level 1 tables, and so on up to the single root table.
+ *
+ * @return the size in bytes.
+ */
+long long pageTableSize(Simulator *sim, long long pages) {
+	long long tables = 0;
+	int level;
+	for(level = 1; level <= sim->pageTableLevels; level++) {
+		int shift = sim->pageTableBits * level; // log2 of the pages one table on this level maps
+		if(level == sim->pageTableLevels || shift >= 62) {
+			tables++; // the root
+			break;
+		}
+		tables += (pages + (1LL << shift) - 1) >> shift;
+	}
+	return tables * (PAGE_TABLE_ENTRY_BYTES << sim->pageTableBits);
+}
+
+/**
+ * Forget every run owned by a process and take it out of the heap.
+ *
+ * @param id process id to remove.
+ */
+void removeProcess(Simulator *sim, int id) {
+	Process *process = &sim->processTable[id];
+	int i = process->heapIndex;
+	sim->residentProcesses--;
+	if(i != sim->residentProcesses) { // fill the hole with the last heap entry
+		sim->largestProcesses[i] = sim->largestProcesses[sim->residentProcesses];
+		sim->processTable[sim->largestProcesses[i]].heapIndex = i;
+		siftProcess(sim, i);
+	}
+	free(process->extents);
+	process->extents = NULL;
+	if(process->pageTable != NULL) {
+		sim->pageTableBytes -= pageTableSize(sim, process->pageCount);
+	}
+	free(process->pageTable);
+	process->pageTable = NULL;
+	process->pageCount = 0;
+	process->extentCount = 0;
+	process->extentCapacity = 0;
+	process->size = 0;
+	process->heapIndex = -1;
+}
+
+/**
+ * Get the process that occupies the most memory.
+ *
+ * @return its id, or -1 if no process is resident.
+ */
+int largestProcess(Simulator *sim) {
+	if(sim->residentProcesses == 0) {
+		return -1;
+	}
+	return sim->largestProcesses[0];
+}
+
+/**
+ * Record that the run of a process starting at oldStart now starts at newStart.
+ * Compaction preserves the order of runs, so the heap order is unaffected.
+ *
+ * @param id process id that owns the run.
+ * @param oldStart first block of the run before it moved.
+ * @param newStart first block of the run after it moved.
+ */
+void moveOwnedExtent(Simulator *sim, int id, long long oldStart, long long newStart) {
+	Process *process = &sim->processTable[id];
+	// binary search for the run, since the runs are ordered by starting block
+	int low = 0;
+	int high = process->extentCount - 1;
+	while(low < high) {
+		int middle = (low + high) / 2;
+		if(process->extents[middle].start < oldStart) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	process->extents[low].start = newStart;
+	if(low > 0 && process->extents[low - 1].start + process->extents[low - 1].length == newStart) {
+		// the run now continues the one before it, so they become one run
+		process->extents[low - 1].length += process->extents[low].length;
+		memmove(process->extents + low, process->extents + low + 1, (process->extentCount - low - 1) * sizeof(OwnedExtent));
+		process->extentCount--;
+	}
+}
+
+/**
+ * Record that a process no longer owns blocks start through start + length - 1,
+ * which must all lie in one of its runs. The run is cut short, or split in two
+ * if the blocks are in the middle of it.
+ *
+ * @param id process id that owns the blocks.
+ * @param start first block given up.
+ * @param length number of blocks given up, fewer than the process owns.
+ */
+void removeOwnedBlocks(Simulator *sim, int id, long long start, long long length) {
+	Process *process = &sim->processTable[id];
+	int e = process->extentCount - 1;
+	while(process->extents[e].start > start) { // usually the last run, where processes shrink
+		e--;
+	}
+	OwnedExtent run = process->extents[e];
+	if(run.start == start && run.length == length) { // the whole run goes
+		memmove(process->extents + e, process->extents + e + 1, (process->extentCount - e - 1) * sizeof(OwnedExtent));
+		process->extentCount--;
+	} else if(run.start == start) {
+		process->extents[e].start += length;
+		process->extents[e].length -= length;
+	} else if(run.start + run.length == start + length) {
+		process->extents[e].length -= length;
+	} else { // the run keeps blocks on both sides, so it becomes two runs
+		if(process->extentCount == process->extentCapacity) {
+			process->extentCapacity *= 2;
+			process->extents = realloc(process->extents, process->extentCapacity * sizeof(OwnedExtent));
+			if(process->extents == NULL) {
+				flushLog(&sim->log);
+				printf("ERROR! Out of memory for the process table\n");
+				exit(1); // Exit with error
+			}
+		}
+		memmove(process->extents + e + 2, process->extents + e + 1, (process->extentCount - e - 1) * sizeof(OwnedExtent));
+		process->extents[e].length = start - run.start;
+		process->extents[e + 1].start = start + length;
+		process->extents[e + 1].length = run.start + run.length - start - length;
+		process->extentCount++;
+	}
+	process->size -= length;
+	siftProcess(sim, process->heapIndex);
+}
+
+/**
+ * Change records follow memory as it changes, so a long or endless replay can
+ * be watched, or its memory rebuilt, without dumping all of memory. Each is
+ * one line:
+ *   + ID START LENGTH     blocks START to START + LENGTH - 1 now belong to process ID
+ *   - ID START LENGTH     process ID gave those blocks back
+ *   > ID FROM TO LENGTH   compaction moved a run of process ID from FROM to TO
+ * Nothing is written unless simulatorDeltas has been called.
+ *
+ * @param kind '+', '-' or '>'.
+ * @param to where the run moved to, for '>' only.
+ */
+void recordDelta(Simulator *sim, char kind, int id, long long start, long long length, long long to) {
+	char line[96];
+	int used = 0;
+	line[used++] = kind;
+	line[used++] = ' ';
+	used += formatNumber(line + used, id);
+	line[used++] = ' ';
+	used += formatNumber(line + used, start);
+	line[used++] = ' ';
+	if(kind == '>') {
+		used += formatNumber(line + used, to);
+		line[used++] = ' ';
+	}
+	used += formatNumber(line + used, length);
+	line[used++] = '\n';
+	fwrite(line, 1, used, sim->deltas);
+}
+
+/**
+ * Fill memory like fillMemory below, without reporting it; the caller logs the allocation.
+ *
+ * @param startBlock index in memory array to start allocation from.
+ * @param id the process id to place in allocated array locations.
+ * @param size number of array locations to place the id into, starting from startBlock (inclusive)
+ */
+void fillBlocks(Simulator *sim, long long startBlock, int id, long long size) {
+	if(startBlock < 0 || startBlock + size > sim->memorySize) { // Useful check for debugging: Never go outside of bounds
+		flushLog(&sim->log);
+		printf("ERROR! Cell %lld out of bounds\n", startBlock < 0 ? startBlock : sim->memorySize);
+		exit(1); // Exit with error
+	}
+	// Useful check for debugging: Never fill reserved space. The blocks must all lie in one free extent.
+	Extent *hole = extentAtOrBefore(sim->addressRoot, startBlock);
+	if(hole == NULL || startBlock + size > hole->start + hole->length) {
+		long long cell = (hole == NULL || hole->start + hole->length <= startBlock) ? startBlock : hole->start + hole->length;
+		flushLog(&sim->log);
+		printf("ERROR! Cell %lld not empty. Contains %d\n", cell, sim->memory->get(sim, cell));
+		exit(1); // Exit with error
+	}
+	if(id > sim->memory->maxId) { // Useful check for debugging: Never store an id the cells cannot hold
+		flushLog(&sim->log);
+		printf("ERROR! Process id %d does not fit in a %s cell\n", id, sim->memory->name);
+		exit(1); // Exit with error
+	}
+	sim->memory->fill(sim, startBlock, size, id); // "allocate" blocks to id
+	if(sim->deltas != NULL) {
+		recordDelta(sim, '+', id, startBlock, size, 0);
+	}
+	reserveExtent(sim, startBlock, size); // the blocks are no longer part of a free extent
+	sim->freeSpace->reserve(sim, startBlock, size);
+	sim->freeBlocks -= size;
+	addOwnedExtent(sim, id, startBlock, size); // and the process table knows who owns them
+	sim->lastAllocationPoint = startBlock + size; // Information tracked for next-fit algorithm
+}
+
+/**
+ * Fill a specified chunk of memory with a "process" id, which
+ * in our simple simulation means that the memory block has been
+ * allocated to that process. The function fills size number of
+ * slots with the id, starting at the startBlock
+ *
+ * @param startBlock index in memory array to start allocation from.
+ * @param id the process id to place in allocated array locations.
+ * @param size number of array locations to place the id into, starting from startBlock (inclusive)
+ */
+void fillMemory(Simulator *sim, long long startBlock, int id, long long size) {
+	logEvent(&sim->log, EVENT_ALLOCATE, id, startBlock, startBlock + size - 1);
+	fillBlocks(sim, startBlock, id, size);
+}
+
+/**
+ * Deallocate (set to zero) all slots allocated to the process with the
+ * given id. The process table says where they are, so only the process's
+ * own runs are touched. The policy's release is passed in, rather than read
+ * from sim, so a replay loop that knows the policy can have it inlined.
+ *
+ * @param id process id in array to replace with 0.
+ * @param release the release of sim's policy, or NULL if it has none.
+ * @return false if the process owns no memory.
+ */
+static inline __attribute__((always_inline)) bool releaseProcessWith(Simulator *sim, int id,
+		void (*release)(Simulator *sim, long long start, long long length)) {
+	if(id <= 0 || id >= sim->processTableCapacity || sim->processTable[id].heapIndex == -1) {
+		return false; // the process owns no memory
+	}
+	Process *process = &sim->processTable[id];
+	int e;
+	// Set memory slots occupied by the process to 0, one run at a time
+	for(e = 0; e < process->extentCount; e++) {
+		OwnedExtent run = process->extents[e];
+		sim->memory->clear(sim, run.start, run.length);
+		if(sim->deltas != NULL) {
+			recordDelta(sim, '-', id, run.start, run.length, 0);
+		}
+		releaseExtent(sim, run.start, run.length); // the cleared blocks join the free extents around them
+		sim->freeSpace->release(sim, run.start, run.length);
+		sim->freeBlocks += run.length;
+		if(release != NULL) {
+			release(sim, run.start, run.length);
+		}
+	}
+	if(sim->evictor->dismiss != NULL) {
+		sim->evictor->dismiss(sim, id);
+	}
+	removeProcess(sim, id);
+	return true;
+}
+
+/**
+ * Deallocate all slots allocated to the process with the given id.
+ *
+ * @param id process id in array to replace with 0.
+ * @return false if the process owns no memory.
+ */
+bool releaseProcess(Simulator *sim, int id) {
+	return releaseProcessWith(sim, id, sim->policy->release);
+}
+
+/**
+ * Give back some of the blocks of a process that keeps the rest, as when it
+ * shrinks. The policy's own free lists are left to the caller, which knows
+ * whether the blocks belong on them.
+ *
+ * @param id process id that owns the blocks.
+ * @param start first block given up.
+ * @param length number of blocks given up, all in one run of the process.
+ */
+void releaseBlocks(Simulator *sim, int id, long long start, long long length) {
+	logEvent(&sim->log, EVENT_RELEASE, id, start, start + length - 1);
+	sim->memory->clear(sim, start, length);
+	if(sim->deltas != NULL) {
+		recordDelta(sim, '-', id, start, length, 0);
+	}
+	releaseExtent(sim, start, length);
+	sim->freeSpace->release(sim, start, length);
+	sim->freeBlocks += length;
+	removeOwnedBlocks(sim, id, start, length);
+}
+
+/**
+ * Reserve blocks that a policy rounded a request up to but the process does
+ * not use, such as the rest of its buddy block or of its last frame. They stay
+ * empty in memory, but leave the free extents like allocated blocks, since the
+ * policy cannot hand them to anyone else; they count as wasted instead of free.
+ *
+ * @param start first unused block, right after the ones the process fills.
+ * @param length number of unused blocks, which may be 0.
+ */
+void reserveTail(Simulator *sim, long long start, long long length) {
+	if(length > 0) {
+		// Useful check for debugging: the unused blocks must all lie in one free extent, as for fillBlocks
+		Extent *hole = start < 0 || start + length > sim->memorySize ? NULL : extentAtOrBefore(sim->addressRoot, start);
+		if(hole == NULL || start + length > hole->start + hole->length) {
+			flushLog(&sim->log);
+			printf("ERROR! Cells %lld through %lld are not all empty\n", start, start + length - 1);
+			exit(1); // Exit with error
+		}
+		reserveExtent(sim, start, length);
+		sim->freeSpace->reserve(sim, start, length);
+		sim->freeBlocks -= length;
+		sim->wastedBlocks += length;
+	}
+}
+
+/**
+ * Give back the blocks reserveTail reserved, as when the process is freed or resized.
+ */
+void releaseTail(Simulator *sim, long long start, long long length) {
+	if(length > 0) {
+		releaseExtent(sim, start, length);
+		sim->freeSpace->release(sim, start, length);
+		sim->freeBlocks += length;
+		sim->wastedBlocks -= length;
+	}
+}
+
+/**
+ * When memory gets full, it will be necessary to vacate "processes."
+ * This function deallocates all slots allocated to the process with
+ * the given id, and counts it as vacated.
+ *
+ * @param id process id in array to replace with 0.
+ */
+void vacateProcess(Simulator *sim, int id) {
+	logEvent(&sim->log, EVENT_VACATE, id, 0, 0);
+	sim->processesVacated++; // Incremented processes vacated with each call to vacate process
+	sim->blocksVacated += sim->processTable[id].size;
+	releaseProcess(sim, id);
+}
+
+/**
+ * Number of free blocks in memory. fillMemory and vacateProcess keep
+ * the count up to date, so this never scans memory.
+ */
+long long vacantSpace(Simulator *sim){
+	return sim->freeBlocks;
+}
+
+/**
+ * Evictors, as described where the Evictor type is declared.
+ */
+
+int largestVictim(Simulator *sim, long long size) {
+	return largestProcess(sim);
+}
+
+void admitFifo(Simulator *sim, int id) {
+	if(sim->arrivalCount == sim->arrivalCapacity) {
+		if(sim->arrivalHead > sim->arrivalCount / 2) { // most of the queue is gone, so shift what is left to the front
+			memmove(sim->arrivalQueue, sim->arrivalQueue + sim->arrivalHead, (sim->arrivalCount - sim->arrivalHead) * sizeof(Arrival));
+			sim->arrivalCount -= sim->arrivalHead;
+			sim->arrivalHead = 0;
+		} else {
+			sim->arrivalCapacity = sim->arrivalCapacity == 0 ? 1024 : sim->arrivalCapacity * 2;
+			sim->arrivalQueue = realloc(sim->arrivalQueue, sim->arrivalCapacity * sizeof(Arrival));
+			if(sim->arrivalQueue == NULL) {
+				flushLog(&sim->log);
+				printf("ERROR! Out of memory for the arrival queue\n");
+				exit(1); // Exit with error
+			}
+		}
+	}
+	sim->arrivalQueue[sim->arrivalCount].id = id;
+	sim->arrivalQueue[sim->arrivalCount].arrival = sim->processTable[id].arrival;
+	sim->arrivalCount++;
+}
+
+int fifoVictim(Simulator *sim, long long size) {
+	// entries of processes that have left since are dropped as they reach the head
+	while(sim->arrivalHead < sim->arrivalCount) {
+		Arrival *oldest = &sim->arrivalQueue[sim->arrivalHead];
+		Process *process = &sim->processTable[oldest->id];
+		if(process->heapIndex != -1 && process->arrival == oldest->arrival) {
+			return oldest->id;
+		}
+		sim->arrivalHead++;
+	}
+	return largestProcess(sim); // a process placed outside allocate, which the queue never saw
+}
+
+void admitBySize(Simulator *sim, int id) {
+	Process *process = &sim->processTable[id];
+	process->sizeNode = insertBySize(sim, &sim->processSizeRoot, id, process->size);
+}
+
+void dismissBySize(Simulator *sim, int id) {
+	Process *process = &sim->processTable[id];
+	if(process->sizeNode != NULL) {
+		removeBySize(sim, &sim->processSizeRoot, process->sizeNode);
+		process->sizeNode = NULL;
+	}
+}
+
+/**
+ * Find the smallest resident process of at least size blocks, the lowest id among equals.
+ *
+ * @return its id, or -1 if every process is smaller.
+ */
+int smallestProcessAtLeast(Simulator *sim, long long size) {
+	Extent *t = sim->processSizeRoot;
+	Extent *found = NULL;
+	while(t != NULL) {
+		if(t->length >= size) {
+			found = t;
+			t = t->sizeLeft;
+		} else {
+			t = t->sizeRight;
+		}
+	}
+	return found != NULL ? (int)found->start : -1;
+}
+
+/**
+ * Number of blocks a request still lacks, counting every free block; when
+ * there are enough but they are in the wrong places, the whole request.
+ */
+long long shortfall(Simulator *sim, long long size) {
+	return size > vacantSpace(sim) ? size - vacantSpace(sim) : size;
+}
+
+int smallestVictim(Simulator *sim, long long size) {
+	int id = smallestProcessAtLeast(sim, shortfall(sim, size));
+	return id != -1 ? id : largestProcess(sim);
+}
+
+/**
+ * Find the run of a process that holds a block.
+ *
+ * @param id process id that owns the block.
+ * @param block a block the process owns.
+ * @return the run.
+ */
+OwnedExtent ownedExtentAt(Simulator *sim, int id, long long block) {
+	Process *process = &sim->processTable[id];
+	// binary search for the last run that starts at or before block
+	int low = 0;
+	int high = process->extentCount - 1;
+	while(low < high) {
+		int middle = (low + high + 1) / 2;
+		if(process->extents[middle].start <= block) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return process->extents[low];
+}
+
+/**
+ * The process that reserved a block that is not free, and a block of it that
+ * the process fills. Only blocks a process reserved but does not use (see
+ * reserveTail) hold no id, and the process fills its last frame, or its buddy
+ * block, from the start.
+ *
+ * @param filled receives a block in the same run that holds the id.
+ * @return the process id.
+ */
+int reservedBy(Simulator *sim, long long block, long long *filled) {
+	*filled = block;
+	int id = sim->memory->get(sim, block);
+	if(id == 0 && sim->policy->paging) {
+		*filled = block - block % sim->frameSize;
+		id = sim->memory->get(sim, *filled);
+	}
+	int order;
+	for(order = 1; id == 0 && order < 63; order++) { // the smallest aligned block around it that a process fills
+		*filled = block & ~((1LL << order) - 1);
+		id = sim->memory->get(sim, *filled);
+	}
+	return id;
+}
+
+/**
+ * The block after the last one that vacating a run of a process frees: the
+ * end of the run, or of the blocks reserved past it that the process does not
+ * use, which follow the last page of a pages process or a buddy process.
+ */
+long long reservedEnd(Simulator *sim, int id, OwnedExtent run) {
+	long long end = run.start + run.length;
+	if(end == sim->memorySize || sim->memory->get(sim, end) != 0) {
+		return end;
+	}
+	Extent *next = extentAtOrAfter(sim->addressRoot, end);
+	if(next != NULL && next->start == end) { // a free extent follows, so nothing is reserved
+		return end;
+	}
+	if(sim->policy->paging) {
+		return end - end % sim->frameSize + sim->frameSize;
+	}
+	return run.start + (1LL << orderOf(sim->processTable[id].size)); // the rest of its buddy block
+}
+
+/**
+ * Pick the process on either side of the longest free extent whose run would
+ * make the longest hole if it were vacated, counting the free extent on the
+ * far side of the run too.
+ *
+ * @param hole receives the length of that hole.
+ * @return the process id, or -1 if there is no free extent or it has no neighbours.
+ */
+int holeNeighbour(Simulator *sim, long long *hole) {
+	Extent *longest = largestExtent(sim);
+	int best = -1;
+	*hole = 0;
+	if(longest == NULL) {
+		return -1;
+	}
+	long long sides[2] = {longest->start - 1, longest->start + longest->length};
+	int side;
+	for(side = 0; side < 2; side++) {
+		if(sides[side] < 0 || sides[side] >= sim->memorySize) {
+			continue;
+		}
+		long long filled;
+		int id = reservedBy(sim, sides[side], &filled);
+		OwnedExtent run = ownedExtentAt(sim, id, filled);
+		long long end = reservedEnd(sim, id, run);
+		long long length = longest->length + end - run.start;
+		Extent *far = side == 0 ? extentAtOrBefore(sim->addressRoot, run.start - 1) : extentAtOrAfter(sim->addressRoot, end);
+		if(far != NULL && (far->start + far->length == run.start || far->start == end)) {
+			length += far->length;
+		}
+		if(length > *hole) {
+			*hole = length;
+			best = id;
+		}
+	}
+	return best;
+}
+
+int adjacentVictim(Simulator *sim, long long size) {
+	long long hole;
+	int id = holeNeighbour(sim, &hole);
+	return id != -1 ? id : largestProcess(sim);
+}
+
+/**
+ * Weigh the two ways out of a request that does not fit, counting every block
+ * that is vacated or moved as one block of cost. Vacating a neighbour of the
+ * longest hole costs its blocks, and nothing more if the hole becomes long
+ * enough. Vacating the smallest process that covers the shortfall costs its
+ * blocks plus a compaction, estimated as the allocated blocks behind the
+ * first free block, which is what full compaction would move.
+ */
+int planVictim(Simulator *sim, long long size) {
+	long long hole;
+	int neighbour = holeNeighbour(sim, &hole);
+	int smallest = smallestProcessAtLeast(sim, shortfall(sim, size));
+	long long neighbourCost = LLONG_MAX;
+	long long smallestCost = LLONG_MAX;
+	if(neighbour != -1 && hole >= size) {
+		neighbourCost = sim->processTable[neighbour].size;
+	}
+	if(smallest != -1) {
+		smallestCost = sim->processTable[smallest].size;
+		Extent *first = extentAtOrAfter(sim->addressRoot, 0);
+		if(sim->policy->compacts && first != NULL) {
+			smallestCost += sim->memorySize - first->start - vacantSpace(sim);
+		}
+	}
+	if(neighbourCost == LLONG_MAX && smallestCost == LLONG_MAX) {
+		return neighbour != -1 ? neighbour : largestProcess(sim);
+	}
+	return neighbourCost <= smallestCost ? neighbour : smallest;
+}
+
+// Every evictor that can be selected with --eviction
+Evictor evictors[] = {
+	{"largest", largestVictim, NULL, NULL},
+	{"fifo", fifoVictim, admitFifo, NULL},
+	{"smallest", smallestVictim, admitBySize, dismissBySize},
+	{"adjacent", adjacentVictim, NULL, NULL},
+	{"plan", planVictim, admitBySize, dismissBySize},
+};
+
+/**
+ * For each allocation policy below, assign the process id to
+ * a contiguous region of memory with "size" number of blocks. Return
+ * true on success, and false if no region large enough exists.
+ */
+
+/**
+ * first-fit allocation according to specification above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool firstFit(Simulator *sim, int id, long long size) {
+	// the lowest block that starts a free run with enough space to hold the process
+	long long start = sim->freeSpace->findRun(sim, 0, size);
+	// if no free run is large enough, first fit fails
+	if(start == -1) {
+		return false;
+	}
+	// fill the memory with the process at the start of the free run
+	fillMemory(sim, start, id, size);
+	return true;
+}
+
+
+/**
+ * next-fit allocation according to specification above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool nextFit(Simulator *sim, int id, long long size) {
+	// set the current search position to the last checked value
+    long long i = sim->lastAllocationPoint;
+
+	if(vacantSpace(sim) > size) {
+		if(sim->lastAllocationPoint + vacantSpace(sim) > sim->memorySize){
+			sim->lastAllocationPoint = 0;
+		}
+		// the first free run of size blocks starting at or after lastChecked
+		long long start = sim->freeSpace->findRun(sim, i, size);
+		if(start == -1) {
+			// no free run of size blocks starts at or after the last allocation point
+			return false;
+		}
+		// fill the memory with the process
+		fillMemory(sim, start, id, size);
+		// update lastChecked to the next position in memory
+		sim->lastAllocationPoint = (start + size) % sim->memorySize;
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/**
+ * best-fit allocation according to specification above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool bestFit(Simulator *sim, int id, long long size) {
+	// the smallest free extent that is large enough to hold the process,
+	// taking the lowest-addressed one when several have the same size
+	Extent *hole = smallestExtentAtLeast(sim, size);
+	// if no free extent is large enough, best fit has failed
+	if(hole == NULL) {
+		return false;
+	}
+	fillMemory(sim, hole->start, id, size);
+	return true;
+}
+
+/**
+ * worst-fit allocation according to specification above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool worstFit(Simulator *sim, int id, long long size) { 
+	// the largest free extent, taking the lowest-addressed one when several have the same size
+	Extent *hole = largestExtent(sim);
+	// if even the largest free extent cannot hold the process, worst fit failed
+	if(hole == NULL || hole->length < size) {
+		return false;
+	}
+	// fill the memory starting at the beginning of the worst fitting free extent
+	fillMemory(sim, hole->start, id, size);
+	return true;
+} 
+
+/**
+ * The auto policy places each request with next-fit, first-fit, best-fit or
+ * worst-fit, and every AUTO_WINDOW requests picks which one to use next from
+ * signals that cost nothing to keep: the share of the free blocks outside the
+ * longest free extent, the compactions and vacates of the window, and moving
+ * averages of the request size and its spread. In order:
+ *   memory was compacted         best-fit, which leaves the fewest slivers that
+ *                                force the next compaction
+ *   over half the free blocks    best-fit, for the same reason
+ *   lie outside the longest extent
+ *   vacates without fragmentation  first-fit, since memory is simply full and
+ *                                first-fit keeps the free space at the top
+ *   sizes within a quarter of    worst-fit, whose leftovers stay large enough
+ *   their mean, some fragmentation  for the next request of that size
+ *   otherwise                    next-fit, the cheapest search
+ * It starts with next-fit, and each switch is logged with its reason.
+ */
+
+// Requests between the decisions of the auto policy
+#define AUTO_WINDOW 64
+
+// The fits of the auto policy, in AutoFit order
+bool (*autoFits[])(Simulator *sim, int id, long long size) = {nextFit, firstFit, bestFit, worstFit};
+
+/**
+ * Choose the fit for the next window of requests of the auto policy.
+ */
+void chooseAutoFit(Simulator *sim) {
+	Extent *longest = largestExtent(sim);
+	double fragmentation = sim->freeBlocks > 0 ? 1.0 - (double)(longest != NULL ? longest->length : 0) / sim->freeBlocks : 0.0;
+	int compactions = sim->compactionEvents - sim->autoCompactions;
+	int vacated = sim->processesVacated - sim->autoVacated;
+	bool uniform = sim->autoSizeVariance < 0.0625 * sim->autoMeanSize * sim->autoMeanSize; // spread under a quarter of the mean
+	int fit = AUTO_NEXT_FIT;
+	AutoReason reason = AUTO_CALM;
+	if(compactions > 0) {
+		fit = AUTO_BEST_FIT;
+		reason = AUTO_COMPACTING;
+	} else if(fragmentation > 0.5) {
+		fit = AUTO_BEST_FIT;
+		reason = AUTO_FRAGMENTED;
+	} else if(vacated > 0 && fragmentation < 0.25) {
+		fit = AUTO_FIRST_FIT;
+		reason = AUTO_EVICTING;
+	} else if(uniform && fragmentation >= 0.25) {
+		fit = AUTO_WORST_FIT;
+		reason = AUTO_UNIFORM;
+	}
+	if(fit != sim->autoFit) {
+		logEvent(&sim->log, EVENT_SWITCH, fit, sim->steps + 1, reason);
+		sim->autoFit = fit;
+		sim->autoSwitches++;
+	}
+	sim->autoWindowStart = sim->steps;
+	sim->autoCompactions = sim->compactionEvents;
+	sim->autoVacated = sim->processesVacated;
+}
+
+/**
+ * auto allocation, as described above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool autoPlace(Simulator *sim, int id, long long size) {
+	if(sim->autoSizeStep != sim->steps + 1) { // the first attempt of this request, not a retry after vacating
+		sim->autoSizeStep = sim->steps + 1;
+		if(sim->autoMeanSize == 0.0) {
+			sim->autoMeanSize = size;
+		}
+		double distance = size - sim->autoMeanSize;
+		sim->autoMeanSize += distance / 16;
+		sim->autoSizeVariance += (distance * distance - sim->autoSizeVariance) / 16;
+		if(sim->steps - sim->autoWindowStart >= AUTO_WINDOW) {
+			chooseAutoFit(sim);
+		}
+	}
+	return autoFits[sim->autoFit](sim, id, size);
+}
+
+/**
+ * Resize the run of a process of a contiguous policy in place. Shrinking frees
+ * the end of the run; growing takes blocks from the free extent right after it,
+ * if that extent is long enough.
+ *
+ * @param id resident process id.
+ * @param size number of blocks the process should own.
+ * @return true if the process now owns size blocks, false if it cannot grow in place.
+ */
+bool resizeRun(Simulator *sim, int id, long long size) {
+	Process *process = &sim->processTable[id];
+	OwnedExtent run = process->extents[process->extentCount - 1];
+	long long end = run.start + run.length;
+	if(size < process->size) {
+		long long cut = process->size - size;
+		releaseBlocks(sim, id, end - cut, cut);
+		if(sim->policy->release != NULL) {
+			sim->policy->release(sim, end - cut, cut);
+		}
+		return true;
+	}
+	Extent *after = extentAtOrAfter(sim->addressRoot, end);
+	if(after == NULL || after->start != end || after->length < size - process->size) {
+		return false;
+	}
+	fillMemory(sim, end, id, size - process->size);
+	return true;
+}
+
+/**
+ * The pages policy keeps its own record of which frames are free, so neither
+ * placing nor freeing a process has to search memory. The frame bitmap has a
+ * level for every 64 times fewer bits: bit f of level 0 is set when frame f is
+ * free, and bit w of level k + 1 when word w of level k is not 0. The lowest
+ * free frame at or after any frame is found with one bit scan per level, so
+ * finding frames costs a few bit operations per frame. Memory itself is still
+ * filled and cleared like for every other policy, and that keeps the index of
+ * free extents up to date too (the evictors, telemetry and stats read it): each
+ * run of frames that follow each other costs O(log holes) treap updates, which
+ * is most of the time a process takes to place or free when its frames are
+ * scattered. Only whole frames count; blocks after the last whole frame are
+ * never used.
+ */
+
+/**
+ * Mark a frame free (true) or taken (false), updating the levels above it.
+ */
+void setFrame(Simulator *sim, long long frame, bool free) {
+	int level;
+	long long index = frame;
+	for(level = 0; level < sim->frameLevels; level++) {
+		uint64_t *word = &sim->freeFrames[level][index >> 6];
+		bool wasEmpty = *word == 0;
+		if(free) {
+			*word |= 1ULL << (index & 63);
+		} else {
+			*word &= ~(1ULL << (index & 63));
+		}
+		if(free ? !wasEmpty : *word != 0) {
+			break; // the level above already has the right bit
+		}
+		index >>= 6;
+	}
+	sim->freeFrameCount += free ? 1 : -1;
+}
+
+/**
+ * Find the lowest free frame at or after frame.
+ *
+ * @return the frame, or -1 if every frame from there on is taken.
+ */
+long long nextFreeFrame(Simulator *sim, long long frame) {
+	int level = 0;
+	long long index = frame;
+	while(level < sim->frameLevels) {
+		long long word = index >> 6;
+		if(word >= sim->frameWords[level]) {
+			return -1;
+		}
+		uint64_t bits = sim->freeFrames[level][word] & (UINT64_MAX << (index & 63));
+		if(bits != 0) { // go back down, taking the lowest set bit on each level
+			index = word * 64 + countTrailingZeros(bits);
+			while(level > 0) {
+				level--;
+				index = index * 64 + countTrailingZeros(sim->freeFrames[level][index]);
+			}
+			return index;
+		}
+		level++; // nothing left in this word, so look for the next non-empty word a level up
+		index = word + 1;
+	}
+	return -1;
+}
+
+/**
+ * Mark the whole frames of a free extent free, for every extent of the index.
+ */
+void addFreeFrames(Simulator *sim, Extent *t) {
+	if(t != NULL) {
+		addFreeFrames(sim, t->addrLeft);
+		long long frame = (t->start + sim->frameSize - 1) / sim->frameSize;
+		while(frame < sim->wholeFrames && (frame + 1) * sim->frameSize <= t->start + t->length) {
+			setFrame(sim, frame, true);
+			frame++;
+		}
+		addFreeFrames(sim, t->addrRight);
+	}
+}
+
+void resetPages(Simulator *sim) {
+	if(sim->frameLevels == 0) {
+		sim->wholeFrames = sim->memorySize / sim->frameSize;
+		long long bits = sim->wholeFrames;
+		do { // levels until one word covers everything
+			sim->frameWords[sim->frameLevels] = (bits + 63) / 64;
+			sim->freeFrames[sim->frameLevels] = calloc(sim->frameWords[sim->frameLevels] > 0 ? sim->frameWords[sim->frameLevels] : 1, sizeof(uint64_t));
+			if(sim->freeFrames[sim->frameLevels] == NULL) {
+				flushLog(&sim->log);
+				printf("ERROR! Out of memory for the frame bitmap\n");
+				exit(1); // Exit with error
+			}
+			bits = sim->frameWords[sim->frameLevels];
+			sim->frameLevels++;
+		} while(bits > 1);
+	}
+	int level;
+	for(level = 0; level < sim->frameLevels; level++) {
+		memset(sim->freeFrames[level], 0, sim->frameWords[level] * sizeof(uint64_t));
+	}
+	sim->freeFrameCount = 0;
+	sim->wastedBlocks = 0;
+	addFreeFrames(sim, sim->addressRoot);
+}
+
+/**
+ * Implements simple paging memory allocation.
+ * The pages policy is special in that it may allocate
+ * non-contiguous regions of memory to the process id.
+ * However, a full frame must be reserved for each chunk
+ * of allocation, even if it is not used by the process.
+ * The lowest free frames are used, and the process's page
+ * table records which frame holds each of its pages.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @param frameSize sim's frame size, a constant in the replay loops made for one frame size.
+ * @return true if allocation succeeds, false if it fails.
+ */
+static inline __attribute__((always_inline)) bool placePages(Simulator *sim, int id, long long size, long long frameSize) {
+    long long requiredFrames = size / frameSize; // Calculate number of frames required
+    long long remainingBlocks = size % frameSize; // Calculate the number of remaining blocks after required frames
+	// the remaining blocks still need a frame of their own
+	long long framesToAllocate = requiredFrames + (remainingBlocks > 0 ? 1 : 0);
+
+	// Make sure enough free frames exist before taking any of them,
+	// so a request that does not fit leaves memory untouched
+	if(sim->freeFrameCount < framesToAllocate) {
+		return false;
+	}
+
+	Process *process = processEntry(sim, id);
+	process->pageTable = malloc(framesToAllocate * sizeof(long long));
+	if(process->pageTable == NULL) {
+		flushLog(&sim->log);
+		printf("ERROR! Out of memory for the page table\n");
+		exit(1); // Exit with error
+	}
+	process->pageCount = framesToAllocate;
+	sim->pageTableBytes += pageTableSize(sim, framesToAllocate);
+	if(sim->pageTableBytes > sim->peakPageTableBytes) {
+		sim->peakPageTableBytes = sim->pageTableBytes;
+	}
+	// Allocate the lowest free frames; the remaining blocks go at the start of the last one.
+	// Every frame is reported, but frames that follow each other are filled as one run.
+	long long frame = -1;
+	long long runStart = 0;
+	long long runLength = 0;
+	long long k;
+	for(k = 0; k < framesToAllocate; k++) {
+		frame = nextFreeFrame(sim, frame + 1);
+		setFrame(sim, frame, false);
+		process->pageTable[k] = frame;
+		long long length = k < requiredFrames ? frameSize : remainingBlocks;
+		logEvent(&sim->log, EVENT_ALLOCATE, id, frame * frameSize, frame * frameSize + length - 1);
+		if(runLength > 0 && runStart + runLength != frame * frameSize) {
+			fillBlocks(sim, runStart, id, runLength);
+			runLength = 0;
+		}
+		if(runLength == 0) {
+			runStart = frame * frameSize;
+		}
+		runLength += length;
+	}
+	fillBlocks(sim, runStart, id, runLength);
+	if(remainingBlocks > 0) { // the rest of the last frame is reserved but unused
+		reserveTail(sim, frame * frameSize + remainingBlocks, frameSize - remainingBlocks);
+	}
+	return true;
+}
+
+/**
+ * Simple paging with sim's frame size, for the policy table.
+ */
+bool pages(Simulator *sim, int id, long long size) {
+	return placePages(sim, id, size, sim->frameSize);
+}
+
+/**
+ * Mark the frames of a run of a process of the pages policy free again.
+ *
+ * @param frameSize sim's frame size, as for placePages.
+ */
+static inline __attribute__((always_inline)) void releaseFrames(Simulator *sim, long long start, long long length, long long frameSize) {
+	// no other process shares the frames of a run, so they are all free now
+	if((start + length) % frameSize != 0) { // the run ends in the partly used last frame of its process
+		releaseTail(sim, start + length, frameSize - (start + length) % frameSize);
+	}
+	long long frame;
+	for(frame = start / frameSize; frame * frameSize < start + length; frame++) {
+		setFrame(sim, frame, true);
+	}
+}
+
+void releasePages(Simulator *sim, long long start, long long length) {
+	releaseFrames(sim, start, length, sim->frameSize);
+}
+
+/**
+ * Resize a process of the pages policy in place. Its last pages are the ones
+ * that come and go: shrinking gives back the frames of the pages it no longer
+ * needs, and growing fills the rest of its last frame and then takes the
+ * lowest free frames, as placing does. Only when there are not enough free
+ * frames does it fail.
+ */
+bool resizePages(Simulator *sim, int id, long long size) {
+	Process *process = &sim->processTable[id];
+	long long old = process->size;
+	long long oldPages = process->pageCount;
+	long long newPages = (size + sim->frameSize - 1) / sim->frameSize;
+	if(newPages - oldPages > sim->freeFrameCount) {
+		return false;
+	}
+	if(newPages > oldPages) {
+		long long *larger = realloc(process->pageTable, newPages * sizeof(long long));
+		if(larger == NULL) {
+			flushLog(&sim->log);
+			printf("ERROR! Out of memory for the page table\n");
+			exit(1); // Exit with error
+		}
+		process->pageTable = larger;
+	}
+	// the unused rest of the last frame is free while pages come and go, and reserved again at the end
+	long long lastFrame = process->pageTable[oldPages - 1] * sim->frameSize;
+	releaseTail(sim, lastFrame + old - (oldPages - 1) * sim->frameSize, oldPages * sim->frameSize - old);
+	sim->pageTableBytes += pageTableSize(sim, newPages) - pageTableSize(sim, oldPages);
+	if(sim->pageTableBytes > sim->peakPageTableBytes) {
+		sim->peakPageTableBytes = sim->pageTableBytes;
+	}
+	long long page;
+	if(size < old) { // from the last page back, give up what the new size does not cover
+		for(page = oldPages - 1; page >= 0 && page * sim->frameSize >= size - sim->frameSize; page--) {
+			long long first = page * sim->frameSize; // first logical block of the page
+			long long had = old - first < sim->frameSize ? old - first : sim->frameSize;
+			long long keeps = size > first ? size - first : 0;
+			long long frameStart = process->pageTable[page] * sim->frameSize;
+			if(keeps < had) {
+				releaseBlocks(sim, id, frameStart + keeps, had - keeps);
+			}
+			if(keeps == 0) {
+				setFrame(sim, process->pageTable[page], true);
+			}
+		}
+	} else { // fill the last page, then add pages in the lowest free frames
+		long long frame = -1;
+		for(page = oldPages - 1; page < newPages; page++) {
+			long long first = page * sim->frameSize;
+			long long had = page < oldPages ? old - first : 0;
+			long long needs = size - first < sim->frameSize ? size - first : sim->frameSize;
+			if(page >= oldPages) {
+				frame = nextFreeFrame(sim, frame + 1);
+				setFrame(sim, frame, false);
+				process->pageTable[page] = frame;
+			}
+			if(needs > had) {
+				fillMemory(sim, process->pageTable[page] * sim->frameSize + had, id, needs - had);
+			}
+		}
+	}
+	process->pageCount = newPages;
+	lastFrame = process->pageTable[newPages - 1] * sim->frameSize;
+	reserveTail(sim, lastFrame + size - (newPages - 1) * sim->frameSize, newPages * sim->frameSize - size);
+	return true;
+}
+
+/**
+ * The buddy policy hands out blocks of 2^order blocks. Memory starts out as
+ * the fewest aligned power-of-two blocks that cover it (128 blocks is a single
+ * block of order 7; 1000 blocks are blocks of 512, 256, 128, 64, 32 and 8).
+ * A request is rounded up to the next power of two and takes the lowest free
+ * block of the smallest order that can hold it, splitting larger blocks in
+ * half as needed. The process only fills the blocks it asked for; the rest of
+ * its block is reserved with reserveTail, counted in wastedBlocks rather than
+ * as free. When a process is vacated its block
+ * is merged with its buddy (the other half of the block they were split from)
+ * for as long as the buddy is free too. Each step is one search of a treap,
+ * so the cost grows with the log of the number of free blocks, not with the
+ * size of memory. Compaction would break the block structure, so the buddy
+ * policy vacates the largest process instead, like paging.
+ */
+
+/**
+ * Make a block of 2^order blocks free for the buddy policy.
+ */
+void addBuddyBlock(Simulator *sim, long long start, int order) {
+	insertByAddress(sim, &sim->buddyRoots[order], start, 1LL << order);
+	sim->buddyOrders |= 1ULL << order;
+}
+
+/**
+ * Take a free block of the buddy policy off its free list.
+ */
+void takeBuddyBlock(Simulator *sim, Extent *block, int order) {
+	removeByAddress(sim, &sim->buddyRoots[order], block);
+	if(sim->buddyRoots[order] == NULL) {
+		sim->buddyOrders &= ~(1ULL << order);
+	}
+}
+
+/**
+ * The buddy policy never compacts, so it is only reset when memory is empty.
+ */
+void resetBuddy(Simulator *sim) {
+	int order;
+	for(order = 0; order < 64; order++) {
+		discardExtents(sim, sim->buddyRoots[order]);
+		sim->buddyRoots[order] = NULL;
+	}
+	sim->buddyOrders = 0;
+	sim->wastedBlocks = 0;
+	long long start = 0;
+	while(start < sim->memorySize) { // the largest aligned block that still fits, then the next
+		order = 62;
+		while((start & ((1LL << order) - 1)) != 0 || start + (1LL << order) > sim->memorySize) {
+			order--;
+		}
+		addBuddyBlock(sim, start, order);
+		start += 1LL << order;
+	}
+}
+
+/**
+ * buddy-system allocation, as described above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool buddy(Simulator *sim, int id, long long size) {
+	int order = orderOf(size);
+	if(order > 62) {
+		return false;
+	}
+	// orders that have a free block large enough; the smallest of them is used
+	uint64_t large = sim->buddyOrders & (UINT64_MAX << order);
+	if(large == 0) {
+		return false;
+	}
+	int from = countTrailingZeros(large);
+	Extent *block = sim->buddyRoots[from];
+	while(block->addrLeft != NULL) { // the lowest free block of that order
+		block = block->addrLeft;
+	}
+	long long start = block->start;
+	takeBuddyBlock(sim, block, from);
+	while(from > order) { // split in half, keeping the lower half, until the block fits snugly
+		from--;
+		addBuddyBlock(sim, start + (1LL << from), from);
+	}
+	fillMemory(sim, start, id, size);
+	reserveTail(sim, start + size, (1LL << order) - size);
+	return true;
+}
+
+void releaseBuddy(Simulator *sim, long long start, long long length) {
+	int order = orderOf(length);
+	releaseTail(sim, start + length, (1LL << order) - length);
+	while(order < 62) { // merge with the buddy while it is free as a whole
+		long long buddyStart = start ^ (1LL << order);
+		Extent *other = extentAtOrBefore(sim->buddyRoots[order], buddyStart);
+		if(other == NULL || other->start != buddyStart) {
+			break;
+		}
+		takeBuddyBlock(sim, other, order);
+		start = start < buddyStart ? start : buddyStart;
+		order++;
+	}
+	addBuddyBlock(sim, start, order);
+}
+
+/**
+ * Resize a process of the buddy policy in place. Within its block it just uses
+ * more or fewer of the blocks. Shrinking below half the block gives the upper
+ * halves back as free blocks; growing past the block merges it with its buddies
+ * above it, which only works while the block is the lower half and those
+ * buddies are free.
+ */
+bool resizeBuddy(Simulator *sim, int id, long long size) {
+	Process *process = &sim->processTable[id];
+	long long start = process->extents[0].start;
+	long long old = process->size;
+	int order = orderOf(old);
+	int target = orderOf(size);
+	if(target > 62) {
+		return false;
+	}
+	int o;
+	for(o = order; o < target; o++) { // check every buddy before taking any
+		Extent *other = extentAtOrBefore(sim->buddyRoots[o], start + (1LL << o));
+		if((start & (1LL << o)) != 0 || other == NULL || other->start != start + (1LL << o)) {
+			return false;
+		}
+	}
+	releaseTail(sim, start + old, (1LL << order) - old); // the rest of the new block is reserved at the end
+	for(o = order; o < target; o++) {
+		takeBuddyBlock(sim, extentAtOrBefore(sim->buddyRoots[o], start + (1LL << o)), o);
+	}
+	for(o = order - 1; o >= target; o--) { // the upper halves the process no longer needs
+		addBuddyBlock(sim, start + (1LL << o), o);
+	}
+	if(size > old) {
+		fillMemory(sim, start + old, id, size - old);
+	} else {
+		releaseBlocks(sim, id, start + size, old - size);
+	}
+	reserveTail(sim, start + size, (1LL << target) - size);
+	return true;
+}
+
+/**
+ * Write the free blocks of one order of the buddy policy, lowest address first.
+ */
+void saveBuddyBlocks(Extent *t, OwnedExtent *blocks, long long *count) {
+	if(t != NULL) {
+		saveBuddyBlocks(t->addrLeft, blocks, count);
+		if(blocks != NULL) {
+			blocks[*count].start = t->start;
+			blocks[*count].length = t->length;
+		}
+		(*count)++;
+		saveBuddyBlocks(t->addrRight, blocks, count);
+	}
+}
+
+long long saveBuddy(Simulator *sim, OwnedExtent *blocks) {
+	long long count = 0;
+	int order;
+	for(order = 0; order < 64; order++) {
+		saveBuddyBlocks(sim->buddyRoots[order], blocks, &count);
+	}
+	return count;
+}
+
+void loadBuddy(Simulator *sim, const OwnedExtent *blocks, long long count) {
+	int order;
+	for(order = 0; order < 64; order++) {
+		discardExtents(sim, sim->buddyRoots[order]);
+		sim->buddyRoots[order] = NULL;
+	}
+	sim->buddyOrders = 0;
+	long long b;
+	for(b = 0; b < count; b++) {
+		addBuddyBlock(sim, blocks[b].start, orderOf(blocks[b].length));
+	}
+}
+
+/**
+ * The tlsf policy (two-level segregated fit) keeps every free extent on a list
+ * for its size class. The first level is the power of two at or below the size,
+ * and the second level splits that power of two into TLSF_SECOND_LEVELS equal
+ * classes. One bitmap tells which first levels have a free block and one per
+ * first level tells which of its lists do, so finding a list takes two bit
+ * scans. The request is rounded up to the next class boundary before the
+ * search, so the head of any list found is big enough and no list is walked.
+ * The process gets exactly the blocks it asked for and the rest of the free
+ * block goes back on the list of its own class. Freed blocks are merged with
+ * free neighbours through boundary tags, two hash tables that map the first
+ * and the last block of each free block to it, so placing and freeing both
+ * take constant time on average, and the tags grow with the number of free
+ * blocks rather than the size of memory. The one exception is a request whose
+ * rounded-up class is above every free block: the blocks of its own class may
+ * still hold it, and that list is walked, which takes time linear in its
+ * length. Like the other contiguous policies, fragmented memory is compacted
+ * before anything is vacated.
+ */
+
+/**
+ * Find the slot of the boundary tag of block, or the empty slot where it would go.
+ */
+long long tagSlot(const TlsfTags *tags, long long block) {
+	long long mask = tags->capacity - 1;
+	long long slot = (long long)(((uint64_t)block * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+	while(tags->slots[slot].block != -1 && tags->slots[slot].block != block) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/**
+ * The free block with an edge at block, or NULL if there is none.
+ */
+Extent *findTag(const TlsfTags *tags, long long block) {
+	return tags->slots[tagSlot(tags, block)].extent;
+}
+
+/**
+ * Make a table of boundary tags of capacity slots, all empty.
+ */
+void clearTags(TlsfTags *tags, long long capacity) {
+	free(tags->slots);
+	tags->slots = malloc(capacity * sizeof(TlsfTag));
+	if(tags->slots == NULL) {
+		printf("ERROR! Out of memory for the tlsf boundary tags\n");
+		exit(1); // Exit with error
+	}
+	long long slot;
+	for(slot = 0; slot < capacity; slot++) {
+		tags->slots[slot].block = -1;
+		tags->slots[slot].extent = NULL;
+	}
+	tags->capacity = capacity;
+	tags->count = 0;
+}
+
+/**
+ * Tag block with a free block, doubling the table once it is half full.
+ */
+void putTag(TlsfTags *tags, long long block, Extent *extent) {
+	if(2 * (tags->count + 1) > tags->capacity) {
+		TlsfTag *old = tags->slots;
+		long long oldCapacity = tags->capacity;
+		tags->slots = NULL;
+		clearTags(tags, oldCapacity * 2);
+		long long slot;
+		for(slot = 0; slot < oldCapacity; slot++) {
+			if(old[slot].block != -1) {
+				tags->slots[tagSlot(tags, old[slot].block)] = old[slot];
+				tags->count++;
+			}
+		}
+		free(old);
+	}
+	long long slot = tagSlot(tags, block);
+	tags->count += tags->slots[slot].block == -1;
+	tags->slots[slot].block = block;
+	tags->slots[slot].extent = extent;
+}
+
+/**
+ * Remove the tag of block, moving back the tags after it that probed past its slot.
+ */
+void dropTag(TlsfTags *tags, long long block) {
+	long long mask = tags->capacity - 1;
+	long long hole = tagSlot(tags, block);
+	if(tags->slots[hole].block == -1) {
+		return;
+	}
+	tags->count--;
+	long long slot = hole;
+	for(;;) {
+		slot = (slot + 1) & mask;
+		if(tags->slots[slot].block == -1) {
+			break;
+		}
+		long long home = (long long)(((uint64_t)tags->slots[slot].block * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+		if(((slot - home) & mask) >= ((slot - hole) & mask)) { // its probe passed the hole, so it can fill it
+			tags->slots[hole] = tags->slots[slot];
+			hole = slot;
+		}
+	}
+	tags->slots[hole].block = -1;
+	tags->slots[hole].extent = NULL;
+}
+
+/**
+ * Find the size class of a free block of size blocks.
+ */
+void tlsfClass(long long size, int *first, int *second) {
+	if(size < TLSF_SECOND_LEVELS) {
+		*first = 0;
+		*second = (int)size;
+	} else {
+		int bit = highestBit(size);
+		*first = bit - TLSF_SECOND_BITS + 1;
+		*second = (int)((size >> (bit - TLSF_SECOND_BITS)) - TLSF_SECOND_LEVELS);
+	}
+}
+
+/**
+ * Make a run of blocks a free block of the tlsf policy, at the head of its list.
+ */
+void addTlsfBlock(Simulator *sim, long long start, long long length) {
+	int first, second;
+	tlsfClass(length, &first, &second);
+	Extent *block = newExtent(sim, start, length);
+	block->addrLeft = NULL;
+	block->addrRight = sim->tlsfLists[first][second];
+	if(block->addrRight != NULL) {
+		block->addrRight->addrLeft = block;
+	}
+	sim->tlsfLists[first][second] = block;
+	sim->tlsfFirst |= 1ULL << first;
+	sim->tlsfSecond[first] |= 1U << second;
+	putTag(&sim->tlsfStarts, start, block);
+	putTag(&sim->tlsfEnds, start + length - 1, block);
+}
+
+/**
+ * Take a free block of the tlsf policy off its list and recycle its node.
+ */
+void takeTlsfBlock(Simulator *sim, Extent *block) {
+	int first, second;
+	tlsfClass(block->length, &first, &second);
+	if(block->addrLeft != NULL) {
+		block->addrLeft->addrRight = block->addrRight;
+	} else {
+		sim->tlsfLists[first][second] = block->addrRight;
+	}
+	if(block->addrRight != NULL) {
+		block->addrRight->addrLeft = block->addrLeft;
+	}
+	if(sim->tlsfLists[first][second] == NULL) {
+		sim->tlsfSecond[first] &= ~(1U << second);
+		if(sim->tlsfSecond[first] == 0) {
+			sim->tlsfFirst &= ~(1ULL << first);
+		}
+	}
+	dropTag(&sim->tlsfStarts, block->start);
+	dropTag(&sim->tlsfEnds, block->start + block->length - 1);
+	block->addrRight = sim->spareExtents;
+	sim->spareExtents = block;
+}
+
+/**
+ * Take every free block of the tlsf policy off its list.
+ */
+void discardTlsfBlocks(Simulator *sim) {
+	while(sim->tlsfFirst != 0) {
+		int first = countTrailingZeros(sim->tlsfFirst);
+		takeTlsfBlock(sim, sim->tlsfLists[first][countTrailingZeros(sim->tlsfSecond[first])]);
+	}
+}
+
+/**
+ * Put every free extent of the index on the tlsf lists, lowest address first.
+ */
+void addTlsfBlocks(Simulator *sim, Extent *t) {
+	if(t != NULL) {
+		addTlsfBlocks(sim, t->addrRight); // lists are filled at the head, so the highest goes in first
+		addTlsfBlock(sim, t->start, t->length);
+		addTlsfBlocks(sim, t->addrLeft);
+	}
+}
+
+void resetTlsf(Simulator *sim) {
+	if(sim->tlsfStarts.slots == NULL) {
+		flushLog(&sim->log); // in case the tables cannot be made
+		clearTags(&sim->tlsfStarts, 64);
+		clearTags(&sim->tlsfEnds, 64);
+	}
+	discardTlsfBlocks(sim);
+	addTlsfBlocks(sim, sim->addressRoot);
+}
+
+/**
+ * The order of the tlsf lists decides which block of a class is used, and it
+ * depends on the order blocks were freed in, so it is saved list by list.
+ */
+long long saveTlsf(Simulator *sim, OwnedExtent *blocks) {
+	long long count = 0;
+	int first, second;
+	for(first = 0; first < TLSF_FIRST_LEVELS; first++) {
+		for(second = 0; second < TLSF_SECOND_LEVELS; second++) {
+			Extent *block;
+			for(block = sim->tlsfLists[first][second]; block != NULL; block = block->addrRight) {
+				if(blocks != NULL) {
+					blocks[count].start = block->start;
+					blocks[count].length = block->length;
+				}
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+void loadTlsf(Simulator *sim, const OwnedExtent *blocks, long long count) {
+	discardTlsfBlocks(sim);
+	long long b;
+	for(b = count - 1; b >= 0; b--) { // lists are filled at the head, so the last of each goes in first
+		addTlsfBlock(sim, blocks[b].start, blocks[b].length);
+	}
+}
+
+/**
+ * two-level segregated fit allocation, as described above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if allocation succeeds, false if it fails.
+ */
+bool tlsf(Simulator *sim, int id, long long size) {
+	if(size > sim->memorySize) {
+		return false;
+	}
+	// round up to the next class boundary, so every block of the class found is large enough
+	long long rounded = size;
+	if(size >= TLSF_SECOND_LEVELS) {
+		rounded += (1LL << (highestBit(size) - TLSF_SECOND_BITS)) - 1;
+	}
+	int first, second;
+	tlsfClass(rounded, &first, &second);
+	Extent *block = NULL;
+	uint32_t lists = sim->tlsfSecond[first] & (UINT32_MAX << second);
+	uint64_t levels = first + 1 < TLSF_FIRST_LEVELS ? sim->tlsfFirst & (UINT64_MAX << (first + 1)) : 0;
+	if(lists != 0) {
+		block = sim->tlsfLists[first][countTrailingZeros(lists)];
+	} else if(levels != 0) {
+		first = countTrailingZeros(levels);
+		block = sim->tlsfLists[first][countTrailingZeros(sim->tlsfSecond[first])];
+	} else {
+		// only the request's own class can be left; its blocks may or may not be
+		// large enough, so look through it (after compaction it holds the one free block)
+		tlsfClass(size, &first, &second);
+		block = sim->tlsfLists[first][second];
+		while(block != NULL && block->length < size) {
+			block = block->addrRight;
+		}
+		if(block == NULL) {
+			return false;
+		}
+	}
+	long long start = block->start;
+	long long length = block->length;
+	takeTlsfBlock(sim, block);
+	if(length > size) { // the rest of the block stays free
+		addTlsfBlock(sim, start + size, length - size);
+	}
+	fillMemory(sim, start, id, size);
+	return true;
+}
+
+void releaseTlsf(Simulator *sim, long long start, long long length) {
+	// merge with the free blocks that end right before it and start right after it
+	Extent *before = start > 0 ? findTag(&sim->tlsfEnds, start - 1) : NULL;
+	if(before != NULL) {
+		start = before->start;
+		length += before->length;
+		takeTlsfBlock(sim, before);
+	}
+	Extent *after = start + length < sim->memorySize ? findTag(&sim->tlsfStarts, start + length) : NULL;
+	if(after != NULL) {
+		length += after->length;
+		takeTlsfBlock(sim, after);
+	}
+	addTlsfBlock(sim, start, length);
+}
+
+/**
+ * Resize a process of the tlsf policy in place, like resizeRun, finding the
+ * free block after the run through the boundary tags.
+ */
+bool resizeTlsf(Simulator *sim, int id, long long size) {
+	Process *process = &sim->processTable[id];
+	if(size < process->size) {
+		return resizeRun(sim, id, size); // the freed end goes back through releaseTlsf
+	}
+	OwnedExtent run = process->extents[0];
+	long long end = run.start + run.length;
+	long long extra = size - process->size;
+	Extent *after = end < sim->memorySize ? findTag(&sim->tlsfStarts, end) : NULL;
+	if(after == NULL || after->length < extra) {
+		return false;
+	}
+	long long length = after->length;
+	takeTlsfBlock(sim, after);
+	if(length > extra) {
+		addTlsfBlock(sim, end + extra, length - extra);
+	}
+	fillMemory(sim, end, id, extra);
+	return true;
+}
+
+// Every policy that can be selected by name
+Policy policies[] = {
+	{"ff", "first-fit allocation", firstFit, NULL, NULL, resizeRun, true, false, NULL, NULL},
+	{"nf", "next-fit allocation", nextFit, NULL, NULL, resizeRun, true, false, NULL, NULL},
+	{"bf", "best-fit allocation", bestFit, NULL, NULL, resizeRun, true, false, NULL, NULL},
+	{"wf", "worst-fit allocation", worstFit, NULL, NULL, resizeRun, true, false, NULL, NULL},
+	{"pages", "simple paging", pages, resetPages, releasePages, resizePages, false, true, NULL, NULL},
+	{"buddy", "buddy-system allocation", buddy, resetBuddy, releaseBuddy, resizeBuddy, false, false, saveBuddy, loadBuddy},
+	{"tlsf", "two-level segregated fit allocation", tlsf, resetTlsf, releaseTlsf, resizeTlsf, true, false, saveTlsf, loadTlsf},
+	{"auto", "adaptive allocation, switching between the fits", autoPlace, NULL, NULL, resizeRun, true, false, NULL, NULL},
+};
+
+/**
+ * Compact memory: This function should never be used in
+ * conjunction with the paging policy, but all of the others
+ * need it.
+ *
+ * @param size number of blocks the request needs; everything moves regardless.
+ */
+void compaction(Simulator *sim, long long size) { 
+	// counts the number of current allocated blocks of memory
+	long long count = 0;
+	// loops through memory one run of equal ids at a time
+	long long i = 0;
+	while(i < sim->memorySize){
+		int id;
+		long long end = sim->memory->run(sim, i, &id);
+		// if the run is allocated, move it down to the current counter of allocated blocks
+		// this moves the allocated blocks to the front of memory
+		if(id != 0){
+			if(i != count) {
+				sim->memory->move(sim, i, count, end - i);
+				if(sim->deltas != NULL) {
+					recordDelta(sim, '>', id, i, end - i, count);
+				}
+				moveOwnedExtent(sim, id, i, count); // tell the process table where the run moved to
+				sim->blocksMoved += end - i;
+			}
+			count += end - i;
+		}
+		i = end;
+	} 
+	// every free block is now part of one extent at the end of memory
+	resetExtents(sim, count, sim->memorySize - count);
+	sim->freeSpace->reset(sim, count);
+	if(sim->policy->reset != NULL) {
+		sim->policy->reset(sim);
+	}
+
+	logEvent(&sim->log, EVENT_COMPACTION, 0, 0, 0);
+	sim->compactionEvents++;
+}
+
+/**
+ * Copy the free extents of an address treap into an array, lowest address first.
+ */
+void collectExtents(Extent *t, Extent **list, long long *count) {
+	if(t != NULL) {
+		collectExtents(t->addrLeft, list, count);
+		list[(*count)++] = t;
+		collectExtents(t->addrRight, list, count);
+	}
+}
+
+/**
+ * Compact memory just enough for a request. Any stretch of memory from the
+ * start of one free extent to the end of a later one that holds size free
+ * blocks in total will do, once its runs slide to the front of it; the stretch
+ * chosen is the one with the fewest allocated blocks, which are all that move.
+ * The runs keep their order, and the rest of memory stays where it is.
+ *
+ * @param size number of blocks the request needs.
+ */
+void windowCompaction(Simulator *sim, long long size) {
+	long long count = 0;
+	long long capacity = 1; // each free extent but the last is followed by a run of some process
+	int p;
+	for(p = 0; p < sim->residentProcesses; p++) {
+		capacity += sim->processTable[sim->largestProcesses[p]].extentCount;
+	}
+	Extent **list = malloc(capacity * sizeof(Extent *));
+	if(list == NULL) {
+		flushLog(&sim->log);
+		printf("ERROR! Out of memory for compaction\n");
+		exit(1); // Exit with error
+	}
+	collectExtents(sim->addressRoot, list, &count);
+	if(count == 0) { // memory is full, so there is nothing to gain
+		free(list);
+		return;
+	}
+
+	// slide the first extent of the stretch along, keeping just enough free blocks behind it
+	long long first = 0, last;
+	long long bestFirst = 0, bestLast = count - 1;
+	long long cheapest = LLONG_MAX;
+	long long vacant = 0; // free blocks from first through last
+	for(last = 0; last < count; last++) {
+		vacant += list[last]->length;
+		while(vacant - list[first]->length >= size) {
+			vacant -= list[first]->length;
+			first++;
+		}
+		if(vacant >= size) {
+			long long used = list[last]->start + list[last]->length - list[first]->start - vacant;
+			if(used < cheapest) {
+				cheapest = used;
+				bestFirst = first;
+				bestLast = last;
+			}
+		}
+	}
+	long long low = list[bestFirst]->start;
+	long long high = list[bestLast]->start + list[bestLast]->length;
+	long long e;
+	for(e = bestFirst; e <= bestLast; e++) { // the stretch becomes one free extent at its end
+		removeExtent(sim, list[e]);
+	}
+	free(list);
+
+	// loops through the stretch one run of equal ids at a time, as compaction does for all of memory
+	long long moved = low;
+	long long i = low;
+	while(i < high) {
+		int id;
+		long long end = sim->memory->run(sim, i, &id);
+		if(id != 0) {
+			sim->memory->move(sim, i, moved, end - i);
+			if(sim->deltas != NULL && i != moved) {
+				recordDelta(sim, '>', id, i, end - i, moved);
+			}
+			moveOwnedExtent(sim, id, i, moved); // tell the process table where the run moved to
+			sim->blocksMoved += end - i;
+			moved += end - i;
+		}
+		i = end;
+	}
+	insertExtent(sim, moved, high - moved);
+	sim->freeSpace->reserve(sim, low, moved - low);
+	sim->freeSpace->release(sim, moved, high - moved);
+	if(sim->policy->reset != NULL) {
+		sim->policy->reset(sim);
+	}
+
+	logEvent(&sim->log, EVENT_COMPACTION, 0, 0, 0);
+	sim->compactionEvents++;
+}
+
+// Every compactor that can be selected with --compaction
+Compactor compactors[] = {
+	{"full", compaction},
+	{"window", windowCompaction},
+};
+
+
+/**
+ * Nanoseconds on a clock that only moves forward, for timing single calls.
+ */
+long long monotonicNanos() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Let a policy place a process, timing the search while telemetry is written.
+ *
+ * @param place the place of sim's policy.
+ */
+static inline __attribute__((always_inline)) bool placeWith(Simulator *sim, int id, long long size,
+		bool (*place)(Simulator *sim, int id, long long size)) {
+	if(sim->telemetry == NULL) {
+		return place(sim, id, size);
+	}
+	long long start = monotonicNanos();
+	bool placed = place(sim, id, size);
+	sim->searchNanos += monotonicNanos() - start;
+	return placed;
+}
+
+/**
+ * Let the policy place a process, timing the search while telemetry is written.
+ */
+bool placeProcess(Simulator *sim, int id, long long size) {
+	return placeWith(sim, id, size, sim->policy->place);
+}
+
+/**
+ * Compact memory for a request, timing it while telemetry is written.
+ */
+void compactMemory(Simulator *sim, long long size) {
+	if(sim->telemetry == NULL) {
+		sim->compactor->compact(sim, size);
+		return;
+	}
+	long long start = monotonicNanos();
+	sim->compactor->compact(sim, size);
+	sim->compactionNanos += monotonicNanos() - start;
+}
+
+/**
+ * Vacate the process the evictor picks for a request, timing it while telemetry is written.
+ *
+ * @return false if no process is resident, so there is nothing to vacate.
+ */
+bool evictFor(Simulator *sim, long long size) {
+	long long start = sim->telemetry != NULL ? monotonicNanos() : 0;
+	int victimId = sim->evictor->victim(sim, size);
+	if(victimId != -1) {
+		vacateProcess(sim, victimId);
+	}
+	if(sim->telemetry != NULL) {
+		sim->evictionNanos += monotonicNanos() - start;
+	}
+	return victimId != -1;
+}
+
+/**
+ * Whether a request of size blocks could be placed in memory with nothing
+ * else in it: in whole frames for paging, in the largest block for the buddy
+ * system, and in all of memory otherwise.
+ */
+bool fitsEmptyMemory(const Simulator *sim, long long size) {
+	if(sim->policy->paging) {
+		return (size + sim->frameSize - 1) / sim->frameSize <= sim->wholeFrames;
+	}
+	if(sim->policy->place == buddy) {
+		return orderOf(size) <= highestBit(sim->memorySize);
+	}
+	if(sim->policy->place == nextFit || (sim->policy->place == autoPlace && autoFits[sim->autoFit] == nextFit)) {
+		return size < sim->memorySize; // next-fit wants more blocks free than it places
+	}
+	return size <= sim->memorySize;
+}
+
+/**
+ * Allocate memory of appropriate size to the process with id using the
+ * chosen policy. A request that could not fit even in empty memory fails at
+ * once, without vacating anything. For paging (and the buddy policy), allocation should only
+ * fail if there are not enough free frames (blocks), in which case the process
+ * the evictor picks (by default the one occupying the most memory) should be
+ * vacated before trying again.
+ *
+ * For policies that allocate in contiguous space,
+ * failure to allocate should result first in a check on the number of
+ * remaining free blocks in memory. If there is enough space to hold the
+ * process, but the space is fragmented, then compaction should occur.
+ * Otherwise, the process the evictor picks should be vacated before
+ * repeating the attempt to allocate.
+ *
+ * The policy's place and compacts are passed in, rather than read from sim,
+ * so a replay loop that knows the policy calls it directly and drops the
+ * branch it does not take.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @param place the place of sim's policy.
+ * @param compacts the compacts of sim's policy.
+ * @return true if the process got its memory, false if it can never fit.
+ */
+static inline __attribute__((always_inline)) bool allocateWith(Simulator *sim, int id, long long size,
+		bool (*place)(Simulator *sim, int id, long long size), bool compacts) {
+
+	if(!fitsEmptyMemory(sim, size)) {
+		// even empty memory is too small, so nothing is vacated for it
+		logEvent(&sim->log, EVENT_NO_FIT, id, size, 0);
+		return false;
+	}
+	if(compacts) { 
+			while(!placeWith(sim, id, size, place)){
+				// checks if the process was successfully allocated
+				// counts the number of current allocated blocks of memory
+				long long vacant = vacantSpace(sim);
+
+				if(size <= vacant){
+					// if we have space to allocate the process, perform compaction
+					compactMemory(sim, size);
+					sim->lastAllocationPoint = 0;
+					if(placeWith(sim, id, size, place)) {
+						break;
+					}
+					// next-fit wants more than size blocks free, so it vacates as if there were too few
+				}
+				// vacate the victim the evictor picks from an index of its own
+				if (!evictFor(sim, size)) {
+					// memory is already empty, so the request can never fit
+					logEvent(&sim->log, EVENT_NO_FIT, id, size, 0);
+					return false;
+				}
+			}
+		}
+		else {
+
+			while(!placeWith(sim, id, size, place)) {
+				// vacate the victim the evictor picks from an index of its own
+				if (!evictFor(sim, size)) {
+					// memory is already empty, so the request can never fit
+					logEvent(&sim->log, EVENT_NO_FIT, id, size, 0);
+					return false;
+				}
+			}
+		}
+		sim->processTable[id].arrival = ++sim->arrivals;
+		if(sim->evictor->admit != NULL) {
+			sim->evictor->admit(sim, id);
+		}
+		return true;
+}
+
+/**
+ * Allocate memory to the process with id using sim's policy, as described above.
+ *
+ * @param id process id being placed into memory in the allocated slots.
+ * @param size number of blocks in the process being allocated.
+ * @return true if the process got its memory, false if it can never fit.
+ */
+bool allocate(Simulator *sim, int id, long long size) {
+	return allocateWith(sim, id, size, sim->policy->place, sim->policy->compacts);
+}
+
+/**
+ * Free all memory owned by a process, as a process does when it ends.
+ *
+ * @param id process id.
+ * @param release the release of sim's policy, or NULL if it has none.
+ * @return false if the process owns no memory.
+ */
+static inline __attribute__((always_inline)) bool freeWith(Simulator *sim, int id,
+		void (*release)(Simulator *sim, long long start, long long length)) {
+	if(id <= 0 || id >= sim->processTableCapacity || sim->processTable[id].heapIndex == -1) {
+		return false;
+	}
+	logEvent(&sim->log, EVENT_FREE, id, 0, 0);
+	return releaseProcessWith(sim, id, release);
+}
+
+/**
+ * Free all memory owned by a process, as a process does when it ends.
+ *
+ * @param id process id.
+ * @return false if the process owns no memory.
+ */
+bool freeProcess(Simulator *sim, int id) {
+	return freeWith(sim, id, sim->policy->release);
+}
+
+/**
+ * Change the number of blocks a process owns, keeping what it already has
+ * where it is if the policy can grow or shrink it in place. Otherwise the
+ * process moves: it gives up its blocks and is placed again like a new
+ * request, and the blocks it owned count as copied. A process that owns
+ * nothing, because it never did or because it was vacated, is simply
+ * allocated, like realloc of a null pointer. A size that could not fit even
+ * in empty memory fails with the process keeping what it had.
+ *
+ * @param id process id.
+ * @param size number of blocks the process should own.
+ * @return true if the process owns size blocks, false if it can never fit.
+ */
+bool reallocate(Simulator *sim, int id, long long size) {
+	if(id >= sim->processTableCapacity || sim->processTable[id].heapIndex == -1) {
+		return allocate(sim, id, size);
+	}
+	Process *process = &sim->processTable[id];
+	sim->reallocations++;
+	if(size == process->size) {
+		return true;
+	}
+	if(sim->policy->resize(sim, id, size)) {
+		if(sim->evictor->dismiss != NULL) { // an evictor that indexes processes by size sees the new size
+			sim->evictor->dismiss(sim, id);
+			sim->evictor->admit(sim, id);
+		}
+		return true;
+	}
+	if(!fitsEmptyMemory(sim, size)) { // the process keeps the blocks it has rather than lose them for nothing
+		logEvent(&sim->log, EVENT_NO_FIT, id, size, 0);
+		return false;
+	}
+	long long copied = process->size; // only growing can fail, so everything the process had is copied
+	releaseProcess(sim, id);
+	if(!allocate(sim, id, size)) { // which logged that it does not fit
+		allocate(sim, id, copied); // the process goes back to the size it had
+		return false;
+	}
+	sim->reallocationsMoved++;
+	sim->blocksCopied += copied;
+	return true;
+}
+
+/**
+ * Find a memory allocation policy by name.
+ *
+ * @return the policy, or NULL if there is none with that name.
+ */
+const Policy *findPolicy(const char *name) {
+	int p;
+	for(p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+		if(strcmp(name, policies[p].name) == 0) {
+			return &policies[p];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find a memory store by name.
+ *
+ * @return the store, or NULL if there is none with that name.
+ */
+const MemoryStore *findStore(const char *name) {
+	int s;
+	for(s = 0; s < sizeof(stores) / sizeof(stores[0]); s++) {
+		if(strcmp(name, stores[s].name) == 0) {
+			return &stores[s];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find a free-space engine by name.
+ *
+ * @return the engine, or NULL if there is none with that name.
+ */
+const FreeSpaceEngine *findEngine(const char *name) {
+	int e;
+	for(e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+		if(strcmp(name, engines[e].name) == 0) {
+			return &engines[e];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find a compactor by name.
+ *
+ * @return the compactor, or NULL if there is none with that name.
+ */
+const Compactor *findCompactor(const char *name) {
+	int c;
+	for(c = 0; c < sizeof(compactors) / sizeof(compactors[0]); c++) {
+		if(strcmp(name, compactors[c].name) == 0) {
+			return &compactors[c];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find an evictor by name.
+ *
+ * @return the evictor, or NULL if there is none with that name.
+ */
+const Evictor *findEvictor(const char *name) {
+	int e;
+	for(e = 0; e < sizeof(evictors) / sizeof(evictors[0]); e++) {
+		if(strcmp(name, evictors[e].name) == 0) {
+			return &evictors[e];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Telemetry samples a simulation as it runs, as CSV with a header line or as
+ * JSON lines (one object per sample), with these fields:
+ *   step                    allocations, reallocations and frees so far
+ *   utilization             share of memory that processes own or reserve
+ *   free_blocks, free_extents, largest_free  of the blocks the policy can still hand out
+ *   external_fragmentation  share of the free blocks outside the longest free extent
+ *   wasted                  blocks reserved by rounding that no process uses
+ *   internal_fragmentation  share of the reserved blocks that are wasted
+ *   resident, vacated, compactions, moved
+ *   search_ns, compaction_ns, eviction_ns  time spent on each so far
+ *   holes_N                 free extents of N to 2N - 1 blocks ("holes" in JSON)
+ * Every figure comes from counters the simulation keeps up to date anyway, so
+ * a sample costs the same however large memory is.
+ */
+
+/**
+ * Write one telemetry sample of the simulation as it is now.
+ */
+void writeTelemetrySample(Simulator *sim) {
+	Extent *longest = largestExtent(sim);
+	long long largest = longest != NULL ? longest->length : 0;
+	long long reserved = sim->memorySize - sim->freeBlocks; // wasted blocks are reserved, not free
+	double utilization = (double)reserved / sim->memorySize;
+	double external = sim->freeBlocks > 0 ? 1.0 - (double)largest / sim->freeBlocks : 0.0;
+	double internal = reserved > 0 ? (double)sim->wastedBlocks / reserved : 0.0;
+	int classes = highestBit(sim->memorySize) + 1; // enough for a free extent as long as memory
+	int k;
+	if(sim->telemetryJson) {
+		fprintf(sim->telemetry, "{\"step\":%lld,\"utilization\":%.6f,\"free_blocks\":%lld,\"free_extents\":%lld,\"largest_free\":%lld,"
+			"\"external_fragmentation\":%.6f,\"wasted\":%lld,\"internal_fragmentation\":%.6f,\"resident\":%d,\"vacated\":%d,"
+			"\"compactions\":%d,\"moved\":%lld,\"search_ns\":%lld,\"compaction_ns\":%lld,\"eviction_ns\":%lld,\"holes\":[",
+			sim->steps, utilization, sim->freeBlocks, sim->freeExtentCount, largest, external, sim->wastedBlocks, internal,
+			sim->residentProcesses, sim->processesVacated, sim->compactionEvents, sim->blocksMoved,
+			sim->searchNanos, sim->compactionNanos, sim->evictionNanos);
+		for(k = 0; k < classes; k++) {
+			fprintf(sim->telemetry, k == 0 ? "%lld" : ",%lld", sim->holeSizes[k]);
+		}
+		fprintf(sim->telemetry, "]}\n");
+	} else {
+		fprintf(sim->telemetry, "%lld,%.6f,%lld,%lld,%lld,%.6f,%lld,%.6f,%d,%d,%d,%lld,%lld,%lld,%lld",
+			sim->steps, utilization, sim->freeBlocks, sim->freeExtentCount, largest, external, sim->wastedBlocks, internal,
+			sim->residentProcesses, sim->processesVacated, sim->compactionEvents, sim->blocksMoved,
+			sim->searchNanos, sim->compactionNanos, sim->evictionNanos);
+		for(k = 0; k < classes; k++) {
+			fprintf(sim->telemetry, ",%lld", sim->holeSizes[k]);
+		}
+		fputc('\n', sim->telemetry);
+	}
+}
+
+/**
+ * Count an allocation, reallocation or free, and take a telemetry sample if one is due.
+ */
+void telemetryStep(Simulator *sim) {
+	sim->steps++;
+	if(sim->telemetry != NULL && sim->steps % sim->telemetryEvery == 0) {
+		writeTelemetrySample(sim);
+	}
+}
+
+/**
+ * Fill in the settings the command line starts from: 128 blocks, frames of
+ * 2 blocks, first-fit, u32 cells, the extent engine, full compaction, vacating
+ * the largest process, no TLB, page tables of 4 levels of 9 bits, and no logging.
+ *
+ * @param config the settings to fill in.
+ */
+void simulatorDefaults(SimulatorConfig *config) {
+	config->memorySize = 128;
+	config->frameSize = 2;
+	config->policy = "ff";
+	config->store = "u32";
+	config->engine = "extent";
+	config->compaction = "full";
+	config->eviction = "largest";
+	config->tlbEntries = 0;
+	config->tlbWays = 1;
+	config->tlbReplacement = "lru";
+	config->pageTableLevels = 4;
+	config->pageTableBits = 9;
+	config->logLevel = LOG_OFF;
+	config->eventLogName = NULL;
+}
+
+/**
+ * Create a simulation with empty memory.
+ *
+ * @param config sizes, policy, store, engine, compaction, eviction, translation and logging of the simulation.
+ * @return the simulation, or NULL if a setting is invalid or the event log cannot be created.
+ */
+Simulator *simulatorCreate(const SimulatorConfig *config) {
+	const Policy *policy = findPolicy(config->policy);
+	const MemoryStore *store = findStore(config->store);
+	const FreeSpaceEngine *engine = findEngine(config->engine);
+	const Compactor *compactor = findCompactor(config->compaction);
+	const Evictor *evictor = findEvictor(config->eviction);
+	if(policy == NULL || store == NULL || engine == NULL || compactor == NULL || evictor == NULL || config->memorySize < 1 || config->frameSize < 1) {
+		return NULL;
+	}
+	if(config->tlbEntries < 0 || config->tlbWays < 1 || config->tlbEntries % config->tlbWays != 0 || config->pageTableLevels < 1 || config->pageTableBits < 1 || config->pageTableBits > 30) {
+		return NULL;
+	}
+	if(strcmp(config->tlbReplacement, "lru") != 0 && strcmp(config->tlbReplacement, "random") != 0) {
+		return NULL;
+	}
+	Simulator *sim = calloc(1, sizeof(Simulator));
+	if(sim == NULL) {
+		return NULL;
+	}
+	sim->memorySize = config->memorySize;
+	sim->frameSize = config->frameSize;
+	sim->policy = policy;
+	sim->memory = store;
+	sim->freeSpace = engine;
+	sim->compactor = compactor;
+	sim->evictor = evictor;
+	sim->pageTableLevels = config->pageTableLevels;
+	sim->pageTableBits = config->pageTableBits;
+	if(config->tlbEntries > 0) {
+		sim->tlb = calloc(config->tlbEntries, sizeof(TlbEntry));
+		if(sim->tlb == NULL) {
+			free(sim);
+			return NULL;
+		}
+		sim->tlbWays = config->tlbWays;
+		sim->tlbSets = config->tlbEntries / config->tlbWays;
+		sim->tlbRandom = strcmp(config->tlbReplacement, "random") == 0;
+		sim->tlbSeed = 2463534242u;
+	}
+	sim->prioritySeed = 2463534242u;
+	sim->skipFullWords = skipFullWordsScalar;
+	sim->skipEmptyWords = skipEmptyWordsScalar;
+	if(!openLog(&sim->log, config->logLevel, config->eventLogName)) {
+		free(sim->tlb);
+		free(sim);
+		return NULL;
+	}
+	clearMemory(sim); // Clear memory before allocating it for processes
+	return sim;
+}
+
+/**
+ * Give size blocks to a new process, compacting memory or vacating the
+ * largest processes first if the policy calls for it.
+ *
+ * @param sim the simulation.
+ * @param id process id, at least 1, that does not own any memory yet.
+ * @param size number of blocks, at least 1.
+ * @return true if the process got its memory, false if it can never fit or the arguments are invalid.
+ */
+bool simulatorAllocate(Simulator *sim, int id, long long size) {
+	if(id < 1 || id > sim->memory->maxId || size < 1) {
+		return false;
+	}
+	if(id < sim->processTableCapacity && sim->processTable[id].heapIndex != -1) {
+		return false; // the process already owns memory
+	}
+	logEvent(&sim->log, EVENT_REQUEST, id, size, 0);
+	bool placed = allocate(sim, id, size);
+	telemetryStep(sim);
+	return placed;
+}
+
+/**
+ * Free all memory owned by a process. Unlike a vacate, this does not count
+ * towards the processes vacated.
+ *
+ * @param sim the simulation.
+ * @param id process id.
+ * @return false if the process owns no memory.
+ */
+bool simulatorFree(Simulator *sim, int id) {
+	bool freed = freeProcess(sim, id);
+	telemetryStep(sim);
+	return freed;
+}
+
+/**
+ * Change the number of blocks a process owns, in place when the policy can
+ * and by moving the process otherwise. A process that owns no memory is
+ * allocated size blocks.
+ *
+ * @param sim the simulation.
+ * @param id process id, at least 1.
+ * @param size number of blocks, at least 1.
+ * @return true if the process owns size blocks, false if it can never fit or the arguments are invalid.
+ */
+bool simulatorReallocate(Simulator *sim, int id, long long size) {
+	if(id < 1 || id > sim->memory->maxId || size < 1) {
+		return false;
+	}
+	logEvent(&sim->log, EVENT_RESIZE, id, size, 0);
+	bool placed = reallocate(sim, id, size);
+	telemetryStep(sim);
+	return placed;
+}
+
+/**
+ * Report the counters of a simulation.
+ *
+ * @param sim the simulation.
+ * @param stats receives the counters.
+ */
+void simulatorStats(const Simulator *sim, SimulatorStats *stats) {
+	stats->memorySize = sim->memorySize;
+	stats->freeBlocks = sim->freeBlocks;
+	stats->residentProcesses = sim->residentProcesses;
+	stats->processesVacated = sim->processesVacated;
+	stats->blocksVacated = sim->blocksVacated;
+	stats->compactionEvents = sim->compactionEvents;
+	stats->blocksMoved = sim->blocksMoved;
+	stats->reallocations = sim->reallocations;
+	stats->reallocationsMoved = sim->reallocationsMoved;
+	stats->blocksCopied = sim->blocksCopied;
+	stats->freeExtents = sim->freeExtentCount;
+	memcpy(stats->holeSizes, sim->holeSizes, sizeof(stats->holeSizes));
+	const Extent *largest = sim->sizeRoot;
+	while(largest != NULL && largest->sizeRight != NULL) { // the longest extent is the last in size order
+		largest = largest->sizeRight;
+	}
+	stats->largestFreeExtent = largest != NULL ? largest->length : 0;
+	stats->wastedBlocks = sim->wastedBlocks;
+	stats->accesses = sim->accesses;
+	stats->tlbHits = sim->tlbHits;
+	stats->pageWalks = sim->pageWalks;
+	stats->faults = sim->faults;
+	stats->pageTableBytes = sim->pageTableBytes;
+	stats->peakPageTableBytes = sim->peakPageTableBytes;
+	stats->searchNanos = sim->searchNanos;
+	stats->compactionNanos = sim->compactionNanos;
+	stats->evictionNanos = sim->evictionNanos;
+}
+
+/**
+ * Translate a logical block of a process, counted from 0 over the blocks it
+ * asked for, to the block of memory that holds it. Paging looks the page up in
+ * the process's page table; the other policies walk the process's runs.
+ *
+ * @param sim the simulation.
+ * @param id process id.
+ * @param offset logical block of the process.
+ * @return the block of memory, or -1 if the process does not own that many blocks.
+ */
+long long simulatorTranslate(const Simulator *sim, int id, long long offset) {
+	if(id <= 0 || id >= sim->processTableCapacity || sim->processTable[id].heapIndex == -1 || offset < 0 || offset >= sim->processTable[id].size) {
+		return -1;
+	}
+	const Process *process = &sim->processTable[id];
+	if(process->pageTable != NULL) {
+		return process->pageTable[offset / sim->frameSize] * sim->frameSize + offset % sim->frameSize;
+	}
+	int e;
+	for(e = 0; offset >= process->extents[e].length; e++) {
+		offset -= process->extents[e].length;
+	}
+	return process->extents[e].start + offset;
+}
+
+/**
+ * Access a logical block of a process through the translation model: look
+ * its page up in the TLB, and walk the page tables if the TLB does not have
+ * it. Without a TLB every access walks the page tables.
+ *
+ * @param sim the simulation.
+ * @param id process id.
+ * @param offset logical block of the process.
+ * @return false if the process does not own that many blocks, which counts as a fault.
+ */
+bool simulatorAccess(Simulator *sim, int id, long long offset) {
+	if(simulatorTranslate(sim, id, offset) == -1) {
+		sim->faults++;
+		return false;
+	}
+	sim->accesses++;
+	if(sim->tlb == NULL) {
+		sim->pageWalks++;
+		return true;
+	}
+	long long arrival = sim->processTable[id].arrival;
+	long long page = offset / sim->frameSize;
+	TlbEntry *set = sim->tlb + (page % sim->tlbSets) * sim->tlbWays; // the low bits of the page pick the set
+	TlbEntry *victim = NULL;
+	int way;
+	sim->tlbClock++;
+	for(way = 0; way < sim->tlbWays; way++) {
+		if(set[way].arrival == arrival && set[way].page == page) {
+			set[way].lastUse = sim->tlbClock;
+			sim->tlbHits++;
+			return true;
+		}
+		if(victim == NULL || (victim->arrival != 0 && (set[way].arrival == 0 || set[way].lastUse < victim->lastUse))) {
+			victim = &set[way]; // an empty entry, or else the least recently used
+		}
+	}
+	sim->pageWalks++;
+	if(sim->tlbRandom && victim->arrival != 0) {
+		sim->tlbSeed ^= sim->tlbSeed << 13;
+		sim->tlbSeed ^= sim->tlbSeed >> 17;
+		sim->tlbSeed ^= sim->tlbSeed << 5;
+		victim = &set[sim->tlbSeed % sim->tlbWays];
+	}
+	victim->arrival = arrival;
+	victim->page = page;
+	victim->lastUse = sim->tlbClock;
+	return true;
+}
+
+/**
+ * Start writing telemetry samples, as described above writeTelemetrySample.
+ * From then on the time spent searching, compacting and vacating is measured.
+ *
+ * @param sim the simulation.
+ * @param name file the samples are written to.
+ * @param json true for JSON lines, false for CSV.
+ * @param every steps between samples, at least 1.
+ * @return false if telemetry is already on, every is invalid, or the file cannot be created.
+ */
+bool simulatorTelemetry(Simulator *sim, const char *name, bool json, long long every) {
+	if(sim->telemetry != NULL || every < 1 || (sim->telemetry = fopen(name, "w")) == NULL) {
+		return false;
+	}
+	sim->telemetryJson = json;
+	sim->telemetryEvery = every;
+	if(!json) {
+		fprintf(sim->telemetry, "step,utilization,free_blocks,free_extents,largest_free,external_fragmentation,wasted,internal_fragmentation,"
+			"resident,vacated,compactions,moved,search_ns,compaction_ns,eviction_ns");
+		long long n;
+		for(n = 1; n <= sim->memorySize && n > 0; n *= 2) {
+			fprintf(sim->telemetry, ",holes_%lld", n);
+		}
+		fputc('\n', sim->telemetry);
+	}
+	return true;
+}
+
+/**
+ * Start writing change records of memory, as described above recordDelta.
+ *
+ * @param sim the simulation.
+ * @param name file the records are written to, or "-" for standard output.
+ * @return false if change records are already written or the file cannot be created.
+ */
+bool simulatorDeltas(Simulator *sim, const char *name) {
+	if(sim->deltas != NULL) {
+		return false;
+	}
+	sim->deltas = strcmp(name, "-") == 0 ? stdout : fopen(name, "w");
+	return sim->deltas != NULL;
+}
+
+/**
+ * Write out everything a simulation has logged or recorded so far, so whoever
+ * reads its output as it runs is up to date.
+ */
+void flushSimulator(Simulator *sim) {
+	flushLog(&sim->log);
+	if(sim->deltas != NULL) {
+		fflush(sim->deltas);
+	}
+	if(sim->telemetry != NULL) {
+		fflush(sim->telemetry);
+	}
+}
+
+/**
+ * Read memory one run of equal process ids at a time.
+ *
+ * @param sim the simulation.
+ * @param block first block of the run, less than the memory size.
+ * @param id receives the process id in the run, 0 if it is free.
+ * @return the block after the end of the run.
+ */
+long long simulatorRun(Simulator *sim, long long block, int *id) {
+	return sim->memory->run(sim, block, id);
+}
+
+/**
+ * Free everything a simulation holds, after writing out what is left of its log.
+ *
+ * @param sim the simulation, which cannot be used afterwards.
+ */
+void simulatorDestroy(Simulator *sim) {
+	closeLog(&sim->log);
+	if(sim->telemetry != NULL) {
+		if(sim->steps % sim->telemetryEvery != 0) { // the last sample shows how the simulation ended
+			writeTelemetrySample(sim);
+		}
+		fclose(sim->telemetry);
+	}
+	if(sim->deltas == stdout) {
+		fflush(sim->deltas);
+	} else if(sim->deltas != NULL) {
+		fclose(sim->deltas);
+	}
+	free(sim->cells32);
+	free(sim->cells16);
+	free(sim->occupied);
+	int id;
+	for(id = 0; id < sim->processTableCapacity; id++) {
+		free(sim->processTable[id].extents);
+		free(sim->processTable[id].pageTable);
+		if(sim->processTable[id].sizeNode != NULL) { // the node joins the spare list freed below
+			sim->processTable[id].sizeNode->addrRight = sim->spareExtents;
+			sim->spareExtents = sim->processTable[id].sizeNode;
+		}
+	}
+	free(sim->processTable);
+	free(sim->largestProcesses);
+	free(sim->arrivalQueue);
+	free(sim->tlb);
+	int level;
+	for(level = 0; level < sim->frameLevels; level++) {
+		free(sim->freeFrames[level]);
+	}
+	// every extent node ends up on the spare list, which is then freed node by node
+	discardExtents(sim, sim->addressRoot);
+	discardExtents(sim, sim->runRoot);
+	int order;
+	for(order = 0; order < 64; order++) {
+		discardExtents(sim, sim->buddyRoots[order]);
+	}
+	discardTlsfBlocks(sim);
+	free(sim->tlsfStarts.slots);
+	free(sim->tlsfEnds.slots);
+	while(sim->spareExtents != NULL) {
+		Extent *next = sim->spareExtents->addrRight;
+		free(sim->spareExtents);
+		sim->spareExtents = next;
+	}
+	free(sim);
+}
+
+/**
+ * Memory split into banks, as on a host whose sockets each have memory of
+ * their own. Each bank is a simulation of its own behind a lock of its own,
+ * so requests to different banks run side by side on different threads, and
+ * a compaction or vacate stalls only the threads using that bank. A process
+ * lives in one bank, which banksAllocate returns so the caller can free it
+ * there, as a NUMA allocator finds the node from the address. Blocks of bank
+ * k are numbered from k times the size of a bank.
+ */
+typedef struct Bank {
+	pthread_mutex_t lock; // held by every call that touches the simulation
+	Simulator *sim;
+	long long freeBlocks; // sim->freeBlocks as of the last call, read without the lock to find the least loaded bank
+	long long requests; // requests that tried this bank first
+	long long spilledIn; // processes placed here because the bank they tried first was full
+	long long spilledOut; // requests that tried this bank first and were placed in another, counted without the lock
+	long long lockAcquisitions;
+	long long lockContended; // acquisitions that had to wait for another thread
+	long long lockWaitNanos; // time those waited
+} Bank;
+
+// Process ids whose banks are kept in each page of MemoryBanks.owners
+#define OWNER_PAGE_BITS 16
+
+struct MemoryBanks {
+	Bank **banks; // apart from each other, so threads of different banks do not share cache lines
+	int count;
+	BankPlacement placement;
+	int nextBank; // round-robin placement tries this bank first, modulo count
+	// 1 + the bank each process id was placed in last, 0 for none, -1 while a thread places it;
+	// in pages of 2^OWNER_PAGE_BITS ids, made when first needed, so no lock guards the table
+	int **owners;
+};
+
+/**
+ * Take a bank's lock, counting whether it had to wait for another thread.
+ */
+void lockBank(Bank *bank) {
+	if(pthread_mutex_trylock(&bank->lock) != 0) {
+		long long start = monotonicNanos();
+		pthread_mutex_lock(&bank->lock);
+		bank->lockContended++;
+		bank->lockWaitNanos += monotonicNanos() - start;
+	}
+	bank->lockAcquisitions++;
+}
+
+/**
+ * Let go of a bank's lock, publishing how much of it is free.
+ */
+void unlockBank(Bank *bank) {
+	__atomic_store_n(&bank->freeBlocks, bank->sim->freeBlocks, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&bank->lock);
+}
+
+/**
+ * Create memory of count banks, each as config describes, so memory is
+ * count * config->memorySize blocks in all.
+ *
+ * @param config settings of each bank.
+ * @param count number of banks, at least 1.
+ * @param placement which bank a new process tries first.
+ * @return the banks, or NULL if a setting is invalid or an event log cannot be created.
+ */
+MemoryBanks *banksCreate(const SimulatorConfig *config, int count, BankPlacement placement) {
+	if(count < 1) {
+		return NULL;
+	}
+	MemoryBanks *banks = calloc(1, sizeof(MemoryBanks));
+	if(banks == NULL || (banks->banks = calloc(count, sizeof(Bank *))) == NULL) {
+		free(banks);
+		return NULL;
+	}
+	banks->placement = placement;
+	for(banks->count = 0; banks->count < count; banks->count++) {
+		Bank *bank = calloc(1, sizeof(Bank));
+		if(bank == NULL || (bank->sim = simulatorCreate(config)) == NULL) {
+			free(bank);
+			banksDestroy(banks);
+			return NULL;
+		}
+		pthread_mutex_init(&bank->lock, NULL);
+		bank->freeBlocks = bank->sim->freeBlocks;
+		banks->banks[banks->count] = bank;
+	}
+	if((banks->owners = calloc((banks->banks[0]->sim->memory->maxId >> OWNER_PAGE_BITS) + 1, sizeof(int *))) == NULL) {
+		banksDestroy(banks);
+		return NULL;
+	}
+	return banks;
+}
+
+/**
+ * The slot of MemoryBanks.owners that keeps the bank of a process id,
+ * making its page if no id of the page has had one before.
+ *
+ * @return the slot, or NULL if the page cannot be allocated.
+ */
+int *ownerSlot(MemoryBanks *banks, int id) {
+	int **page = &banks->owners[id >> OWNER_PAGE_BITS];
+	int *owners = __atomic_load_n(page, __ATOMIC_ACQUIRE);
+	if(owners == NULL) {
+		int *made = calloc(1 << OWNER_PAGE_BITS, sizeof(int));
+		if(made == NULL) {
+			return NULL;
+		}
+		if(__atomic_compare_exchange_n(page, &owners, made, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			owners = made;
+		} else { // another thread made the page first
+			free(made);
+		}
+	}
+	return &owners[id & ((1 << OWNER_PAGE_BITS) - 1)];
+}
+
+/**
+ * Claim the owner slot of a process id, so no other thread places, moves or
+ * frees the process until the slot is stored again.
+ *
+ * @return what the slot held, or -1 if another thread has it claimed.
+ */
+int claimOwner(int *owner) {
+	int held = __atomic_load_n(owner, __ATOMIC_ACQUIRE);
+	if(held == -1 || !__atomic_compare_exchange_n(owner, &held, -1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return -1;
+	}
+	return held;
+}
+
+/**
+ * Whether the bank recorded in an owner slot still holds the process, which
+ * it does not once it vacated the process for another.
+ *
+ * @param held value of the slot, 1 + the bank.
+ */
+bool heldInBank(MemoryBanks *banks, int held, int id) {
+	Bank *bank = banks->banks[held - 1];
+	lockBank(bank);
+	bool resident = id < bank->sim->processTableCapacity && bank->sim->processTable[id].heapIndex != -1;
+	unlockBank(bank);
+	return resident;
+}
+
+/**
+ * The bank a new process tries first.
+ */
+int firstBank(MemoryBanks *banks, int home) {
+	int first = home;
+	int k;
+	switch(banks->placement) {
+	case BANK_HOME:
+		break;
+	case BANK_ROUND_ROBIN:
+		first = (unsigned)__atomic_fetch_add(&banks->nextBank, 1, __ATOMIC_RELAXED) % banks->count;
+		break;
+	case BANK_LEAST_LOADED: // the one with the most free blocks, the home bank if it is one of them
+		for(k = 0; k < banks->count; k++) {
+			if(__atomic_load_n(&banks->banks[k]->freeBlocks, __ATOMIC_RELAXED) > __atomic_load_n(&banks->banks[first]->freeBlocks, __ATOMIC_RELAXED)) {
+				first = k;
+			}
+		}
+		break;
+	}
+	return first;
+}
+
+/**
+ * Give size blocks to a new process in a bank, but only if the policy finds
+ * them free as they are, without compacting or vacating.
+ */
+bool placeInBank(Bank *bank, int id, long long size) {
+	Simulator *sim = bank->sim;
+	if(!placeProcess(sim, id, size)) {
+		return false;
+	}
+	sim->processTable[id].arrival = ++sim->arrivals;
+	if(sim->evictor->admit != NULL) {
+		sim->evictor->admit(sim, id);
+	}
+	telemetryStep(sim);
+	return true;
+}
+
+/**
+ * Place a process that owns no memory, for banksAllocate.
+ *
+ * @param first the bank the placement picked.
+ * @return the bank the process got its memory in, or -1 if it can never fit.
+ */
+int placeInBanks(MemoryBanks *banks, int first, int id, long long size) {
+	Bank *bank = banks->banks[first];
+	lockBank(bank);
+	bank->requests++;
+	logEvent(&bank->sim->log, EVENT_REQUEST, id, size, 0);
+	bool placed = banks->count > 1 && placeInBank(bank, id, size);
+	unlockBank(bank);
+	if(placed) {
+		return first;
+	}
+	int k;
+	for(k = 1; k < banks->count; k++) { // spill over to the next bank that has the blocks free
+		int b = (first + k) % banks->count;
+		Bank *other = banks->banks[b];
+		lockBank(other);
+		placed = placeInBank(other, id, size);
+		if(placed) {
+			other->spilledIn++;
+		}
+		unlockBank(other);
+		if(placed) {
+			__atomic_fetch_add(&bank->spilledOut, 1, __ATOMIC_RELAXED);
+			return b;
+		}
+	}
+	lockBank(bank);
+	placed = allocate(bank->sim, id, size);
+	telemetryStep(bank->sim);
+	unlockBank(bank);
+	return placed ? first : -1;
+}
+
+/**
+ * Give size blocks to a new process. It tries the bank the placement picks
+ * first, then each other bank in turn, taking blocks that are free as they
+ * are; only when none has them does the first bank compact or vacate, so
+ * that work never spreads beyond one bank. Threads may call this at once.
+ *
+ * @param banks the banks.
+ * @param home bank of the calling thread, which home placement tries first.
+ * @param id process id, at least 1.
+ * @param size number of blocks, at least 1.
+ * @return the bank the process got its memory in, or -1 if it can never fit,
+ *         already owns memory in some bank or the arguments are invalid.
+ */
+int banksAllocate(MemoryBanks *banks, int home, int id, long long size) {
+	if(home < 0 || home >= banks->count || id < 1 || id > banks->banks[0]->sim->memory->maxId || size < 1) {
+		return -1;
+	}
+	int *owner = ownerSlot(banks, id);
+	if(owner == NULL) {
+		return -1;
+	}
+	int held = claimOwner(owner);
+	if(held == -1) {
+		return -1; // another thread is placing the process
+	}
+	// only looked at once claimed, so no other thread can place the process in between
+	if(held > 0 && heldInBank(banks, held, id)) {
+		__atomic_store_n(owner, held, __ATOMIC_RELEASE);
+		return -1; // the process already owns memory
+	}
+	int first = firstBank(banks, home);
+	int placedIn = placeInBanks(banks, first, id, size);
+	__atomic_store_n(owner, placedIn + 1, __ATOMIC_RELEASE);
+	return placedIn;
+}
+
+
+/**
+ * Free all memory a process owns in a bank.
+ *
+ * @param banks the banks.
+ * @param bank the bank banksAllocate returned for the process.
+ * @param id process id.
+ * @return false if the process owns no memory there or another thread is placing it.
+ */
+bool banksFree(MemoryBanks *banks, int bank, int id) {
+	if(bank < 0 || bank >= banks->count || id < 1 || id > banks->banks[0]->sim->memory->maxId) {
+		return false;
+	}
+	int *owner = ownerSlot(banks, id);
+	int held;
+	if(owner == NULL || (held = claimOwner(owner)) == -1) { // claimed, so the slot is not cleared after another thread placed the process again
+		return false;
+	}
+	lockBank(banks->banks[bank]);
+	bool freed = simulatorFree(banks->banks[bank]->sim, id);
+	unlockBank(banks->banks[bank]);
+	__atomic_store_n(owner, freed ? 0 : held, __ATOMIC_RELEASE);
+	return freed;
+}
+
+/**
+ * Change the number of blocks a process owns, within its bank; growing it may
+ * compact or vacate that bank only. A process that was vacated is allocated
+ * size blocks in the same bank.
+ *
+ * @param banks the banks.
+ * @param bank the bank banksAllocate returned for the process.
+ * @param id process id, at least 1.
+ * @param size number of blocks, at least 1.
+ * @return true if the process owns size blocks, false if it can never fit,
+ *         owns memory in another bank, another thread is placing it or
+ *         the arguments are invalid.
+ */
+bool banksReallocate(MemoryBanks *banks, int bank, int id, long long size) {
+	if(bank < 0 || bank >= banks->count || id < 1 || id > banks->banks[0]->sim->memory->maxId) {
+		return false;
+	}
+	int *owner = ownerSlot(banks, id);
+	if(owner == NULL) {
+		return false;
+	}
+	int held = claimOwner(owner); // a process the bank vacated is allocated again, so it is claimed like banksAllocate claims it
+	if(held == -1) {
+		return false; // another thread is placing the process
+	}
+	if(held > 0 && held != bank + 1 && heldInBank(banks, held, id)) {
+		__atomic_store_n(owner, held, __ATOMIC_RELEASE);
+		return false;
+	}
+	lockBank(banks->banks[bank]);
+	bool placed = simulatorReallocate(banks->banks[bank]->sim, id, size);
+	unlockBank(banks->banks[bank]);
+	__atomic_store_n(owner, placed ? bank + 1 : held, __ATOMIC_RELEASE);
+	return placed;
+}
+
+/**
+ * Report the counters of one bank.
+ *
+ * @param banks the banks.
+ * @param bank number of the bank.
+ * @param stats receives the counters.
+ */
+void banksStats(MemoryBanks *banks, int bank, BankStats *stats) {
+	Bank *b = banks->banks[bank];
+	pthread_mutex_lock(&b->lock); // not counted, so asking does not change the answer
+	simulatorStats(b->sim, &stats->sim);
+	stats->requests = b->requests;
+	stats->spilledIn = b->spilledIn;
+	stats->spilledOut = __atomic_load_n(&b->spilledOut, __ATOMIC_RELAXED);
+	stats->lockAcquisitions = b->lockAcquisitions;
+	stats->lockContended = b->lockContended;
+	stats->lockWaitNanos = b->lockWaitNanos;
+	pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Write telemetry samples of every bank, bank 0 to NAME and bank k to NAME.k.
+ *
+ * @return false if a file cannot be created.
+ */
+bool banksTelemetry(MemoryBanks *banks, const char *name, bool json, long long every) {
+	int k;
+	for(k = 0; k < banks->count; k++) {
+		char path[4096];
+		snprintf(path, sizeof(path), k == 0 ? "%s" : "%s.%d", name, k);
+		if(!simulatorTelemetry(banks->banks[k]->sim, path, json, every)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Read memory of all the banks one run of equal process ids at a time; no
+ * run goes past the end of a bank. Call it while no thread changes memory.
+ *
+ * @param banks the banks.
+ * @param block first block of the run, less than the size of all the banks.
+ * @param id receives the process id in the run, 0 if it is free.
+ * @return the block after the end of the run.
+ */
+long long banksRun(MemoryBanks *banks, long long block, int *id) {
+	long long size = banks->banks[0]->sim->memorySize;
+	int k = block / size;
+	return k * size + simulatorRun(banks->banks[k]->sim, block - k * size, id);
+}
+
+/**
+ * Free every bank, after writing out what is left of their logs in bank order.
+ *
+ * @param banks the banks, which cannot be used afterwards.
+ */
+void banksDestroy(MemoryBanks *banks) {
+	int k;
+	if(banks->owners != NULL) {
+		int maxId = banks->banks[0]->sim->memory->maxId;
+		for(k = 0; k <= maxId >> OWNER_PAGE_BITS; k++) {
+			free(banks->owners[k]);
+		}
+		free(banks->owners);
+	}
+	for(k = 0; k < banks->count; k++) {
+		pthread_mutex_destroy(&banks->banks[k]->lock);
+		simulatorDestroy(banks->banks[k]->sim);
+		free(banks->banks[k]);
+	}
+	free(banks->banks);
+	free(banks);
+}
+
+/**
+ * A request trace is the sequence of events that main replays. It comes in
+ * two formats:
+ *   text    one event per line, as written by hand or by scripts:
+ *             SIZE             a new process asks for SIZE blocks
+ *             alloc ID SIZE    process ID asks for SIZE blocks
+ *             free ID          process ID gives back all of its blocks
+ *             realloc ID SIZE  process ID now needs SIZE blocks
+ *           A bare SIZE goes to the process after the highest id the trace
+ *           has named so far, so a trace of sizes alone numbers its
+ *           processes 1, 2, 3 and so on.
+ *   binary  the 8 bytes of traceMagic, then each size as an unsigned LEB128
+ *           varint (7 bits per byte, low bits first, high bit set on every
+ *           byte but the last), so sizes below 128 take a single byte; or
+ *           the 8 bytes of eventTraceMagic, then for each event the varint
+ *           ID * 4 + TYPE (a TraceEventType), followed by the varint SIZE
+ *           unless the event is a free
+ * As far as the trace itself says, a process must not be allocated while it
+ * holds memory or freed while it holds none; realloc of a process that holds
+ * nothing allocates it, like realloc of a null pointer. What the simulation
+ * vacates does not count, so a trace may free or realloc a vacated process.
+ * The whole file is mapped into memory and parsed in place, which is much
+ * faster than fscanf on large traces. A trace that cannot be mapped, such as
+ * a pipe or standard input (named "-"), is streamed instead: only
+ * STREAM_BUFFER_SIZE bytes of it are held at a time, and each event is
+ * replayed as soon as all of it has arrived. --convert=TEXT turns a text
+ * trace into a binary one, in the first binary format if every event is a
+ * bare size.
+ */
+typedef enum TraceEventType { TRACE_ALLOC, TRACE_FREE, TRACE_REALLOC } TraceEventType;
+
+// One event of a request trace
+typedef struct TraceEvent {
+	TraceEventType type;
+	int id; // process the event is about
+	long long size; // blocks the process asks for, 0 for a free
+} TraceEvent;
+
+typedef struct Trace {
+	const char *name; // file name, for error messages
+	const unsigned char *data; // contents of the file
+	size_t length; // bytes in data
+	size_t position; // next byte to parse
+	long long line; // line of the text trace, or event number of the binary trace, last parsed
+	bool binary; // true when data started with traceMagic or eventTraceMagic
+	bool events; // true when data started with eventTraceMagic
+	bool mapped; // true when data is an mmap of the file rather than a malloc'd copy
+	int fd; // file a streamed trace is still read from, or -1 once it has all been read
+	size_t offset; // bytes of a streamed trace dropped from the front of data so far
+	Simulator *flushing; // simulation flushed before waiting for more of a streamed trace, or NULL
+	int lastId; // highest process id the trace has named so far
+	bool lifetimes; // true once the trace frees or resizes a process
+	unsigned char *live; // live[id] is 1 while the trace says process id holds memory
+	int liveCapacity; // entries in live
+} Trace;
+
+// Bytes of a streamed trace held in memory at a time
+#define STREAM_BUFFER_SIZE (1 << 16)
+
+// Every binary trace of sizes starts with these 8 bytes
+const char traceMagic[8] = "MEMTRC1";
+// Every binary trace of events starts with these 8 bytes
+const char eventTraceMagic[8] = "MEMTRC2";
+
+/**
+ * Read more of a streamed trace into the free space at the end of its buffer,
+ * and stop streaming when the input ends.
+ */
+void readStream(Trace *trace) {
+	ssize_t count;
+	do {
+		count = read(trace->fd, (unsigned char *)trace->data + trace->length, STREAM_BUFFER_SIZE - trace->length);
+	} while(count < 0 && errno == EINTR);
+	if(count > 0) {
+		trace->length += count;
+		return;
+	}
+	if(trace->fd != STDIN_FILENO) {
+		close(trace->fd);
+	}
+	trace->fd = -1;
+}
+
+/**
+ * Open a request trace and work out which format it is in. The file is mapped
+ * into memory; files that cannot be mapped (such as pipes) are streamed
+ * instead, starting with enough of them to tell the format.
+ *
+ * @param name trace file, or "-" for standard input.
+ * @param trace receives the contents of the file.
+ * @return false if the file cannot be read.
+ */
+bool openTrace(const char *name, Trace *trace) {
+	trace->name = name;
+	trace->data = NULL;
+	trace->length = 0;
+	trace->position = 0;
+	trace->line = 0;
+	trace->binary = false;
+	trace->events = false;
+	trace->mapped = false;
+	trace->fd = -1;
+	trace->offset = 0;
+	trace->flushing = NULL;
+	trace->lastId = 0;
+	trace->lifetimes = false;
+	trace->live = NULL;
+	trace->liveCapacity = 0;
+	int fd = strcmp(name, "-") == 0 ? STDIN_FILENO : open(name, O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapping != MAP_FAILED) {
+			madvise(mapping, info.st_size, MADV_SEQUENTIAL); // the trace is read once, front to back
+			trace->data = mapping;
+			trace->length = info.st_size;
+			trace->mapped = true;
+		}
+	}
+	if(trace->mapped) {
+		if(fd != STDIN_FILENO) {
+			close(fd);
+		}
+	} else { // not a regular file, or empty: stream whatever is there
+		trace->data = malloc(STREAM_BUFFER_SIZE);
+		if(trace->data == NULL) {
+			printf("ERROR! Out of memory reading %s\n", name);
+			exit(1); // Exit with error
+		}
+		trace->fd = fd;
+		// read until the format is known, without waiting for more of a text trace than has been written
+		while(trace->fd >= 0 && trace->length < sizeof(traceMagic) && (memcmp(trace->data, traceMagic, trace->length) == 0 || memcmp(trace->data, eventTraceMagic, trace->length) == 0)) {
+			readStream(trace);
+		}
+	}
+	if(trace->length >= sizeof(traceMagic)) {
+		trace->events = memcmp(trace->data, eventTraceMagic, sizeof(eventTraceMagic)) == 0;
+		trace->binary = trace->events || memcmp(trace->data, traceMagic, sizeof(traceMagic)) == 0;
+	}
+	if(trace->binary) {
+		trace->position = sizeof(traceMagic);
+	}
+	return true;
+}
+
+/**
+ * Check whether the unparsed bytes of a streamed trace hold its next event
+ * whole: every varint of it in a binary trace, or in a text trace the end of
+ * the line it is on. Leading white space is already skipped.
+ */
+bool holdsEvent(const Trace *trace) {
+	const unsigned char *data = trace->data;
+	size_t end = trace->length;
+	size_t i = trace->position;
+	if(trace->binary) {
+		// the low bits of the first byte of the header are the type, and a free has no size
+		int varints = trace->events && i < end && (data[i] & 3) != TRACE_FREE ? 2 : 1;
+		while(i < end && varints > 0) {
+			if((data[i++] & 0x80) == 0) {
+				varints--;
+			}
+		}
+		return varints == 0;
+	}
+	return i < end && memchr(data + i, '\n', end - i) != NULL;
+}
+
+/**
+ * Make sure a streamed trace has its next event in memory, unless the input
+ * ends first. What has been parsed is dropped from the front of the buffer and
+ * more is read behind the rest. The simulation that replays the trace is
+ * flushed before each read, since the read may wait for whoever writes the trace.
+ */
+void refillTrace(Trace *trace) {
+	unsigned char *buffer = (unsigned char *)trace->data;
+	for(;;) {
+		if(!trace->binary) { // blank lines are dropped as they arrive, counting them
+			if(trace->line == 0) {
+				trace->line = 1;
+			}
+			size_t i = trace->position;
+			while(i < trace->length && (buffer[i] == ' ' || buffer[i] == '\t' || buffer[i] == '\r' || buffer[i] == '\n' || buffer[i] == '\v' || buffer[i] == '\f')) {
+				if(buffer[i] == '\n') {
+					trace->line++;
+				}
+				i++;
+			}
+			trace->position = i;
+		}
+		if(trace->fd < 0 || holdsEvent(trace)) {
+			return;
+		}
+		memmove(buffer, buffer + trace->position, trace->length - trace->position);
+		trace->length -= trace->position;
+		trace->offset += trace->position;
+		trace->position = 0;
+		if(trace->length == STREAM_BUFFER_SIZE) { // no event is this long, so it is malformed
+			return;
+		}
+		if(trace->flushing != NULL) {
+			flushSimulator(trace->flushing);
+		}
+		readStream(trace);
+	}
+}
+
+/**
+ * Move a trace that has just been opened to a byte of it, counting from the
+ * start of the file: a mapped trace jumps there, and a streamed one reads up
+ * to it without parsing what it skips.
+ *
+ * @return false if the trace ends before it.
+ */
+bool seekTrace(Trace *trace, size_t target) {
+	while(trace->fd >= 0 && trace->offset + trace->length < target) { // drop everything read so far
+		trace->offset += trace->length;
+		trace->length = 0;
+		trace->position = 0;
+		readStream(trace);
+	}
+	if(target < trace->offset || target > trace->offset + trace->length) {
+		return false;
+	}
+	trace->position = target - trace->offset;
+	return true;
+}
+
+/**
+ * Release the contents of a trace opened with openTrace.
+ */
+void closeTrace(Trace *trace) {
+	if(trace->mapped) {
+		munmap((void *)trace->data, trace->length);
+	} else {
+		free((void *)trace->data);
+	}
+	if(trace->fd >= 0 && trace->fd != STDIN_FILENO) {
+		close(trace->fd);
+	}
+	trace->fd = -1;
+	trace->data = NULL;
+	free(trace->live);
+	trace->live = NULL;
+}
+
+/**
+ * Describe where a trace stopped making sense.
+ *
+ * @param message receives the description, without a newline.
+ * @param size room in message.
+ */
+void describeMalformed(const Trace *trace, char *message, size_t size) {
+	if(trace->binary) {
+		snprintf(message, size, "Malformed request %lld in binary trace %s", trace->line, trace->name);
+	} else {
+		snprintf(message, size, "Malformed request on line %lld of %s", trace->line, trace->name);
+	}
+}
+
+/**
+ * Print where a trace stopped making sense.
+ */
+void reportMalformed(const Trace *trace) {
+	char message[4200];
+	describeMalformed(trace, message, sizeof(message));
+	printf("%s\n", message);
+}
+
+/**
+ * Parse an unsigned LEB128 varint of a binary trace.
+ *
+ * @param value receives the number.
+ * @return false if the trace ends inside the varint or it has more than 63 bits.
+ */
+bool readVarint(Trace *trace, unsigned long long *value) {
+	size_t i = trace->position;
+	int shift = 0;
+	*value = 0;
+	for(;;) {
+		if(i == trace->length || shift > 56) {
+			return false;
+		}
+		unsigned char byte = trace->data[i++];
+		*value |= (unsigned long long)(byte & 0x7f) << shift;
+		shift += 7;
+		if((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	trace->position = i;
+	return *value <= LLONG_MAX;
+}
+
+/**
+ * Parse a whole number of a text trace, after any spaces or tabs. It must be
+ * followed by white space or the end of the trace.
+ *
+ * @param value receives the number.
+ * @return false if there is no number there, or it does not fit in a long long.
+ */
+bool readTextNumber(Trace *trace, unsigned long long *value) {
+	const unsigned char *data = trace->data;
+	size_t end = trace->length;
+	size_t i = trace->position;
+	while(i < end && (data[i] == ' ' || data[i] == '\t')) {
+		i++;
+	}
+	if(i < end && data[i] == '+') { // fscanf took an explicit sign, so this does too
+		i++;
+	}
+	size_t digits = i;
+	*value = 0;
+	while(i < end && data[i] >= '0' && data[i] <= '9') {
+		unsigned digit = data[i] - '0';
+		if(*value > (LLONG_MAX - digit) / 10) { // would overflow a long long
+			return false;
+		}
+		*value = *value * 10 + digit;
+		i++;
+	}
+	trace->position = i;
+	if(i == digits) { // no digits, or a negative sign
+		return false;
+	}
+	return i == end || data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n' || data[i] == '\v' || data[i] == '\f';
+}
+
+/**
+ * Check an event against what the trace has said about its process so far,
+ * and remember what it says now.
+ *
+ * @return 1 if the event makes sense, -1 if not.
+ */
+int acceptEvent(Trace *trace, TraceEvent *event, unsigned long long id, unsigned long long size) {
+	if(id < 1 || id > INT_MAX || (event->type != TRACE_FREE && size == 0)) {
+		return -1;
+	}
+	if(id >= trace->liveCapacity) {
+		int capacity = trace->liveCapacity == 0 ? 1024 : trace->liveCapacity;
+		while(capacity <= id) {
+			capacity = capacity > INT_MAX / 2 ? INT_MAX : capacity * 2;
+		}
+		trace->live = realloc(trace->live, capacity);
+		if(trace->live == NULL) {
+			printf("ERROR! Out of memory reading %s\n", trace->name);
+			exit(1); // Exit with error
+		}
+		memset(trace->live + trace->liveCapacity, 0, capacity - trace->liveCapacity);
+		trace->liveCapacity = capacity;
+	}
+	if((event->type == TRACE_ALLOC && trace->live[id]) || (event->type == TRACE_FREE && !trace->live[id])) {
+		return -1;
+	}
+	trace->live[id] = event->type != TRACE_FREE;
+	trace->lifetimes = trace->lifetimes || event->type != TRACE_ALLOC;
+	if(id > trace->lastId) {
+		trace->lastId = id;
+	}
+	event->id = id;
+	event->size = size;
+	return 1;
+}
+
+/**
+ * Parse the next event of a trace. Sizes must be whole numbers of at least 1
+ * that fit in a long long, and ids must fit in an int. Text traces may separate
+ * bare sizes with any white space, like fscanf did, but anything else on a line
+ * is malformed.
+ *
+ * @param trace trace opened with openTrace.
+ * @param event receives the event.
+ * @return 1 for an event, 0 at the end of the trace, -1 if the next event is malformed.
+ */
+int nextEvent(Trace *trace, TraceEvent *event) {
+	if(trace->fd >= 0) {
+		refillTrace(trace);
+	}
+	const unsigned char *data = trace->data;
+	size_t end = trace->length;
+	unsigned long long id = (unsigned long long)trace->lastId + 1; // for a bare size
+	unsigned long long size = 0;
+	event->type = TRACE_ALLOC;
+	if(trace->binary) {
+		if(trace->position == end) {
+			return 0;
+		}
+		trace->line++;
+		if(trace->events) {
+			unsigned long long header;
+			if(!readVarint(trace, &header) || (header & 3) > TRACE_REALLOC) {
+				return -1;
+			}
+			event->type = header & 3;
+			id = header >> 2;
+		}
+		if(event->type != TRACE_FREE && !readVarint(trace, &size)) {
+			return -1;
+		}
+		return acceptEvent(trace, event, id, size);
+	}
+	if(trace->line == 0) {
+		trace->line = 1;
+	}
+	size_t i = trace->position;
+	while(i < end && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n' || data[i] == '\v' || data[i] == '\f')) {
+		if(data[i] == '\n') {
+			trace->line++;
+		}
+		i++;
+	}
+	trace->position = i;
+	if(i == end) {
+		return 0;
+	}
+	if(data[i] >= 'a' && data[i] <= 'z') { // an event with an explicit process id
+		size_t word = i;
+		while(i < end && data[i] >= 'a' && data[i] <= 'z') {
+			i++;
+		}
+		trace->position = i;
+		if(i - word == 5 && memcmp(data + word, "alloc", 5) == 0) {
+			event->type = TRACE_ALLOC;
+		} else if(i - word == 4 && memcmp(data + word, "free", 4) == 0) {
+			event->type = TRACE_FREE;
+		} else if(i - word == 7 && memcmp(data + word, "realloc", 7) == 0) {
+			event->type = TRACE_REALLOC;
+		} else {
+			return -1;
+		}
+		if(i == end || (data[i] != ' ' && data[i] != '\t') || !readTextNumber(trace, &id)) {
+			return -1;
+		}
+	}
+	if(event->type != TRACE_FREE && !readTextNumber(trace, &size)) {
+		return -1;
+	}
+	return acceptEvent(trace, event, id, size);
+}
+
+/**
+ * Write a number to a binary trace as an unsigned LEB128 varint.
+ */
+void writeVarint(FILE *output, unsigned long long value) {
+	unsigned char bytes[10];
+	int length = 0;
+	do { // 7 bits at a time, low bits first
+		bytes[length] = value & 0x7f;
+		value >>= 7;
+		if(value != 0) {
+			bytes[length] |= 0x80;
+		}
+		length++;
+	} while(value != 0);
+	fwrite(bytes, 1, length, output);
+}
+
+/**
+ * Write a request trace, in either format, to a binary trace. The trace is
+ * read twice: once to check it and find out whether it is sizes alone, and
+ * once to write it.
+ *
+ * @param inputName trace to read.
+ * @param outputName binary trace to (over)write.
+ * @return 0 on success, 1 if a file cannot be used or the input is malformed.
+ */
+int convertTrace(const char *inputName, const char *outputName) {
+	Trace trace;
+	if(!openTrace(inputName, &trace)) {
+		printf("Problem reading file %s\n", inputName);
+		return 1; // Error
+	}
+	TraceEvent event;
+	long long count = 0;
+	bool sizesOnly = true; // every event allocates for the next process, as a trace of sizes does
+	int status;
+	while((status = nextEvent(&trace, &event)) == 1) {
+		count++;
+		sizesOnly = sizesOnly && event.type == TRACE_ALLOC && event.id == count;
+	}
+	if(status < 0) {
+		reportMalformed(&trace);
+		closeTrace(&trace);
+		return 1; // Error
+	}
+	closeTrace(&trace);
+	if(!openTrace(inputName, &trace)) {
+		printf("Problem reading file %s\n", inputName);
+		return 1; // Error
+	}
+	FILE *output = fopen(outputName, "wb");
+	if(output == NULL) {
+		printf("Problem writing file %s\n", outputName);
+		closeTrace(&trace);
+		return 1; // Error
+	}
+	fwrite(sizesOnly ? traceMagic : eventTraceMagic, 1, sizeof(traceMagic), output);
+	while(nextEvent(&trace, &event) == 1) {
+		if(!sizesOnly) {
+			writeVarint(output, (unsigned long long)event.id << 2 | event.type);
+		}
+		if(event.type != TRACE_FREE) {
+			writeVarint(output, event.size);
+		}
+	}
+	fclose(output);
+	closeTrace(&trace);
+	printf("Converted %lld requests from %s to %s\n", count, inputName, outputName);
+	return 0;
+}
+
+/**
+ * Read a whole request trace into an array, so it can be replayed many times.
+ *
+ * @param name trace file, in either format.
+ * @param events receives the events, which the caller frees.
+ * @param count receives the number of events.
+ * @return 0 on success, 1 if the file cannot be read or is malformed.
+ */
+int loadTrace(const char *name, TraceEvent **events, long long *count) {
+	Trace trace;
+	if(!openTrace(name, &trace)) {
+		printf("Problem reading file %s\n", name);
+		return 1; // Error
+	}
+	long long capacity = 1024;
+	TraceEvent event;
+	int status;
+	*events = malloc(capacity * sizeof(TraceEvent));
+	*count = 0;
+	while(*events != NULL && (status = nextEvent(&trace, &event)) == 1) {
+		if(*count == capacity) {
+			capacity *= 2;
+			TraceEvent *larger = realloc(*events, capacity * sizeof(TraceEvent));
+			if(larger == NULL) {
+				free(*events);
+			}
+			*events = larger;
+			if(larger == NULL) {
+				break;
+			}
+		}
+		(*events)[(*count)++] = event;
+	}
+	if(*events == NULL) {
+		printf("ERROR! Out of memory reading %s\n", name);
+		exit(1); // Exit with error
+	}
+	if(status < 0) {
+		reportMalformed(&trace);
+		closeTrace(&trace);
+		free(*events);
+		return 1; // Error
+	}
+	closeTrace(&trace);
+	return 0;
+}
+
+/**
+ * Replay one event of a request trace, announcing it in the log first, with
+ * the parts of sim's policy that allocating and freeing use passed in.
+ *
+ * @param event the event.
+ * @return true if the process owns the memory it asked for, false after a free
+ *         or if it can never fit.
+ */
+static inline __attribute__((always_inline)) bool replayWith(Simulator *sim, const TraceEvent *event,
+		bool (*place)(Simulator *sim, int id, long long size),
+		void (*release)(Simulator *sim, long long start, long long length), bool compacts) {
+	bool placed = false;
+	switch(event->type) {
+	case TRACE_ALLOC:
+		logEvent(&sim->log, EVENT_REQUEST, event->id, event->size, 0);
+		placed = allocateWith(sim, event->id, event->size, place, compacts);
+		break;
+	case TRACE_REALLOC:
+		logEvent(&sim->log, EVENT_RESIZE, event->id, event->size, 0);
+		placed = reallocate(sim, event->id, event->size);
+		break;
+	case TRACE_FREE:
+		freeWith(sim, event->id, release); // a process that was vacated has nothing left to free
+		break;
+	}
+	telemetryStep(sim);
+	return placed;
+}
+
+/**
+ * Replay one event of a request trace, announcing it in the log first.
+ *
+ * @param event the event.
+ * @return true if the process owns the memory it asked for, false after a free
+ *         or if it can never fit.
+ */
+bool replayEvent(Simulator *sim, const TraceEvent *event) {
+	return replayWith(sim, event, sim->policy->place, sim->policy->release, sim->policy->compacts);
+}
+
+// Replays a whole trace that is already in memory
+typedef void (*ReplayLoop)(Simulator *sim, const TraceEvent *events, long long count);
+
+/**
+ * Replay a whole trace one replayEvent at a time, which calls the policy
+ * through sim's policy table. Any simulation can be replayed this way.
+ */
+void replayEvents(Simulator *sim, const TraceEvent *events, long long count) {
+	long long e;
+	for(e = 0; e < count; e++) {
+		replayEvent(sim, &events[e]);
+	}
+}
+
+/**
+ * Replay loops made for one policy, and for pages one frame size. The policy's
+ * place and release are constants in them, so the compiler calls or inlines
+ * them directly, drops the branches of allocate the policy never takes, and
+ * turns the divisions by the frame size into shifts.
+ */
+#define REPLAY_LOOP(name, place, release, compacts) \
+	void name(Simulator *sim, const TraceEvent *events, long long count) { \
+		long long e; \
+		for(e = 0; e < count; e++) { \
+			replayWith(sim, &events[e], place, release, compacts); \
+		} \
+	}
+
+// pages with a frame size known when compiling, for REPLAY_LOOP
+#define PAGES_WITH_FRAME(frame) \
+	static inline __attribute__((always_inline)) bool pagesFrame##frame(Simulator *sim, int id, long long size) { \
+		return placePages(sim, id, size, frame); \
+	} \
+	static inline __attribute__((always_inline)) void releasePagesFrame##frame(Simulator *sim, long long start, long long length) { \
+		releaseFrames(sim, start, length, frame); \
+	} \
+	REPLAY_LOOP(replayPagesFrame##frame, pagesFrame##frame, releasePagesFrame##frame, false)
+
+REPLAY_LOOP(replayFirstFit, firstFit, NULL, true)
+REPLAY_LOOP(replayNextFit, nextFit, NULL, true)
+REPLAY_LOOP(replayBestFit, bestFit, NULL, true)
+REPLAY_LOOP(replayWorstFit, worstFit, NULL, true)
+REPLAY_LOOP(replayPages, pages, releasePages, false)
+REPLAY_LOOP(replayBuddy, buddy, releaseBuddy, false)
+REPLAY_LOOP(replayTlsf, tlsf, releaseTlsf, true)
+REPLAY_LOOP(replayAuto, autoPlace, NULL, true)
+PAGES_WITH_FRAME(1)
+PAGES_WITH_FRAME(2)
+PAGES_WITH_FRAME(4)
+PAGES_WITH_FRAME(8)
+PAGES_WITH_FRAME(16)
+
+// A replay loop and the simulations it is made for
+typedef struct SpecializedReplay {
+	const char *policy; // name of the policy
+	long long frameSize; // frame size, or 0 for any
+	ReplayLoop replay;
+} SpecializedReplay;
+
+// Searched in order, so the loops for one frame size come before the one for any
+SpecializedReplay specializedReplays[] = {
+	{"ff", 0, replayFirstFit},
+	{"nf", 0, replayNextFit},
+	{"bf", 0, replayBestFit},
+	{"wf", 0, replayWorstFit},
+	{"pages", 1, replayPagesFrame1},
+	{"pages", 2, replayPagesFrame2},
+	{"pages", 4, replayPagesFrame4},
+	{"pages", 8, replayPagesFrame8},
+	{"pages", 16, replayPagesFrame16},
+	{"pages", 0, replayPages},
+	{"buddy", 0, replayBuddy},
+	{"tlsf", 0, replayTlsf},
+	{"auto", 0, replayAuto},
+};
+
+/**
+ * Find the fastest way to replay a whole trace with a simulation: the loop
+ * made for its policy and frame size if there is one, and replayEvents,
+ * which works for every simulation, if not. Both replay exactly the same.
+ */
+ReplayLoop findReplay(const Simulator *sim) {
+	int r;
+	for(r = 0; r < sizeof(specializedReplays) / sizeof(specializedReplays[0]); r++) {
+		SpecializedReplay *loop = &specializedReplays[r];
+		if(strcmp(sim->policy->name, loop->policy) == 0 && (loop->frameSize == 0 || loop->frameSize == sim->frameSize)) {
+			return loop->replay;
+		}
+	}
+	return replayEvents;
+}
+
+/**
+ * A checkpoint is the state of a simulation written to a file, so a long
+ * replay can go on from there later, or branch off under another policy,
+ * without replaying what came before. It holds the resident processes with
+ * their runs and page tables, the free blocks of policies that order them
+ * their own way (see Policy.saveFree), the TLB, every counter, and where in
+ * its trace the simulation was. The free extents, the store, the free-space
+ * engine and the evictor's index are rebuilt from the runs, in time that grows
+ * with the number of runs rather than the length of the trace. The file is
+ * mapped into memory to write and to read it, and is laid out as
+ *   CheckpointHeader
+ *   CheckpointProcess[processCount], in order of arrival
+ *   OwnedExtent[runCount], the runs of the processes
+ *   long long[pageCount], the page tables of the processes
+ *   OwnedExtent[freeBlockCount], written by saveFree
+ *   TlbEntry[tlbCount]
+ *   unsigned char[liveBytes], which processes the trace says hold memory
+ * in the byte order of the machine that wrote it. The contiguous policies,
+ * which compact, restore each other's checkpoints; a policy that keeps memory
+ * in a layout of its own (pages, buddy) only restores its own, with the same
+ * frame size. The store, engine, compaction and eviction may all change.
+ */
+
+// Every checkpoint starts with these 8 bytes
+const char checkpointMagic[8] = "MEMCKP1";
+
+typedef struct CheckpointHeader {
+	char magic[8]; // checkpointMagic
+	char policy[8]; // name of the policy
+	long long memorySize;
+	long long frameSize;
+	long long processCount;
+	long long runCount;
+	long long pageCount;
+	long long freeBlockCount;
+	long long tlbCount; // entries of the TLB, 0 if there is none
+	long long tlbWays;
+	long long liveBytes;
+	// where the trace was, if the checkpoint was written during a replay
+	long long tracePosition; // bytes of the trace replayed, counting from the start of the file
+	long long traceLine;
+	long long traceLastId;
+	long long traceLifetimes; // 1 once the trace has freed or resized a process
+	// the counters and state of the simulation
+	long long steps;
+	long long arrivals;
+	long long lastAllocationPoint;
+	long long processesVacated;
+	long long blocksVacated;
+	long long compactionEvents;
+	long long blocksMoved;
+	long long reallocations;
+	long long reallocationsMoved;
+	long long blocksCopied;
+	long long wastedBlocks;
+	long long tlbSeed;
+	long long tlbClock;
+	long long accesses;
+	long long tlbHits;
+	long long pageWalks;
+	long long faults;
+	long long pageTableBytes;
+	long long peakPageTableBytes;
+	long long searchNanos;
+	long long compactionNanos;
+	long long evictionNanos;
+	// the state of the auto policy
+	long long autoFit;
+	long long autoWindowStart;
+	long long autoCompactions;
+	long long autoVacated;
+	long long autoSizeStep;
+	double autoMeanSize;
+	double autoSizeVariance;
+	long long autoSwitches;
+} CheckpointHeader;
+
+// A resident process of a checkpoint
+typedef struct CheckpointProcess {
+	long long id;
+	long long arrival;
+	long long runCount; // its runs follow those of the processes before it
+	long long pageCount; // and so do its pages
+} CheckpointProcess;
+
+/**
+ * Compare two processes of a checkpoint by arrival, for qsort.
+ */
+int compareArrivals(const void *a, const void *b) {
+	long long x = ((const CheckpointProcess *)a)->arrival, y = ((const CheckpointProcess *)b)->arrival;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Write a checkpoint of a simulation, as described above.
+ *
+ * @param trace the trace being replayed, or NULL.
+ * @return false if the file cannot be written.
+ */
+bool writeCheckpoint(Simulator *sim, const char *name, const Trace *trace) {
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+	snprintf(header.policy, sizeof(header.policy), "%s", sim->policy->name);
+	header.memorySize = sim->memorySize;
+	header.frameSize = sim->frameSize;
+	header.processCount = sim->residentProcesses;
+	int p;
+	for(p = 0; p < sim->residentProcesses; p++) {
+		Process *process = &sim->processTable[sim->largestProcesses[p]];
+		header.runCount += process->extentCount;
+		header.pageCount += process->pageTable != NULL ? process->pageCount : 0;
+	}
+	header.freeBlockCount = sim->policy->saveFree != NULL ? sim->policy->saveFree(sim, NULL) : 0;
+	header.tlbCount = sim->tlb != NULL ? sim->tlbSets * sim->tlbWays : 0;
+	header.tlbWays = sim->tlbWays;
+	if(trace != NULL) {
+		header.liveBytes = trace->liveCapacity;
+		header.tracePosition = trace->offset + trace->position;
+		header.traceLine = trace->line;
+		header.traceLastId = trace->lastId;
+		header.traceLifetimes = trace->lifetimes;
+	}
+	header.steps = sim->steps;
+	header.arrivals = sim->arrivals;
+	header.lastAllocationPoint = sim->lastAllocationPoint;
+	header.processesVacated = sim->processesVacated;
+	header.blocksVacated = sim->blocksVacated;
+	header.compactionEvents = sim->compactionEvents;
+	header.blocksMoved = sim->blocksMoved;
+	header.reallocations = sim->reallocations;
+	header.reallocationsMoved = sim->reallocationsMoved;
+	header.blocksCopied = sim->blocksCopied;
+	header.wastedBlocks = sim->wastedBlocks;
+	header.tlbSeed = sim->tlbSeed;
+	header.tlbClock = sim->tlbClock;
+	header.accesses = sim->accesses;
+	header.tlbHits = sim->tlbHits;
+	header.pageWalks = sim->pageWalks;
+	header.faults = sim->faults;
+	header.pageTableBytes = sim->pageTableBytes;
+	header.peakPageTableBytes = sim->peakPageTableBytes;
+	header.searchNanos = sim->searchNanos;
+	header.compactionNanos = sim->compactionNanos;
+	header.evictionNanos = sim->evictionNanos;
+	header.autoFit = sim->autoFit;
+	header.autoWindowStart = sim->autoWindowStart;
+	header.autoCompactions = sim->autoCompactions;
+	header.autoVacated = sim->autoVacated;
+	header.autoSizeStep = sim->autoSizeStep;
+	header.autoMeanSize = sim->autoMeanSize;
+	header.autoSizeVariance = sim->autoSizeVariance;
+	header.autoSwitches = sim->autoSwitches;
+
+	size_t bytes = sizeof(CheckpointHeader) + header.processCount * sizeof(CheckpointProcess) + header.runCount * sizeof(OwnedExtent)
+		+ header.pageCount * sizeof(long long) + header.freeBlockCount * sizeof(OwnedExtent) + header.tlbCount * sizeof(TlbEntry) + header.liveBytes;
+	int fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		return false;
+	}
+	unsigned char *image = MAP_FAILED;
+	if(ftruncate(fd, bytes) == 0) {
+		image = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(image == MAP_FAILED) {
+		return false;
+	}
+	memcpy(image, &header, sizeof(header));
+	CheckpointProcess *processes = (CheckpointProcess *)(image + sizeof(CheckpointHeader));
+	OwnedExtent *runs = (OwnedExtent *)(processes + header.processCount);
+	long long *pages = (long long *)(runs + header.runCount);
+	OwnedExtent *freeBlocks = (OwnedExtent *)(pages + header.pageCount);
+	TlbEntry *tlb = (TlbEntry *)(freeBlocks + header.freeBlockCount);
+	unsigned char *live = (unsigned char *)(tlb + header.tlbCount);
+	for(p = 0; p < sim->residentProcesses; p++) {
+		int id = sim->largestProcesses[p];
+		processes[p].id = id;
+		processes[p].arrival = sim->processTable[id].arrival;
+	}
+	qsort(processes, header.processCount, sizeof(CheckpointProcess), compareArrivals);
+	for(p = 0; p < header.processCount; p++) {
+		Process *process = &sim->processTable[processes[p].id];
+		processes[p].runCount = process->extentCount;
+		memcpy(runs, process->extents, process->extentCount * sizeof(OwnedExtent));
+		runs += process->extentCount;
+		processes[p].pageCount = process->pageTable != NULL ? process->pageCount : 0;
+		memcpy(pages, process->pageTable, processes[p].pageCount * sizeof(long long));
+		pages += processes[p].pageCount;
+	}
+	if(header.freeBlockCount > 0) {
+		sim->policy->saveFree(sim, freeBlocks);
+	}
+	memcpy(tlb, sim->tlb, header.tlbCount * sizeof(TlbEntry));
+	if(header.liveBytes > 0) {
+		memcpy(live, trace->live, header.liveBytes);
+	}
+	return munmap(image, bytes) == 0;
+}
+
+/**
+ * Reserve the blocks a restored process does not use in the last block or
+ * frame it was rounded up to, as placing it did (see reserveTail).
+ */
+void restoreTail(Simulator *sim, int id) {
+	Process *process = &sim->processTable[id];
+	if(sim->policy->place == buddy) {
+		reserveTail(sim, process->extents[0].start + process->size, (1LL << orderOf(process->size)) - process->size);
+	} else if(sim->policy->paging && process->pageCount > 0) {
+		long long used = process->size - (process->pageCount - 1) * sim->frameSize; // blocks of the last page
+		reserveTail(sim, process->pageTable[process->pageCount - 1] * sim->frameSize + used, sim->frameSize - used);
+	}
+}
+
+/**
+ * Restore a checkpoint into a simulation that has not allocated anything,
+ * created with the settings to go on with, and move its trace, if it has one,
+ * to where the checkpoint was written.
+ *
+ * @param trace the trace to go on replaying, just opened, or NULL.
+ * @return 1 on success, 0 if the file is not a whole checkpoint or the trace
+ *         ends before it, -1 if the checkpoint is of another memory size, or
+ *         of a policy that cannot be restored with the simulation's.
+ */
+int readCheckpoint(Simulator *sim, const char *name, Trace *trace) {
+	int fd = open(name, O_RDONLY);
+	if(fd < 0) {
+		return 0;
+	}
+	struct stat info;
+	unsigned char *image = MAP_FAILED;
+	size_t bytes = 0;
+	if(fstat(fd, &info) == 0 && info.st_size >= sizeof(CheckpointHeader)) {
+		bytes = info.st_size;
+		image = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if(image == MAP_FAILED) {
+		return 0;
+	}
+	CheckpointHeader header;
+	memcpy(&header, image, sizeof(header));
+	header.policy[sizeof(header.policy) - 1] = '\0';
+	const Policy *saved = findPolicy(header.policy);
+	if(memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0 || saved == NULL || header.processCount < 0 || header.runCount < 0
+		|| header.pageCount < 0 || header.freeBlockCount < 0 || header.tlbCount < 0 || header.liveBytes < 0
+		|| bytes != sizeof(CheckpointHeader) + header.processCount * sizeof(CheckpointProcess) + header.runCount * sizeof(OwnedExtent)
+			+ header.pageCount * sizeof(long long) + header.freeBlockCount * sizeof(OwnedExtent) + header.tlbCount * sizeof(TlbEntry) + header.liveBytes) {
+		munmap(image, bytes);
+		return 0;
+	}
+	// a policy that does not compact keeps memory in a layout that only it, with the same frames, understands
+	bool samePolicy = saved == sim->policy && header.frameSize == sim->frameSize;
+	if(header.memorySize != sim->memorySize || ((!saved->compacts || !sim->policy->compacts) && !samePolicy) || sim->residentProcesses > 0) {
+		munmap(image, bytes);
+		return -1;
+	}
+	const CheckpointProcess *processes = (const CheckpointProcess *)(image + sizeof(CheckpointHeader));
+	const OwnedExtent *runs = (const OwnedExtent *)(processes + header.processCount);
+	const long long *pages = (const long long *)(runs + header.runCount);
+	const OwnedExtent *freeBlocks = (const OwnedExtent *)(pages + header.pageCount);
+	const TlbEntry *tlb = (const TlbEntry *)(freeBlocks + header.freeBlockCount);
+	const unsigned char *live = (const unsigned char *)(tlb + header.tlbCount);
+	long long p;
+	long long runCount = 0, pageCount = 0;
+	bool valid = true;
+	for(p = 0; p < header.processCount; p++) {
+		if(processes[p].id > sim->memory->maxId) { // the cells of the store cannot hold the id
+			munmap(image, bytes);
+			return -1;
+		}
+		valid = valid && processes[p].id >= 1 && processes[p].runCount >= 1 && processes[p].pageCount >= 0;
+		runCount += processes[p].runCount;
+		pageCount += processes[p].pageCount;
+	}
+	for(p = 0; p < header.runCount; p++) { // every run must lie in memory
+		valid = valid && runs[p].start >= 0 && runs[p].length >= 1 && runs[p].start + runs[p].length <= sim->memorySize;
+	}
+	// a checkpoint written without a trace leaves the trace at its start
+	bool seeking = trace != NULL && header.tracePosition > 0;
+	if(!valid || runCount != header.runCount || pageCount != header.pageCount || header.liveBytes > INT_MAX
+		|| (seeking && !seekTrace(trace, header.tracePosition))) {
+		munmap(image, bytes);
+		return 0;
+	}
+
+	for(p = 0; p < header.processCount; p++) {
+		int id = processes[p].id;
+		long long r;
+		for(r = 0; r < processes[p].runCount; r++) {
+			fillBlocks(sim, runs[r].start, id, runs[r].length); // which stops with an error if runs overlap
+		}
+		runs += processes[p].runCount;
+		Process *process = &sim->processTable[id];
+		process->arrival = processes[p].arrival;
+		if(processes[p].pageCount > 0) {
+			process->pageTable = malloc(processes[p].pageCount * sizeof(long long));
+			if(process->pageTable == NULL) {
+				printf("ERROR! Out of memory for the page table\n");
+				exit(1); // Exit with error
+			}
+			memcpy(process->pageTable, pages, processes[p].pageCount * sizeof(long long));
+			process->pageCount = processes[p].pageCount;
+			pages += processes[p].pageCount;
+		}
+		restoreTail(sim, id);
+		if(sim->evictor->admit != NULL) { // in order of arrival, as allocate admitted them
+			sim->evictor->admit(sim, id);
+		}
+	}
+	if(samePolicy && sim->policy->loadFree != NULL) {
+		sim->policy->loadFree(sim, freeBlocks, header.freeBlockCount);
+	} else if(sim->policy->reset != NULL) { // as after compaction, the free lists follow the free extents
+		sim->policy->reset(sim);
+	}
+	if(sim->tlb != NULL && header.tlbCount == sim->tlbSets * sim->tlbWays && header.tlbWays == sim->tlbWays) {
+		memcpy(sim->tlb, tlb, header.tlbCount * sizeof(TlbEntry)); // a TLB of another shape starts out empty
+	}
+	if(seeking) {
+		trace->line = header.traceLine;
+		trace->lastId = header.traceLastId;
+		trace->lifetimes = header.traceLifetimes != 0;
+		free(trace->live);
+		trace->live = malloc(header.liveBytes > 0 ? header.liveBytes : 1);
+		if(trace->live == NULL) {
+			printf("ERROR! Out of memory reading %s\n", trace->name);
+			exit(1); // Exit with error
+		}
+		memcpy(trace->live, live, header.liveBytes);
+		trace->liveCapacity = header.liveBytes;
+	}
+	sim->steps = header.steps;
+	sim->arrivals = header.arrivals;
+	sim->lastAllocationPoint = header.lastAllocationPoint;
+	sim->processesVacated = header.processesVacated;
+	sim->blocksVacated = header.blocksVacated;
+	sim->compactionEvents = header.compactionEvents;
+	sim->blocksMoved = header.blocksMoved;
+	sim->reallocations = header.reallocations;
+	sim->reallocationsMoved = header.reallocationsMoved;
+	sim->blocksCopied = header.blocksCopied;
+	sim->wastedBlocks = samePolicy ? header.wastedBlocks : 0; // another policy has not rounded anything up yet
+	sim->tlbSeed = header.tlbSeed;
+	sim->tlbClock = header.tlbClock;
+	sim->accesses = header.accesses;
+	sim->tlbHits = header.tlbHits;
+	sim->pageWalks = header.pageWalks;
+	sim->faults = header.faults;
+	sim->pageTableBytes = header.pageTableBytes;
+	sim->peakPageTableBytes = header.peakPageTableBytes;
+	sim->searchNanos = header.searchNanos;
+	sim->compactionNanos = header.compactionNanos;
+	sim->evictionNanos = header.evictionNanos;
+	if(samePolicy && header.autoFit >= 0 && header.autoFit <= AUTO_WORST_FIT) { // another policy starts the auto policy afresh
+		sim->autoFit = header.autoFit;
+		sim->autoWindowStart = header.autoWindowStart;
+		sim->autoCompactions = header.autoCompactions;
+		sim->autoVacated = header.autoVacated;
+		sim->autoSizeStep = header.autoSizeStep;
+		sim->autoMeanSize = header.autoMeanSize;
+		sim->autoSizeVariance = header.autoSizeVariance;
+		sim->autoSwitches = header.autoSwitches;
+	} else {
+		sim->autoWindowStart = sim->steps;
+		sim->autoCompactions = sim->compactionEvents;
+		sim->autoVacated = sim->processesVacated;
+	}
+	munmap(image, bytes);
+	return 1;
+}
+
+/**
+ * Write a checkpoint of a simulation, as described above writeCheckpoint.
+ *
+ * @param sim the simulation.
+ * @param name file the checkpoint is written to.
+ * @return false if the file cannot be written.
+ */
+bool simulatorSave(Simulator *sim, const char *name) {
+	return writeCheckpoint(sim, name, NULL);
+}
+
+/**
+ * Restore a checkpoint written by simulatorSave, or by the command line with
+ * --checkpoint, into a simulation that has not allocated anything yet.
+ *
+ * @param sim the simulation, created with the memory size of the checkpoint.
+ * @param name checkpoint file.
+ * @return false if the file is not a checkpoint, or it cannot be restored with sim's settings.
+ */
+bool simulatorRestore(Simulator *sim, const char *name) {
+	return readCheckpoint(sim, name, NULL) == 1;
+}
+
+/**
+ * Read the next line of an access trace: a process id and a logical block of it.
+ *
+ * @param input the access trace.
+ * @param id receives the process id.
+ * @param offset receives the logical block.
+ * @return 1 if an access was read, 0 at the end of the file, -1 if the line is malformed.
+ */
+int nextAccess(FILE *input, int *id, long long *offset) {
+	int read = fscanf(input, "%d %lld", id, offset);
+	if(read == EOF) {
+		return 0;
+	}
+	return read == 2 && *id >= 1 && *offset >= 0 ? 1 : -1;
+}
+
+/**
+ * Read a positive block count from a command-line option value.
+ *
+ * @param text the digits after the '=' of the option.
+ * @param value receives the count.
+ * @return true if text is a whole number of at least 1.
+ */
+bool parseCount(const char *text, long long *value) {
+	char *end;
+	*value = strtoll(text, &end, 10);
+	return end != text && *end == '\0' && *value >= 1;
+}
+
+/**
+ * Read a comma-separated list of positive block counts, such as 128,256,1024.
+ *
+ * @param text the list after the '=' of the option.
+ * @param values receives the counts, which the caller frees.
+ * @param count receives the number of counts.
+ * @return true if every entry is a whole number of at least 1.
+ */
+bool parseCountList(const char *text, long long **values, int *count) {
+	int entries = 1;
+	const char *c;
+	for(c = text; *c != '\0'; c++) {
+		if(*c == ',') {
+			entries++;
+		}
+	}
+	*values = malloc(entries * sizeof(long long));
+	*count = 0;
+	if(*values == NULL) {
+		return false;
+	}
+	char *end;
+	for(c = text; *count < entries; c = end + 1) {
+		long long value = strtoll(c, &end, 10);
+		if(end == c || (*end != ',' && *end != '\0') || value < 1) {
+			free(*values);
+			return false;
+		}
+		(*values)[(*count)++] = value;
+	}
+	return true;
+}
+
+/**
+ * Print the command line that main expects.
+ */
+void printUsage() {
+	printf("Incorrect arguments. Expected:\n");
+	printf(" 0: C file: name of program being run\n");
+	printf(" 1: input fiename: file with sequence of memory requests (one int per line, or a binary trace), or - for standard input\n");
+	printf("    lines may also be \"alloc ID SIZE\", \"free ID\" or \"realloc ID SIZE\" for processes that come and go\n");
+	printf(" 2: output filename: file that final memory contents will be (over)written to\n");
+	printf(" 3: memory allocation policy: ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits\n");
+	printf("Followed by any of these options:\n");
+	printf(" --memory=N: number of memory blocks (default 128)\n");
+	printf(" --frame=N: number of blocks in each frame/page (default 2)\n");
+	printf(" --store=u16|u32|rle: 16-bit cells, 32-bit cells or run-length runs for memory (default u32)\n");
+	printf(" --engine=extent|bitmap: free-space search for ff and nf (default extent)\n");
+	printf(" --compaction=full|window: slide all of memory to the front, or empty just enough of it (default full)\n");
+	printf(" --eviction=largest|fifo|smallest|adjacent|plan: which process is vacated when a request does not fit (default largest)\n");
+	printf("Translation model for pages, which reports TLB hits, page walks and page-table size:\n");
+	printf(" --accesses=FILE: lines of \"ID OFFSET\", each replayed once request ID has been allocated\n");
+	printf("   (without it, a process touches each of its pages once when it arrives)\n");
+	printf(" --tlb=N: TLB entries (default no TLB, so every access walks the page tables)\n");
+	printf(" --tlb-ways=N: entries in each TLB set (default 1, direct mapped)\n");
+	printf(" --tlb-replacement=lru|random: which entry of a full set is replaced (default lru)\n");
+	printf(" --page-levels=N, --page-bits=N: levels of page tables, and page-number bits per level (default 4 and 9)\n");
+	printf(" --log=off|summary|full: print nothing, only the final counters, or every event (default full)\n");
+	printf(" --event-log=FILE: write every event to FILE as binary records instead of text\n");
+	printf(" --deltas=FILE: write a line to FILE (- for standard output) for every run of blocks allocated, freed or moved\n");
+	printf(" --image=blocks|runs: write the output file one line per block, or one \"START LENGTH ID\" line per run a process owns (default blocks)\n");
+	printf(" --checkpoint=FILE: write the state of the simulation to FILE.N after request N\n");
+	printf(" --checkpoint-at=N,N,...: requests after which a checkpoint is written (default only after the last)\n");
+	printf(" --restore=FILE: start from a checkpoint and replay the rest of the trace, with any policy\n");
+	printf("   (pages and buddy only restore their own checkpoints, with the same frame size)\n");
+	printf(" --banks=N: split memory into N banks, each with its own lock, compaction and vacates, and print the counters of each\n");
+	printf(" --placement=home|round-robin|least-loaded: which bank a new process tries first before it spills over to the others:\n");
+	printf("   its own (process ID modulo N), each in turn, or the one with the most free blocks (default home)\n");
+	printf(" --bank-threads=N: number of banks replayed at once (default one per processor)\n");
+	printf("   (telemetry of bank K goes to FILE.K, and of bank 0 to FILE)\n");
+	printf(" --telemetry=FILE: write samples of fragmentation, utilization and time spent to FILE\n");
+	printf(" --telemetry-every=N: requests between samples (default 1)\n");
+	printf(" --telemetry-format=csv|json: CSV with a header, or one JSON object per line (default csv)\n");
+	printf("Or, to print a binary event log as text: --decode=FILE\n");
+	printf("Or, to turn a request trace into a binary trace: --convert=TEXT BINARY\n");
+	printf("Or, to compare policies and sizes on one trace: --sweep=FILE followed by any of\n");
+	printf(" --policies=P,P,...: policies to run (default all of them)\n");
+	printf(" --memory=N,N,...: memory sizes to run (default 128)\n");
+	printf(" --frame=N,N,...: frame sizes to run with pages (default 2)\n");
+	printf(" --evictions=E,E,...: evictors to run (default largest)\n");
+	printf(" --store=u16|u32|rle, --engine=extent|bitmap, --compaction=full|window: as above\n");
+	printf(" --threads=N: number of simulations run at once (default one per processor)\n");
+	printf("Or, to replay many traces: --batch=DIR|MANIFEST followed by any of\n");
+	printf(" --policy=P: policy to run (default ff)\n");
+	printf(" --memory=N, --frame=N, --store=u16|u32|rle, --engine=extent|bitmap, --compaction=full|window, --eviction=E: as above\n");
+	printf(" --csv=FILE: write the stats of every trace to FILE (default standard output)\n");
+	printf(" --out=DIR: also write the final memory of each trace to DIR/NAME.mem\n");
+	printf(" --threads=N: number of traces replayed at once (default one per processor)\n");
+	printf("Or, to time the policies on generated workloads and write CSV: --bench followed by any of\n");
+	printf(" --policies=P,P,...: policies to run (default all of them)\n");
+	printf(" --workloads=W,W,...: uniform, zipf, bimodal or ramp (default all of them)\n");
+	printf(" --memory=N,N,...: memory sizes to run (default 1024 and 65536)\n");
+	printf(" --requests=N: allocations in each workload (default 100000)\n");
+	printf(" --seed=N: seed of the workload generator (default 1)\n");
+	printf(" --frame=N, --store=u16|u32|rle, --engine=extent|bitmap, --compaction=full|window, --eviction=E: as above\n");
+	printf(" --csv=FILE: write the results to FILE (default standard output)\n");
+	printf(" --threads=N: number of runs at once (default 1, so runs do not disturb each other's timings)\n");
+	printf("Or, to time malloc and free on more and more threads and write CSV: --stress followed by any of\n");
+	printf(" --threads=N,N,...: thread counts to run (default powers of two up to the processors)\n");
+	printf(" --operations=N: allocations each thread makes (default 1000000)\n");
+	printf(" --csv=FILE: write the results to FILE (default standard output)\n");
+	printf("   (run with LD_PRELOAD of a build with -DMEMORY_ALLOCATION_PRELOAD to time the policies)\n");
+}
+
+/**
+ * Write the runs of a simulation's memory, numbering its blocks from base.
+ */
+void writeImageRuns(FILE *output, Simulator *sim, long long base, bool runs) {
+	long long i = 0;
+	while(i < sim->memorySize) { // one run of equal ids at a time, so the rle store is not searched per block
+		int id;
+		long long end = simulatorRun(sim, i, &id);
+		if(runs && id != 0) {
+			fprintf(output, "%lld %lld %d\n", base + i, end - i, id);
+		}
+		for(; !runs && i < end; i++) {
+			fprintf(output, "%d\n", id);
+		}
+		i = end;
+	}
+}
+
+/**
+ * Write the final state of memory to a file, one process id per block, or
+ * with runs one line "START LENGTH ID" per run of blocks a process owns, so
+ * the file grows with the number of runs rather than the size of memory.
+ * Free blocks are the ones no run covers.
+ *
+ * @param runs true for one line per run, false for one line per block.
+ * @return false if the file cannot be written.
+ */
+bool writeMemoryImage(Simulator *sim, const char *name, bool runs) {
+	FILE *output = fopen(name, "w"); // Open file in write mode
+	if(output == NULL) {
+		return false;
+	}
+	writeImageRuns(output, sim, 0, runs);
+	return fclose(output) == 0; // Close the file
+}
+
+/**
+ * Write the final state of all the banks to a file, as writeMemoryImage
+ * does, bank after bank.
+ *
+ * @return false if the file cannot be written.
+ */
+bool writeBanksImage(MemoryBanks *banks, const char *name, bool runs) {
+	FILE *output = fopen(name, "w"); // Open file in write mode
+	if(output == NULL) {
+		return false;
+	}
+	int k;
+	for(k = 0; k < banks->count; k++) {
+		writeImageRuns(output, banks->banks[k]->sim, k * banks->banks[k]->sim->memorySize, runs);
+	}
+	return fclose(output) == 0; // Close the file
+}
+
+/**
+ * Run job(context, i) for every i from 0 to jobs - 1 on a pool of threads.
+ * The jobs are dealt out to the threads in equal ranges. A thread works through
+ * its own range from the front, and when that is empty it steals the back half
+ * of the largest range left, so threads that drew long jobs (such as long
+ * traces) are helped by the ones that finished early.
+ */
+typedef struct ThreadPool {
+	int jobs; // number of jobs
+	void (*job)(void *context, int index); // runs one job
+	void *context; // shared by every job
+} ThreadPool;
+
+// The jobs one thread of a pool has left: next through end - 1
+typedef struct PoolWorker {
+	pthread_mutex_t lock; // guards next and end, which thieves change too
+	int next;
+	int end;
+	ThreadPool *pool;
+	struct PoolWorker *workers; // every worker of the pool, for stealing
+	int workerCount;
+} PoolWorker;
+
+/**
+ * Take the next job of a worker's own range.
+ *
+ * @return the job, or -1 if the range is empty.
+ */
+int takeJob(PoolWorker *worker) {
+	int index = -1;
+	pthread_mutex_lock(&worker->lock);
+	if(worker->next < worker->end) {
+		index = worker->next++;
+	}
+	pthread_mutex_unlock(&worker->lock);
+	return index;
+}
+
+/**
+ * Move the back half of the largest range of the other workers into an idle
+ * worker's range.
+ *
+ * @return false if there was nothing left to steal.
+ */
+bool stealJobs(PoolWorker *thief) {
+	for(;;) {
+		PoolWorker *victim = NULL;
+		int most = 0;
+		int w;
+		for(w = 0; w < thief->workerCount; w++) { // the range may shrink again before it is stolen from
+			PoolWorker *other = &thief->workers[w];
+			if(other == thief) {
+				continue;
+			}
+			pthread_mutex_lock(&other->lock);
+			int left = other->end - other->next;
+			pthread_mutex_unlock(&other->lock);
+			if(left > most) {
+				victim = other;
+				most = left;
+			}
+		}
+		if(victim == NULL) {
+			return false;
+		}
+		int first = -1, end = -1;
+		pthread_mutex_lock(&victim->lock);
+		if(victim->next < victim->end) {
+			end = victim->end;
+			first = end - (victim->end - victim->next + 1) / 2; // the victim keeps the front half
+			victim->end = first;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		if(first != -1) {
+			pthread_mutex_lock(&thief->lock);
+			thief->next = first;
+			thief->end = end;
+			pthread_mutex_unlock(&thief->lock);
+			return true;
+		}
+	}
+}
+
+void *poolWorker(void *argument) {
+	PoolWorker *worker = argument;
+	ThreadPool *pool = worker->pool;
+	int index;
+	do {
+		while((index = takeJob(worker)) != -1) {
+			pool->job(pool->context, index);
+		}
+	} while(stealJobs(worker));
+	return NULL;
+}
+
+/**
+ * Run every job of a pool and wait for all of them to finish.
+ *
+ * @param threads number of jobs to run at once; the calling thread is one of them.
+ */
+void runPool(ThreadPool *pool, int threads) {
+	if(threads > pool->jobs) {
+		threads = pool->jobs > 0 ? pool->jobs : 1;
+	}
+	PoolWorker *workers = malloc(threads * sizeof(PoolWorker));
+	pthread_t *ids = malloc(threads * sizeof(pthread_t));
+	if(workers == NULL || ids == NULL) {
+		printf("ERROR! Out of memory for the thread pool\n");
+		exit(1); // Exit with error
+	}
+	int t;
+	for(t = 0; t < threads; t++) { // deal the jobs out in equal ranges
+		pthread_mutex_init(&workers[t].lock, NULL);
+		workers[t].next = (long long)pool->jobs * t / threads;
+		workers[t].end = (long long)pool->jobs * (t + 1) / threads;
+		workers[t].pool = pool;
+		workers[t].workers = workers;
+		workers[t].workerCount = threads;
+	}
+	int started = 1; // worker 0 is the calling thread
+	while(started < threads && pthread_create(&ids[started], NULL, poolWorker, &workers[started]) == 0) {
+		started++;
+	}
+	// if a thread could not be started, its range is stolen by the others
+	poolWorker(&workers[0]);
+	for(t = 1; t < started; t++) {
+		pthread_join(ids[t], NULL);
+	}
+	for(t = 0; t < threads; t++) {
+		pthread_mutex_destroy(&workers[t].lock);
+	}
+	free(ids);
+	free(workers);
+}
+
+/**
+ * Number of processors that are online, which is the default number of threads.
+ */
+int processorCount() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+}
+
+/**
+ * Seconds on a clock that only moves forward, for timing runs.
+ */
+double wallSeconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// One configuration of a sweep, and what happened when the trace ran with it
+typedef struct SweepRun {
+	const Policy *policy;
+	const Evictor *evictor;
+	long long memorySize;
+	long long frameSize;
+	int processesVacated;
+	long long blocksVacated; // blocks the vacated processes owned
+	int compactionEvents;
+	long long blocksMoved; // blocks copied by compaction
+	long long wastedBlocks; // blocks lost to rounding at the end of the run
+	double seconds; // wall-clock time of the run
+} SweepRun;
+
+// Everything the runs of a sweep share; the trace is only read
+typedef struct Sweep {
+	const TraceEvent *events; // events of the trace
+	long long count; // number of events
+	const char *store;
+	const char *engine;
+	const char *compaction;
+	SweepRun *runs;
+} Sweep;
+
+/**
+ * Replay the whole trace with one configuration of a sweep.
+ */
+void sweepJob(void *context, int index) {
+	Sweep *sweep = context;
+	SweepRun *run = &sweep->runs[index];
+	SimulatorConfig config;
+	simulatorDefaults(&config);
+	config.memorySize = run->memorySize;
+	config.frameSize = run->frameSize;
+	config.policy = run->policy->name;
+	config.eviction = run->evictor->name;
+	config.store = sweep->store;
+	config.engine = sweep->engine;
+	config.compaction = sweep->compaction;
+	double start = wallSeconds();
+	Simulator *sim = simulatorCreate(&config);
+	findReplay(sim)(sim, sweep->events, sweep->count);
+	run->processesVacated = sim->processesVacated;
+	run->blocksVacated = sim->blocksVacated;
+	run->compactionEvents = sim->compactionEvents;
+	run->blocksMoved = sim->blocksMoved;
+	run->wastedBlocks = sim->wastedBlocks;
+	simulatorDestroy(sim);
+	run->seconds = wallSeconds() - start;
+}
+
+/**
+ * Sweep mode: read one trace, run it with every combination of policy, evictor, memory
+ * size and frame size on a pool of threads, and print one table of the results.
+ * Frame sizes only matter to paging, so the other policies run once per memory size.
+ *
+ * @param argc number of command line parameters.
+ * @param argv command line parameters, with --sweep=FILE first.
+ * @return 0 on success, 1 on error.
+ */
+int sweepTrace(int argc, char *argv[]) {
+	const char *traceName = argv[1] + 8;
+	const Policy *chosen[sizeof(policies) / sizeof(policies[0])];
+	int policyCount = 0;
+	const Evictor *evictions[sizeof(evictors) / sizeof(evictors[0])] = {&evictors[0]};
+	int evictorCount = 1;
+	long long defaultMemory = 128, defaultFrame = 2;
+	long long *memorySizes = &defaultMemory, *frameSizes = &defaultFrame;
+	int memoryCount = 1, frameCount = 1;
+	int threads = processorCount();
+	long long value;
+	Sweep sweep;
+	sweep.store = "u32";
+	sweep.engine = "extent";
+	sweep.compaction = "full";
+	int arg;
+	for(arg = 2; arg < argc; arg++) {
+		if(strncmp(argv[arg], "--policies=", 11) == 0) {
+			char names[256];
+			snprintf(names, sizeof(names), "%s", argv[arg] + 11);
+			char *name;
+			policyCount = 0;
+			for(name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+				const Policy *policy = findPolicy(name);
+				if(policy == NULL || policyCount == sizeof(chosen) / sizeof(chosen[0])) {
+					printf("Invalid memory allocation policy %s\n", name);
+					printf(" ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits\n");
+					return 1; // Error
+				}
+				chosen[policyCount++] = policy;
+			}
+		} else if(strncmp(argv[arg], "--evictions=", 12) == 0) {
+			char names[256];
+			snprintf(names, sizeof(names), "%s", argv[arg] + 12);
+			char *name;
+			evictorCount = 0;
+			for(name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+				const Evictor *evictor = findEvictor(name);
+				if(evictor == NULL || evictorCount == sizeof(evictions) / sizeof(evictions[0])) {
+					printf("Invalid eviction %s\n", name);
+					printf(" largest, fifo, smallest, adjacent or plan\n");
+					return 1; // Error
+				}
+				evictions[evictorCount++] = evictor;
+			}
+		} else if(strncmp(argv[arg], "--memory=", 9) == 0) {
+			if(!parseCountList(argv[arg] + 9, &memorySizes, &memoryCount)) {
+				printf("Invalid memory sizes %s\n", argv[arg] + 9);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--frame=", 8) == 0) {
+			if(!parseCountList(argv[arg] + 8, &frameSizes, &frameCount)) {
+				printf("Invalid frame sizes %s\n", argv[arg] + 8);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--store=", 8) == 0 && findStore(argv[arg] + 8) != NULL) {
+			sweep.store = argv[arg] + 8;
+		} else if(strncmp(argv[arg], "--engine=", 9) == 0 && findEngine(argv[arg] + 9) != NULL) {
+			sweep.engine = argv[arg] + 9;
+		} else if(strncmp(argv[arg], "--compaction=", 13) == 0 && findCompactor(argv[arg] + 13) != NULL) {
+			sweep.compaction = argv[arg] + 13;
+		} else if(strncmp(argv[arg], "--threads=", 10) == 0 && parseCount(argv[arg] + 10, &value)) {
+			threads = value < INT_MAX ? value : INT_MAX;
+		} else {
+			printUsage();
+			return 1; // Error
+		}
+	}
+	if(policyCount == 0) { // every policy, in table order
+		for(policyCount = 0; policyCount < sizeof(policies) / sizeof(policies[0]); policyCount++) {
+			chosen[policyCount] = &policies[policyCount];
+		}
+	}
+
+	TraceEvent *events;
+	if(loadTrace(traceName, &events, &sweep.count) != 0) {
+		return 1; // Error
+	}
+	sweep.events = events;
+	sweep.runs = malloc((long long)policyCount * evictorCount * memoryCount * frameCount * sizeof(SweepRun));
+	if(sweep.runs == NULL) {
+		printf("ERROR! Out of memory for the sweep\n");
+		exit(1); // Exit with error
+	}
+	int runs = 0;
+	int p, v, m, f;
+	for(p = 0; p < policyCount; p++) {
+		for(v = 0; v < evictorCount; v++) {
+			for(m = 0; m < memoryCount; m++) {
+				for(f = 0; f < (chosen[p]->paging ? frameCount : 1); f++) {
+					sweep.runs[runs].policy = chosen[p];
+					sweep.runs[runs].evictor = evictions[v];
+					sweep.runs[runs].memorySize = memorySizes[m];
+					sweep.runs[runs].frameSize = frameSizes[chosen[p]->paging ? f : 0];
+					runs++;
+				}
+			}
+		}
+	}
+
+	ThreadPool pool = {runs, sweepJob, &sweep};
+	runPool(&pool, threads);
+
+	printf("%-6s %-8s %12s %8s %10s %14s %12s %14s %10s %10s\n", "policy", "eviction", "memory", "frame", "vacated", "lost", "compactions", "moved", "wasted", "seconds");
+	int r;
+	for(r = 0; r < runs; r++) {
+		SweepRun *run = &sweep.runs[r];
+		char frame[24] = "-"; // contiguous policies have no frames
+		if(run->policy->paging) {
+			snprintf(frame, sizeof(frame), "%lld", run->frameSize);
+		}
+		printf("%-6s %-8s %12lld %8s %10d %14lld %12d %14lld %10lld %10.3f\n", run->policy->name, run->evictor->name, run->memorySize, frame, run->processesVacated, run->blocksVacated, run->compactionEvents, run->blocksMoved, run->wastedBlocks, run->seconds);
+	}
+
+	free(sweep.runs);
+	free(events);
+	if(memorySizes != &defaultMemory) {
+		free(memorySizes);
+	}
+	if(frameSizes != &defaultFrame) {
+		free(frameSizes);
+	}
+	return 0;
+}
+
+/**
+ * Compare two strings through pointers to them, for qsort.
+ */
+int comparePaths(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Add a copy of path to a growing list of paths.
+ */
+void addPath(char ***paths, int *count, int *capacity, const char *path) {
+	if(*count == *capacity) {
+		*capacity = *capacity == 0 ? 64 : *capacity * 2;
+		*paths = realloc(*paths, *capacity * sizeof(char *));
+	}
+	if(*paths == NULL || ((*paths)[*count] = strdup(path)) == NULL) {
+		printf("ERROR! Out of memory for the list of traces\n");
+		exit(1); // Exit with error
+	}
+	(*count)++;
+}
+
+/**
+ * List the traces of a batch. A directory stands for every regular file in it
+ * whose name does not start with a dot, in name order. Any other file is a
+ * manifest with one trace path per line; blank lines are skipped.
+ *
+ * @param source directory or manifest.
+ * @param paths receives the trace paths, which the caller frees.
+ * @param count receives the number of traces.
+ * @return false if source cannot be read.
+ */
+bool listTraces(const char *source, char ***paths, int *count) {
+	int capacity = 0;
+	*paths = NULL;
+	*count = 0;
+	DIR *directory = opendir(source);
+	if(directory != NULL) {
+		struct dirent *entry;
+		char path[4096];
+		struct stat info;
+		while((entry = readdir(directory)) != NULL) {
+			snprintf(path, sizeof(path), "%s/%s", source, entry->d_name);
+			if(entry->d_name[0] != '.' && stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+				addPath(paths, count, &capacity, path);
+			}
+		}
+		closedir(directory);
+		qsort(*paths, *count, sizeof(char *), comparePaths);
+		return true;
+	}
+	FILE *manifest = fopen(source, "r");
+	if(manifest == NULL) {
+		return false;
+	}
+	char *line = NULL;
+	size_t room = 0;
+	ssize_t length;
+	while((length = getline(&line, &room, manifest)) != -1) {
+		while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+			line[--length] = '\0';
+		}
+		if(length > 0) {
+			addPath(paths, count, &capacity, line);
+		}
+	}
+	free(line);
+	fclose(manifest);
+	return true;
+}
+
+// One trace of a batch, and what happened when it was replayed
+typedef struct BatchRun {
+	const char *path;
+	long long requests;
+	int processesVacated;
+	int compactionEvents;
+	long long blocksMoved; // blocks copied by compaction
+	long long freeBlocks;
+	int residentProcesses;
+	long long wastedBlocks; // blocks lost to rounding at the end of the replay
+	double seconds; // wall-clock time of the replay
+	char status[512]; // "ok", or why the trace could not be replayed
+} BatchRun;
+
+// Everything the replays of a batch share
+typedef struct Batch {
+	SimulatorConfig config; // every trace runs with the same settings
+	const char *outputDirectory; // where memory images go, or NULL for none
+	BatchRun *runs;
+} Batch;
+
+/**
+ * Replay one trace of a batch, and write its memory image if asked to.
+ */
+void batchJob(void *context, int index) {
+	Batch *batch = context;
+	BatchRun *run = &batch->runs[index];
+	double start = wallSeconds();
+	Trace trace;
+	if(!openTrace(run->path, &trace)) {
+		snprintf(run->status, sizeof(run->status), "Problem reading file %s", run->path);
+		return;
+	}
+	Simulator *sim = simulatorCreate(&batch->config);
+	TraceEvent event;
+	int status;
+	while((status = nextEvent(&trace, &event)) == 1) {
+		run->requests++;
+		replayEvent(sim, &event);
+	}
+	if(status < 0) {
+		describeMalformed(&trace, run->status, sizeof(run->status));
+	} else {
+		snprintf(run->status, sizeof(run->status), "ok");
+	}
+	closeTrace(&trace);
+	if(status == 0 && batch->outputDirectory != NULL) {
+		const char *name = strrchr(run->path, '/');
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s.mem", batch->outputDirectory, name != NULL ? name + 1 : run->path);
+		if(!writeMemoryImage(sim, path, false)) {
+			snprintf(run->status, sizeof(run->status), "Problem writing memory image");
+		}
+	}
+	run->processesVacated = sim->processesVacated;
+	run->compactionEvents = sim->compactionEvents;
+	run->blocksMoved = sim->blocksMoved;
+	run->freeBlocks = sim->freeBlocks;
+	run->residentProcesses = sim->residentProcesses;
+	run->wastedBlocks = sim->wastedBlocks;
+	simulatorDestroy(sim);
+	run->seconds = wallSeconds() - start;
+}
+
+/**
+ * Write text as one CSV field, quoted so commas and quotes in it survive.
+ */
+void writeCsvField(FILE *output, const char *text) {
+	fputc('"', output);
+	for(; *text != '\0'; text++) {
+		if(*text == '"') {
+			fputc('"', output); // a quote inside a field is written twice
+		}
+		fputc(*text, output);
+	}
+	fputc('"', output);
+}
+
+/**
+ * Batch mode: replay every trace of a directory or manifest with the same
+ * settings on a pool of threads, and write one CSV row of stats per trace.
+ * A trace that cannot be read or is malformed gets a row saying so, and
+ * the other traces still run.
+ *
+ * @param argc number of command line parameters.
+ * @param argv command line parameters, with --batch=DIR|MANIFEST first.
+ * @return 0 if every trace was replayed, 1 otherwise.
+ */
+int batchTraces(int argc, char *argv[]) {
+	const char *source = argv[1] + 8;
+	const char *csvName = NULL;
+	int threads = processorCount();
+	long long value;
+	Batch batch;
+	simulatorDefaults(&batch.config);
+	batch.outputDirectory = NULL;
+	int arg;
+	for(arg = 2; arg < argc; arg++) {
+		if(strncmp(argv[arg], "--policy=", 9) == 0 && findPolicy(argv[arg] + 9) != NULL) {
+			batch.config.policy = argv[arg] + 9;
+		} else if(strncmp(argv[arg], "--memory=", 9) == 0 && parseCount(argv[arg] + 9, &value)) {
+			batch.config.memorySize = value;
+		} else if(strncmp(argv[arg], "--frame=", 8) == 0 && parseCount(argv[arg] + 8, &value)) {
+			batch.config.frameSize = value;
+		} else if(strncmp(argv[arg], "--store=", 8) == 0 && findStore(argv[arg] + 8) != NULL) {
+			batch.config.store = argv[arg] + 8;
+		} else if(strncmp(argv[arg], "--engine=", 9) == 0 && findEngine(argv[arg] + 9) != NULL) {
+			batch.config.engine = argv[arg] + 9;
+		} else if(strncmp(argv[arg], "--compaction=", 13) == 0 && findCompactor(argv[arg] + 13) != NULL) {
+			batch.config.compaction = argv[arg] + 13;
+		} else if(strncmp(argv[arg], "--eviction=", 11) == 0 && findEvictor(argv[arg] + 11) != NULL) {
+			batch.config.eviction = argv[arg] + 11;
+		} else if(strncmp(argv[arg], "--csv=", 6) == 0) {
+			csvName = argv[arg] + 6;
+		} else if(strncmp(argv[arg], "--out=", 6) == 0) {
+			batch.outputDirectory = argv[arg] + 6;
+		} else if(strncmp(argv[arg], "--threads=", 10) == 0 && parseCount(argv[arg] + 10, &value)) {
+			threads = value < INT_MAX ? value : INT_MAX;
+		} else {
+			printUsage();
+			return 1; // Error
+		}
+	}
+
+	char **paths;
+	int count;
+	if(!listTraces(source, &paths, &count)) {
+		printf("Problem reading file %s\n", source);
+		return 1; // Error
+	}
+	FILE *csv = stdout;
+	if(csvName != NULL && (csv = fopen(csvName, "w")) == NULL) {
+		printf("Problem writing file %s\n", csvName);
+		return 1; // Error
+	}
+	batch.runs = calloc(count > 0 ? count : 1, sizeof(BatchRun));
+	if(batch.runs == NULL) {
+		printf("ERROR! Out of memory for the batch\n");
+		exit(1); // Exit with error
+	}
+	int t;
+	for(t = 0; t < count; t++) {
+		batch.runs[t].path = paths[t];
+	}
+
+	ThreadPool pool = {count, batchJob, &batch};
+	runPool(&pool, threads);
+
+	int failed = 0;
+	fprintf(csv, "trace,requests,vacated,compactions,moved,free_blocks,resident,wasted,seconds,status\n");
+	for(t = 0; t < count; t++) {
+		BatchRun *run = &batch.runs[t];
+		writeCsvField(csv, run->path);
+		fprintf(csv, ",%lld,%d,%d,%lld,%lld,%d,%lld,%.6f,", run->requests, run->processesVacated, run->compactionEvents, run->blocksMoved, run->freeBlocks, run->residentProcesses, run->wastedBlocks, run->seconds);
+		writeCsvField(csv, run->status);
+		fputc('\n', csv);
+		if(strcmp(run->status, "ok") != 0) {
+			failed++;
+		}
+		free(paths[t]);
+	}
+	if(csv != stdout) {
+		fclose(csv);
+	}
+	free(paths);
+	free(batch.runs);
+	return failed > 0 ? 1 : 0;
+}
+
+/**
+ * Bench mode generates its workloads instead of reading them, so policies can
+ * be compared, and regressions caught, without trace files. A workload is a
+ * sequence of trace events made by a seeded generator, and every policy runs
+ * the same sequence:
+ *   uniform  sizes spread evenly up to a sixteenth of memory
+ *   zipf     sizes up to a sixteenth of memory following Zipf's law, so the
+ *            smallest requests are by far the most common
+ *   bimodal  mostly small, short-lived requests, and a tenth large, long-lived ones
+ *   ramp     the processes of the first half all live into the second half,
+ *            so memory fills up and then drains
+ * Lifetimes are counted in requests and chosen so the live processes would
+ * fill about nine tenths of memory on average; the ramp overfills it on purpose.
+ * Every allocate() is timed on its own, for the latency percentiles. The
+ * workload is then replayed twice more, untimed event by event: once through
+ * the policy table with replayEvents and once with the replay loop made for
+ * the policy (see findReplay), to show what dispatching through the table costs.
+ */
+typedef enum BenchWorkload { BENCH_UNIFORM, BENCH_ZIPF, BENCH_BIMODAL, BENCH_RAMP } BenchWorkload;
+
+// Names of the workloads, in BenchWorkload order, as given to --workloads
+const char *benchWorkloads[] = {"uniform", "zipf", "bimodal", "ramp"};
+
+/**
+ * Next number of a xorshift64* generator.
+ *
+ * @param state generator state, never 0.
+ */
+uint64_t nextRandom(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
 
-// Array simulates memory
-int memory[MEM_SIZE];
+/**
+ * A random number from 0 to bound - 1.
+ */
+long long randomBelow(uint64_t *state, long long bound) {
+	return nextRandom(state) % (uint64_t)bound;
+}
 
 /**
- * Fill memory array with zeroes, which represent empty space (available for allocation)
+ * Generate the events of a workload. Request i allocates process i + 1, and
+ * the processes whose lifetime is up are freed just before it.
+ *
+ * @param workload which workload.
+ * @param memorySize blocks of memory the workload is sized for.
+ * @param requests number of allocations.
+ * @param seed seed of the generator; the same seed gives the same events.
+ * @param events receives the events, which the caller frees.
+ * @param count receives the number of events.
  */
-void clearMemory() {
-	int i;
-	for(i = 0; i < MEM_SIZE; i++) { // Initialize memory
-		memory[i] = 0; // 0 indicates free memory
+void generateWorkload(BenchWorkload workload, long long memorySize, long long requests, uint64_t seed, TraceEvent **events, long long *count) {
+	long long *sizes = malloc(requests * sizeof(long long));
+	long long *deaths = malloc(requests * sizeof(long long)); // request before which each process is freed
+	long long *dying = malloc(requests * sizeof(long long)); // first process freed before each request, -1 for none
+	long long *nextDying = malloc(requests * sizeof(long long)); // next process freed before the same request
+	long long maxSize = memorySize / 16 > 0 ? memorySize / 16 : 1;
+	double *zipf = workload == BENCH_ZIPF ? malloc(maxSize * sizeof(double)) : NULL;
+	*events = malloc(2 * requests * sizeof(TraceEvent));
+	if(sizes == NULL || deaths == NULL || dying == NULL || nextDying == NULL || (workload == BENCH_ZIPF && zipf == NULL) || *events == NULL) {
+		printf("ERROR! Out of memory for the benchmark\n");
+		exit(1); // Exit with error
+	}
+	uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1; // spread small seeds over the state, and never 0
+	long long i;
+	if(zipf != NULL) { // cumulative weights of 1/size, searched for a uniform point below the total
+		double total = 0;
+		for(i = 0; i < maxSize; i++) {
+			total += 1.0 / (i + 1);
+			zipf[i] = total;
+		}
+	}
+	double sum = 0;
+	for(i = 0; i < requests; i++) {
+		if(workload == BENCH_ZIPF) {
+			double point = (double)(nextRandom(&state) >> 11) / (1ULL << 53) * zipf[maxSize - 1];
+			long long low = 0, high = maxSize - 1;
+			while(low < high) {
+				long long middle = (low + high) / 2;
+				if(zipf[middle] <= point) {
+					low = middle + 1;
+				} else {
+					high = middle;
+				}
+			}
+			sizes[i] = low + 1;
+		} else if(workload == BENCH_BIMODAL && randomBelow(&state, 10) == 0) {
+			sizes[i] = maxSize / 2 + 1 + randomBelow(&state, maxSize - maxSize / 2);
+		} else if(workload == BENCH_BIMODAL) {
+			sizes[i] = 1 + randomBelow(&state, maxSize / 16 > 0 ? maxSize / 16 : 1);
+		} else {
+			sizes[i] = 1 + randomBelow(&state, maxSize);
+		}
+		sum += sizes[i];
+	}
+	long long meanLife = 0.9 * memorySize / (sum / requests);
+	if(meanLife < 1) {
+		meanLife = 1;
+	}
+	for(i = 0; i < requests; i++) {
+		long long life;
+		if(workload == BENCH_BIMODAL) { // large requests live four times as long as small ones
+			life = 1 + randomBelow(&state, sizes[i] > maxSize / 2 ? 4 * meanLife : meanLife);
+		} else if(workload == BENCH_RAMP && i < requests / 2) {
+			life = requests / 2 - i + randomBelow(&state, requests - requests / 2);
+		} else if(workload == BENCH_RAMP) {
+			life = 1 + randomBelow(&state, meanLife);
+		} else {
+			life = 1 + randomBelow(&state, 2 * meanLife);
+		}
+		deaths[i] = i + life;
+		dying[i] = -1;
 	}
+	for(i = requests - 1; i >= 0; i--) { // lists of the processes freed before each request, lowest id first
+		if(deaths[i] < requests) {
+			nextDying[i] = dying[deaths[i]];
+			dying[deaths[i]] = i;
+		}
+	}
+	*count = 0;
+	for(i = 0; i < requests; i++) {
+		long long p;
+		for(p = dying[i]; p != -1; p = nextDying[p]) {
+			TraceEvent event = {TRACE_FREE, p + 1, 0};
+			(*events)[(*count)++] = event;
+		}
+		TraceEvent event = {TRACE_ALLOC, i + 1, sizes[i]};
+		(*events)[(*count)++] = event;
+	}
+	free(sizes);
+	free(deaths);
+	free(dying);
+	free(nextDying);
+	free(zipf);
 }
 
-// Remember last allocation for next-fit algorithm
-int lastAllocationPoint = 0;
+// One policy on one workload of a benchmark, and how it did
+typedef struct BenchRun {
+	const Policy *policy;
+	BenchWorkload workload;
+	long long memorySize;
+	const TraceEvent *events; // the workload, shared with the other policies
+	long long count; // number of events
+	long long allocations; // allocate() calls timed
+	long long frees;
+	double nsPerAllocation; // mean time of an allocate() call
+	long long p50; // median time of an allocate() call, in nanoseconds
+	long long p99; // 99th percentile
+	int processesVacated;
+	int compactionEvents;
+	long long blocksMoved;
+	double seconds; // wall-clock time of the whole run
+	double genericSeconds; // wall-clock time of a replay through the policy table
+	double specializedSeconds; // wall-clock time of a replay with the loop made for the policy
+} BenchRun;
+
+// Everything the runs of a benchmark share
+typedef struct Bench {
+	SimulatorConfig config; // policy and memory size are set per run
+	BenchRun *runs;
+} Bench;
 
 /**
- * Fill a specified chunk of memory with a "process" id, which
- * in our simple simulation means that the memory block has been
- * allocated to that process. The function fills size number of
- * slots with the id, starting at the startBlock
+ * Compare two long longs, for qsort.
+ */
+int compareLongLongs(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Replay one workload with one policy, timing every allocation.
+ */
+void benchJob(void *context, int index) {
+	Bench *bench = context;
+	BenchRun *run = &bench->runs[index];
+	SimulatorConfig config = bench->config;
+	config.policy = run->policy->name;
+	config.memorySize = run->memorySize;
+	long long *latencies = malloc((run->count > 0 ? run->count : 1) * sizeof(long long));
+	if(latencies == NULL) {
+		printf("ERROR! Out of memory for the benchmark\n");
+		exit(1); // Exit with error
+	}
+	double start = wallSeconds();
+	Simulator *sim = simulatorCreate(&config);
+	long long total = 0;
+	long long e;
+	for(e = 0; e < run->count; e++) {
+		const TraceEvent *event = &run->events[e];
+		if(event->type != TRACE_ALLOC) {
+			replayEvent(sim, event);
+			run->frees++;
+			continue;
+		}
+		long long before = monotonicNanos();
+		replayEvent(sim, event);
+		latencies[run->allocations] = monotonicNanos() - before;
+		total += latencies[run->allocations++];
+	}
+	run->processesVacated = sim->processesVacated;
+	run->compactionEvents = sim->compactionEvents;
+	run->blocksMoved = sim->blocksMoved;
+	simulatorDestroy(sim);
+	run->seconds = wallSeconds() - start;
+	if(run->allocations > 0) {
+		qsort(latencies, run->allocations, sizeof(long long), compareLongLongs);
+		run->nsPerAllocation = (double)total / run->allocations;
+		run->p50 = latencies[(run->allocations - 1) / 2];
+		run->p99 = latencies[(run->allocations - 1) * 99 / 100];
+	}
+	free(latencies);
+
+	sim = simulatorCreate(&config);
+	start = wallSeconds();
+	replayEvents(sim, run->events, run->count);
+	run->genericSeconds = wallSeconds() - start;
+	simulatorDestroy(sim);
+	sim = simulatorCreate(&config);
+	start = wallSeconds();
+	findReplay(sim)(sim, run->events, run->count);
+	run->specializedSeconds = wallSeconds() - start;
+	simulatorDestroy(sim);
+}
+
+/**
+ * Bench mode: generate every workload at every memory size, run each with every
+ * policy, and write one CSV row per run. The runs share one thread unless
+ * --threads says otherwise, so they do not disturb each other's timings.
  *
- * @param startBlock index in memory array to start allocation from.
- * @param id the process id to place in allocated array locations.
- * @param size number of array locations to place the id into, starting from startBlock (inclusive)
+ * @param argc number of command line parameters.
+ * @param argv command line parameters, with --bench first.
+ * @return 0 on success, 1 on error.
+ */
+int benchPolicies(int argc, char *argv[]) {
+	const Policy *chosen[sizeof(policies) / sizeof(policies[0])];
+	int policyCount = 0;
+	BenchWorkload workloads[sizeof(benchWorkloads) / sizeof(benchWorkloads[0])];
+	int workloadCount = 0;
+	long long defaultMemory[] = {1024, 65536};
+	long long *memorySizes = defaultMemory;
+	int memoryCount = 2;
+	long long requests = 100000;
+	long long seed = 1;
+	const char *csvName = NULL;
+	int threads = 1;
+	long long value;
+	Bench bench;
+	simulatorDefaults(&bench.config);
+	int arg;
+	for(arg = 2; arg < argc; arg++) {
+		if(strncmp(argv[arg], "--policies=", 11) == 0) {
+			char names[256];
+			snprintf(names, sizeof(names), "%s", argv[arg] + 11);
+			char *name;
+			policyCount = 0;
+			for(name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+				const Policy *policy = findPolicy(name);
+				if(policy == NULL || policyCount == sizeof(chosen) / sizeof(chosen[0])) {
+					printf("Invalid memory allocation policy %s\n", name);
+					printf(" ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits\n");
+					return 1; // Error
+				}
+				chosen[policyCount++] = policy;
+			}
+		} else if(strncmp(argv[arg], "--workloads=", 12) == 0) {
+			char names[256];
+			snprintf(names, sizeof(names), "%s", argv[arg] + 12);
+			char *name;
+			workloadCount = 0;
+			for(name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+				int w = 0;
+				while(w < sizeof(benchWorkloads) / sizeof(benchWorkloads[0]) && strcmp(name, benchWorkloads[w]) != 0) {
+					w++;
+				}
+				if(w == sizeof(benchWorkloads) / sizeof(benchWorkloads[0]) || workloadCount == sizeof(workloads) / sizeof(workloads[0])) {
+					printf("Invalid workload %s\n", name);
+					printf(" uniform, zipf, bimodal or ramp\n");
+					return 1; // Error
+				}
+				workloads[workloadCount++] = w;
+			}
+		} else if(strncmp(argv[arg], "--memory=", 9) == 0) {
+			if(!parseCountList(argv[arg] + 9, &memorySizes, &memoryCount)) {
+				printf("Invalid memory sizes %s\n", argv[arg] + 9);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--requests=", 11) == 0 && parseCount(argv[arg] + 11, &value)) {
+			requests = value;
+		} else if(strncmp(argv[arg], "--seed=", 7) == 0 && parseCount(argv[arg] + 7, &value)) {
+			seed = value;
+		} else if(strncmp(argv[arg], "--frame=", 8) == 0 && parseCount(argv[arg] + 8, &value)) {
+			bench.config.frameSize = value;
+		} else if(strncmp(argv[arg], "--store=", 8) == 0 && findStore(argv[arg] + 8) != NULL) {
+			bench.config.store = argv[arg] + 8;
+		} else if(strncmp(argv[arg], "--engine=", 9) == 0 && findEngine(argv[arg] + 9) != NULL) {
+			bench.config.engine = argv[arg] + 9;
+		} else if(strncmp(argv[arg], "--compaction=", 13) == 0 && findCompactor(argv[arg] + 13) != NULL) {
+			bench.config.compaction = argv[arg] + 13;
+		} else if(strncmp(argv[arg], "--eviction=", 11) == 0 && findEvictor(argv[arg] + 11) != NULL) {
+			bench.config.eviction = argv[arg] + 11;
+		} else if(strncmp(argv[arg], "--csv=", 6) == 0) {
+			csvName = argv[arg] + 6;
+		} else if(strncmp(argv[arg], "--threads=", 10) == 0 && parseCount(argv[arg] + 10, &value)) {
+			threads = value < INT_MAX ? value : INT_MAX;
+		} else {
+			printUsage();
+			return 1; // Error
+		}
+	}
+	if(policyCount == 0) { // every policy, in table order
+		for(policyCount = 0; policyCount < sizeof(policies) / sizeof(policies[0]); policyCount++) {
+			chosen[policyCount] = &policies[policyCount];
+		}
+	}
+	if(workloadCount == 0) {
+		for(workloadCount = 0; workloadCount < sizeof(workloads) / sizeof(workloads[0]); workloadCount++) {
+			workloads[workloadCount] = workloadCount;
+		}
+	}
+	FILE *csv = stdout;
+	if(csvName != NULL && (csv = fopen(csvName, "w")) == NULL) {
+		printf("Problem writing file %s\n", csvName);
+		return 1; // Error
+	}
+
+	// each workload is generated once per memory size, before anything is timed
+	TraceEvent **events = malloc(workloadCount * memoryCount * sizeof(TraceEvent *));
+	long long *counts = malloc(workloadCount * memoryCount * sizeof(long long));
+	bench.runs = calloc(workloadCount * memoryCount * policyCount, sizeof(BenchRun));
+	if(events == NULL || counts == NULL || bench.runs == NULL) {
+		printf("ERROR! Out of memory for the benchmark\n");
+		exit(1); // Exit with error
+	}
+	int runs = 0;
+	int w, m, p;
+	for(w = 0; w < workloadCount; w++) {
+		for(m = 0; m < memoryCount; m++) {
+			int g = w * memoryCount + m;
+			generateWorkload(workloads[w], memorySizes[m], requests, seed, &events[g], &counts[g]);
+			for(p = 0; p < policyCount; p++) {
+				bench.runs[runs].policy = chosen[p];
+				bench.runs[runs].workload = workloads[w];
+				bench.runs[runs].memorySize = memorySizes[m];
+				bench.runs[runs].events = events[g];
+				bench.runs[runs].count = counts[g];
+				runs++;
+			}
+		}
+	}
+
+	ThreadPool pool = {runs, benchJob, &bench};
+	runPool(&pool, threads);
+
+	fprintf(csv, "workload,policy,memory,frame,allocations,frees,ns_per_alloc,p50_ns,p99_ns,vacated,compactions,moved,seconds,generic_seconds,specialized_seconds\n");
+	int r;
+	for(r = 0; r < runs; r++) {
+		BenchRun *run = &bench.runs[r];
+		fprintf(csv, "%s,%s,%lld,", benchWorkloads[run->workload], run->policy->name, run->memorySize);
+		if(run->policy->paging) { // contiguous policies have no frames
+			fprintf(csv, "%lld", bench.config.frameSize);
+		}
+		fprintf(csv, ",%lld,%lld,%.1f,%lld,%lld,%d,%d,%lld,%.6f,%.6f,%.6f\n", run->allocations, run->frees, run->nsPerAllocation, run->p50, run->p99,
+			run->processesVacated, run->compactionEvents, run->blocksMoved, run->seconds, run->genericSeconds, run->specializedSeconds);
+	}
+	if(csv != stdout) {
+		fclose(csv);
+	}
+	for(w = 0; w < workloadCount * memoryCount; w++) {
+		free(events[w]);
+	}
+	free(events);
+	free(counts);
+	free(bench.runs);
+	if(memorySizes != defaultMemory) {
+		free(memorySizes);
+	}
+	return 0;
+}
+
+/**
+ * Stress mode times malloc and free themselves on 1, 2, 4 and so on up to one
+ * thread per processor, to show how the allocator scales. It uses whatever
+ * malloc the program runs with, so
+ *   LD_PRELOAD=./memoryAllocationPreload.so ./memoryAllocation --stress
+ * measures the policies in real-memory mode (see MEMORY_ALLOCATION_PRELOAD),
+ * and without LD_PRELOAD it measures the C library. Each thread keeps
+ * STRESS_SLOTS allocations, nine in ten of them 16 to 256 bytes, and on every
+ * operation replaces a random one. One operation in 16 swaps the allocation
+ * with a slot shared by all threads, so blocks are often freed by another
+ * thread than the one that allocated them.
+ */
+
+// Allocations each thread of the stress benchmark keeps
+#define STRESS_SLOTS 256
+// Slots shared by the threads, through which allocations change hands
+#define STRESS_SHARED 1024
+
+// One run of the stress benchmark
+typedef struct Stress {
+	long long operations; // allocations each thread makes
+	void **shared; // STRESS_SHARED slots for allocations that change hands
+} Stress;
+
+// One thread of a stress run
+typedef struct StressWorker {
+	Stress *stress;
+	uint64_t seed; // state of its random number generator
+} StressWorker;
+
+void *stressWorker(void *argument) {
+	StressWorker *worker = argument;
+	Stress *stress = worker->stress;
+	char *slots[STRESS_SLOTS] = {NULL};
+	long long i;
+	for(i = 0; i < stress->operations; i++) {
+		uint64_t r = nextRandom(&worker->seed);
+		int slot = r % STRESS_SLOTS;
+		int kind = (r >> 8) % 100;
+		size_t size = kind < 90 ? 16 + (r >> 16) % 241 : kind < 99 ? 257 + (r >> 16) % 3840 : 4097 + (r >> 16) % 61440;
+		free(slots[slot]);
+		slots[slot] = malloc(size);
+		if(slots[slot] == NULL) {
+			printf("ERROR! malloc of %zu bytes failed\n", size);
+			exit(1); // Exit with error
+		}
+		slots[slot][0] = slots[slot][size - 1] = (char)i; // touch both ends, as a program would
+		if((r >> 40) % 16 == 0) { // hand the allocation to whichever thread takes this shared slot next
+			slots[slot] = __atomic_exchange_n(&stress->shared[(r >> 44) % STRESS_SHARED], slots[slot], __ATOMIC_ACQ_REL);
+		}
+	}
+	for(i = 0; i < STRESS_SLOTS; i++) {
+		free(slots[i]);
+	}
+	return NULL;
+}
+
+/**
+ * Stress mode: run the stress benchmark on each number of threads and write
+ * one CSV row for each, with the speedup over the first.
+ *
+ * @param argc number of command line parameters.
+ * @param argv command line parameters, with --stress first.
+ * @return 0 on success, 1 on error.
  */
-void fillMemory(int startBlock, int id, int size) {
-	printf("Allocate %d through %d to %d\n", startBlock, startBlock + size - 1, id);
-	int i;
-	for(i = 0; i < size; i++) {
-		if(memory[startBlock + i] != 0) { // Useful check for debugging: Never fill reserved space
-			printf("ERROR! Cell %d not empty. Contains %d\n", startBlock + i, memory[startBlock + i]);
+int stressMalloc(int argc, char *argv[]) {
+	long long *threadCounts = NULL;
+	int runs = 0;
+	long long operations = 1000000;
+	const char *csvName = NULL;
+	long long value;
+	int arg;
+	for(arg = 2; arg < argc; arg++) {
+		if(strncmp(argv[arg], "--threads=", 10) == 0) {
+			free(threadCounts);
+			if(!parseCountList(argv[arg] + 10, &threadCounts, &runs)) {
+				printf("Invalid thread counts %s\n", argv[arg] + 10);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--operations=", 13) == 0 && parseCount(argv[arg] + 13, &value)) {
+			operations = value;
+		} else if(strncmp(argv[arg], "--csv=", 6) == 0) {
+			csvName = argv[arg] + 6;
+		} else {
+			free(threadCounts);
+			printUsage();
+			return 1; // Error
+		}
+	}
+	if(threadCounts == NULL) { // powers of two up to the processors, and the processors themselves
+		int processors = processorCount();
+		threadCounts = malloc((highestBit(processors) + 2) * sizeof(long long));
+		if(threadCounts == NULL) {
+			printf("ERROR! Out of memory for the benchmark\n");
 			exit(1); // Exit with error
 		}
-		if(startBlock + i >= MEM_SIZE) { // Useful check for debugging: Never go outside of bounds
-			printf("ERROR! Cell %d out of bounds\n", startBlock + i);
+		long long threads;
+		for(threads = 1; threads < processors; threads *= 2) {
+			threadCounts[runs++] = threads;
+		}
+		threadCounts[runs++] = processors;
+	}
+	FILE *csv = stdout;
+	if(csvName != NULL && (csv = fopen(csvName, "w")) == NULL) {
+		printf("Problem writing file %s\n", csvName);
+		free(threadCounts);
+		return 1; // Error
+	}
+	fprintf(csv, "threads,operations,seconds,operations_per_second,speedup\n");
+	double first = 0;
+	int r;
+	for(r = 0; r < runs; r++) {
+		int threads = threadCounts[r] < 4096 ? threadCounts[r] : 4096;
+		Stress stress = {operations, calloc(STRESS_SHARED, sizeof(void *))};
+		StressWorker *workers = malloc(threads * sizeof(StressWorker));
+		pthread_t *ids = malloc(threads * sizeof(pthread_t));
+		if(stress.shared == NULL || workers == NULL || ids == NULL) {
+			printf("ERROR! Out of memory for the benchmark\n");
 			exit(1); // Exit with error
 		}
-		memory[startBlock + i] = id; // "allocate" block to id
+		double start = wallSeconds();
+		int t;
+		for(t = 0; t < threads; t++) {
+			workers[t].stress = &stress;
+			workers[t].seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+			if(pthread_create(&ids[t], NULL, stressWorker, &workers[t]) != 0) {
+				printf("ERROR! Cannot start thread %d of the benchmark\n", t + 1);
+				exit(1); // Exit with error
+			}
+		}
+		for(t = 0; t < threads; t++) {
+			pthread_join(ids[t], NULL);
+		}
+		for(t = 0; t < STRESS_SHARED; t++) {
+			free(stress.shared[t]);
+		}
+		double seconds = wallSeconds() - start;
+		double rate = threads * operations / seconds;
+		if(r == 0) {
+			first = rate;
+		}
+		fprintf(csv, "%d,%lld,%.6f,%.0f,%.2f\n", threads, threads * operations, seconds, rate, rate / first);
+		fflush(csv);
+		free(stress.shared);
+		free(workers);
+		free(ids);
 	}
-	lastAllocationPoint = startBlock + size; // Information tracked for next-fit algorithm
+	if(csv != stdout) {
+		fclose(csv);
+	}
+	free(threadCounts);
+	return 0;
 }
 
+#ifdef MEMORY_ALLOCATION_PRELOAD
 /**
- * Increment every time vacateProcess is called
+ * Real-memory mode. Built with -DMEMORY_ALLOCATION_PRELOAD, this file becomes
+ * the malloc, free, calloc and realloc of another program, run by the same
+ * policy code as the simulation:
+ *   make memoryAllocationPreload.so
+ *   MEMALLOC_POLICY=bf LD_PRELOAD=./memoryAllocationPreload.so ./program
+ * Memory is divided into arenas, each a range of address space with one block
+ * per MEMALLOC_BLOCK bytes, placed by a Simulator and guarded by a lock of its
+ * own. Threads are dealt out to the arenas in turn, and an arena is set up
+ * when its first thread arrives. Every allocation is a process of its own,
+ * and the ids of freed allocations are handed out again. Real data cannot be
+ * vacated or compacted away, so a request the policy cannot place fails with
+ * ENOMEM.
+ * A thread keeps allocations of up to CACHE_CLASSES blocks that it frees in a
+ * cache of its own, CACHE_DEPTH of each size, and hands them out again without
+ * taking a lock; the simulation counts them as allocated until the cache is
+ * full or the thread ends. A thread that frees an allocation of another arena
+ * pushes it onto that arena's remote-free stack, also without a lock, and the
+ * next thread to take the arena's lock frees it there.
+ * The pages policy takes its frames from a memfd and maps the frames of each
+ * allocation side by side into a window of address space of its own, so the
+ * program sees one contiguous allocation whose frames need not be. Every
+ * window costs at least one kernel mapping, and malloc fails once the kernel's
+ * vm.max_map_count is reached, so paging suits programs with few, large
+ * allocations. It has no thread caches: finding the arena of a window means
+ * asking each arena in turn. Settings come from the environment:
+ *   MEMALLOC_POLICY    ff, nf, bf, wf, pages, buddy or tlsf (default ff)
+ *   MEMALLOC_ARENAS    number of arenas (default one per processor)
+ *   MEMALLOC_ARENA     bytes of address space in each arena (default 1 GiB)
+ *   MEMALLOC_BLOCK     bytes in a block, a power of two of at least 16 (default 16)
+ *   MEMALLOC_FRAME     blocks in a frame for pages, a whole number of system pages (default one page)
+ *   MEMALLOC_STORE     u16, u32 or rle, as --store (default u32)
+ *   MEMALLOC_ENGINE    extent or bitmap, as --engine (default extent)
+ *   MEMALLOC_TRIM      free space of at least this many bytes goes back to the kernel (default 128 KiB)
+ *   MEMALLOC_TELEMETRY=FILE, MEMALLOC_TELEMETRY_EVERY=N  as --telemetry and --telemetry-every,
+ *                      for arena 0; arena K writes to FILE.K
+ *   MEMALLOC_STATS     if set, the counters of each arena are printed to standard error at exit
+ * Everything the simulator allocates for itself comes from glibc, through
+ * __libc_malloc and its relatives: while a thread is inside the shim, its
+ * allocations are passed straight on, and a pointer outside the arenas is
+ * handed to glibc's free.
  */
-int processesVacated = 0;
+
+// glibc's own allocator, which the simulator's bookkeeping uses
+#pragma GCC visibility push(default)
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *pointer);
+#pragma GCC visibility pop
+
+// Marks the functions the shared object exports
+#define SHIM_EXPORT __attribute__((visibility("default")))
+
+// Allocations of up to this many blocks are kept in the cache of the thread that frees them
+#define CACHE_CLASSES 32
+// Allocations of each size a thread cache holds
+#define CACHE_DEPTH 64
 
 /**
- * When memory gets full, it will be necessary to vacate "processes."
- * This function scans memory and deallocates (sets to zero) all slots 
- * allocated to the process with the given id.
- *
- * @param id process id in array to replace with 0.
+ * One arena: a range of address space whose blocks one simulation places.
  */
-void vacateProcess(int id) {
-	printf("vacate %d\n", id);
-	processesVacated++; // Incremented processes vacated with each call to vacate process
-	
-	// create variables to keep track of the size and starting index of the largest process
-	int processSize = 0;
-    int processStart = 0;
-
-	// initilaize loop variable 
-    int i;
-	// loop through all positions in memory
-    for (i = 0; i < MEM_SIZE; i++) {
-		// if the process at the current location in memory is holds the largest process
-        if (memory[i] == id) {
-			// if this is the first time coming accross the largest process, set the starting index to the current iteration
-            if (processSize == 0) {
-                processStart = i; 
-            }
-			// increment the process size each time we encounter the process during the loop
-            processSize++;
-        }
-    }
-
-	// finds the final position from which the process will be vacated
-	int length = processSize + processStart;
-    // Set memory slots occupied by the largest process to 0
-    for (i = processStart; i < length; i++) {
-        memory[i] = 0;
-    }
-}
-
-int vacantSpace(){
-	int totalVacantSpace = 0;
-	// initilaize loop variable 
-    int i;
-	// loop through all positions in memory
-    for (i = 0; i < MEM_SIZE; i++) {
-		// if the process at the current location in memory is holds the largest process
-        if (memory[i] == 0) {
-            totalVacantSpace++;
-        }
-    }
-	return totalVacantSpace;
-}
-
-/**
- * This is a pointer to a function. The policy is the memory allocation policy.
- * You will be implementing multiple policies, each with the same signature:
- * a bool is returned indicating the success of the allocation, and the two int
- * inputs are the id number to reserve the memory for, and the size 
- * (number of blocks) to reserve. This value is set in the main function based
- * on command-line parameters.
- */
-bool (*policy)(int,int);
+typedef struct ShimArena {
+	pthread_mutex_t lock; // held by every call that touches the simulation
+	Simulator *sim; // the simulation that places allocations
+	char *base; // address of block 0, NULL for the pages policy
+	int memoryFd; // memfd that holds the frames of the pages policy, -1 for the others
+	int forkFd; // copy of those frames for the child of a fork in progress, -1 otherwise
+	// Windows of the pages policy, ordered by address: start is the address, length the id
+	Extent *windows;
+	// Blocks of the cacheable allocation that starts at each block, 0 if none does (NULL for pages)
+	unsigned char *cacheClass;
+	// Addresses freed by threads of other arenas, linked through their first bytes
+	void *remoteFrees;
+	// Ids of freed allocations, to be handed out again, and the lowest id never handed out
+	int *spareIds;
+	int spareIdCount;
+	int spareIdCapacity;
+	int nextId;
+	long long mallocs; // allocations the arena was asked to place, not counting thread caches
+	long long frees; // allocations the arena freed
+	long long remoteFreed; // of those, the ones other arenas' threads freed
+	long long reallocs; // calls of realloc on an allocation of the arena
+	long long failures; // requests the policy could not place
+	long long bytesInUse; // bytes of the blocks owned by allocations, including those in thread caches
+	long long peakBytesInUse; // largest that has been
+} ShimArena;
 
 /**
- * For each allocation policy below, assign the process id to
- * a contiguous region of memory with "size" number of blocks. Return
- * true on success, and false if no region large enough exists.
+ * State of the real-memory allocator. malloc has no argument to carry it in,
+ * so unlike a simulation it is kept in a global.
  */
+typedef struct Shim {
+	pthread_mutex_t lock; // guards setting up the shim and its arenas
+	bool started; // true once the settings are read
+	SimulatorConfig config; // settings of the simulation of every arena
+	long long arenaBytes; // bytes of address space in each arena
+	int blockShift; // log2 of the bytes in a block
+	long long pageBytes; // bytes in a page of the system
+	long long frameBytes; // bytes in a frame of the pages policy
+	long long trimBytes; // free space at least this long goes back to the kernel
+	const char *telemetryName; // telemetry file of arena 0, or NULL
+	long long telemetryEvery;
+	bool stats; // print the counters at exit
+	char *space; // the arenas one after another, NULL for the pages policy
+	ShimArena **arenas; // each arena, NULL until its first thread arrives
+	int arenaCount;
+	int nextArena; // the next new thread gets this arena, modulo arenaCount
+	pthread_key_t cacheKey; // flushes the cache of a thread that ends
+} Shim;
+
+Shim shim = { PTHREAD_MUTEX_INITIALIZER };
+
+// Free allocations a thread keeps, all from its own arena
+typedef struct ThreadCache {
+	int arena; // 1 + the arena of the thread, 0 before its first call
+	bool registered; // cacheKey is set, so the cache is flushed when the thread ends
+	void *lists[CACHE_CLASSES + 1]; // allocations of each number of blocks, linked through their first bytes
+	int counts[CACHE_CLASSES + 1];
+} ThreadCache;
+
+// Set while this thread is inside the shim, so the simulator's own allocations go to glibc
+__thread bool insideShim __attribute__((tls_model("initial-exec")));
+__thread ThreadCache threadCache __attribute__((tls_model("initial-exec")));
 
 /**
- * first-fit allocation according to specification above.
+ * Read a count from the environment.
  *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
- * @return true if allocation succeeds, false if it fails.
+ * @param name the variable.
+ * @param fallback value when the variable is not set.
+ * @return the value.
  */
-bool firstFit(int id, int size) {
-	// stores the starting index of the contiguous block
-	int start = -1; 
-	// counter for the number of contigous blocks 
-	int count = 0; 
-
-	// Iterate through the memory array to find the first available slot of memory which will have enough space to hold the process
-	int i;
-		for(i = 0; i < MEM_SIZE; i++){
-			// if the memory at the current loop iteration is empty
-			if(memory[i] == 0){
-				// if start as not yet been set, set the value of start equal to the current iteration index
-				if(start == -1){
-					start = i;
-				}
-				// increment count for each of the memory locations at which the current loop iteration is empty
-				count++;
-				// if count is eqal to the size of the process, we have enough space to insert the process
-				if(count == size) {
-					// fill the memory with the process
-					fillMemory(start, id, size);
-					return true;
+long long shimSetting(const char *name, long long fallback) {
+	const char *text = getenv(name);
+	long long value;
+	if(text == NULL) {
+		return fallback;
+	}
+	if(!parseCount(text, &value)) {
+		fprintf(stderr, "ERROR! %s must be a whole number of at least 1\n", name);
+		exit(1); // Exit with error
+	}
+	return value;
+}
+
+// A fork must not copy a lock while another thread holds it (see prepareFork)
+void lockShim() {
+	pthread_mutex_lock(&shim.lock);
+	int k;
+	for(k = 0; k < shim.arenaCount; k++) {
+		if(shim.arenas[k] != NULL) {
+			pthread_mutex_lock(&shim.arenas[k]->lock);
+		}
+	}
+}
+
+void unlockShim() {
+	int k;
+	for(k = shim.arenaCount - 1; k >= 0; k--) {
+		if(shim.arenas[k] != NULL) {
+			pthread_mutex_unlock(&shim.arenas[k]->lock);
+		}
+	}
+	pthread_mutex_unlock(&shim.lock);
+}
+
+/**
+ * Copy the frames of the live windows of an arena into a memfd at the same
+ * offsets, or map each window from that memfd instead of the arena's.
+ *
+ * @param copy true to copy, false to map.
+ */
+void cloneWindows(ShimArena *arena, Extent *window, int fd, bool copy) {
+	if(window != NULL) {
+		cloneWindows(arena, window->addrLeft, fd, copy);
+		Process *process = &arena->sim->processTable[window->length];
+		char *address = (char *)(uintptr_t)window->start;
+		long long page = 0;
+		while(page < process->pageCount) { // frames that follow each other share one mapping
+			long long run = 1;
+			while(page + run < process->pageCount && process->pageTable[page + run] == process->pageTable[page] + run) {
+				run++;
+			}
+			char *from = address + page * shim.frameBytes;
+			long long bytes = run * shim.frameBytes;
+			long long offset = process->pageTable[page] * shim.frameBytes;
+			long long done = 0;
+			while(copy && done < bytes) {
+				ssize_t written = pwrite(fd, from + done, bytes - done, offset + done);
+				if(written <= 0 && errno != EINTR) {
+					break;
 				}
+				done += written > 0 ? written : 0;
 			}
-			// if we do not find that the current contiguous region has enough space available, we reset the starting index and contigous block count
-			else {
-				start = -1; 
-				count = 0;
+			if(copy ? done < bytes : mmap(from, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+				fprintf(stderr, "ERROR! Cannot give the child of a fork frames of its own\n");
+				exit(1); // Exit with error
 			}
+			page += run;
 		}
-		return false;
+		cloneWindows(arena, window->addrRight, fd, copy);
+	}
+}
+
+/**
+ * Before a fork, take every lock and copy the frames of each arena of the
+ * pages policy into a new memfd for the child. The windows map their frames
+ * shared from the arena's memfd, and a fork keeps the memfd, so otherwise
+ * parent and child would write to the same frames and each hand them out on
+ * its own. The copy is made while the locks are held, because once fork
+ * returns the parent goes on freeing and reusing frames.
+ */
+void prepareFork() {
+	lockShim();
+	int k;
+	for(k = 0; k < shim.arenaCount; k++) {
+		ShimArena *arena = shim.arenas[k];
+		if(arena != NULL && arena->memoryFd != -1) {
+			arena->forkFd = memfd_create("memalloc", MFD_CLOEXEC);
+			if(arena->forkFd == -1 || ftruncate(arena->forkFd, shim.arenaBytes) != 0) {
+				fprintf(stderr, "ERROR! Cannot create the frames of arena %d for the child of a fork\n", k);
+				exit(1); // Exit with error
+			}
+			cloneWindows(arena, arena->windows, arena->forkFd, true);
+		}
+	}
+}
+
+// The parent keeps its frames and drops the copy
+void parentFork() {
+	int k;
+	for(k = 0; k < shim.arenaCount; k++) {
+		if(shim.arenas[k] != NULL && shim.arenas[k]->forkFd != -1) {
+			close(shim.arenas[k]->forkFd);
+			shim.arenas[k]->forkFd = -1;
+		}
+	}
+	unlockShim();
+}
+
+// The child maps its windows from the copy, as a fork copies private memory
+void childFork() {
+	int k;
+	for(k = 0; k < shim.arenaCount; k++) {
+		ShimArena *arena = shim.arenas[k];
+		if(arena != NULL && arena->forkFd != -1) {
+			cloneWindows(arena, arena->windows, arena->forkFd, false);
+			close(arena->memoryFd);
+			arena->memoryFd = arena->forkFd;
+			arena->forkFd = -1;
+		}
+	}
+	unlockShim();
+}
+
+void flushCache(void *unused);
+
+/**
+ * Read the settings, on the first call. Settings that make no sense end the
+ * program, as a bad command line does.
+ */
+void startShim() {
+	simulatorDefaults(&shim.config);
+	if(getenv("MEMALLOC_POLICY") != NULL) {
+		shim.config.policy = getenv("MEMALLOC_POLICY");
+	}
+	if(getenv("MEMALLOC_STORE") != NULL) {
+		shim.config.store = getenv("MEMALLOC_STORE");
+	}
+	if(getenv("MEMALLOC_ENGINE") != NULL) {
+		shim.config.engine = getenv("MEMALLOC_ENGINE");
+	}
+	long long blockBytes = shimSetting("MEMALLOC_BLOCK", 16);
+	if(blockBytes < 16 || (blockBytes & (blockBytes - 1)) != 0) {
+		fprintf(stderr, "ERROR! MEMALLOC_BLOCK must be a power of two of at least 16\n");
+		exit(1); // Exit with error
+	}
+	shim.blockShift = highestBit(blockBytes);
+	shim.pageBytes = sysconf(_SC_PAGESIZE);
+	shim.arenaBytes = shimSetting("MEMALLOC_ARENA", 1LL << 30) / shim.pageBytes * shim.pageBytes;
+	shim.trimBytes = shimSetting("MEMALLOC_TRIM", 128 << 10);
+	shim.config.memorySize = shim.arenaBytes >> shim.blockShift;
+	shim.config.frameSize = shimSetting("MEMALLOC_FRAME", shim.pageBytes > blockBytes ? shim.pageBytes / blockBytes : 1);
+	shim.frameBytes = shim.config.frameSize << shim.blockShift;
+	const Policy *policy = findPolicy(shim.config.policy);
+	if(policy == NULL || findStore(shim.config.store) == NULL || findEngine(shim.config.engine) == NULL || shim.arenaBytes == 0) {
+		fprintf(stderr, "ERROR! Invalid policy, store, engine or arena in MEMALLOC_ settings\n");
+		exit(1); // Exit with error
+	}
+	if(policy->paging && shim.frameBytes % shim.pageBytes != 0) {
+		fprintf(stderr, "ERROR! MEMALLOC_FRAME must make frames a whole number of %lld byte pages\n", shim.pageBytes);
+		exit(1); // Exit with error
+	}
+	long long arenas = shimSetting("MEMALLOC_ARENAS", processorCount());
+	shim.arenaCount = arenas < 256 ? arenas : 256;
+	shim.arenas = calloc(shim.arenaCount, sizeof(ShimArena *));
+	if(shim.arenas == NULL) {
+		fprintf(stderr, "ERROR! Out of memory for the arenas\n");
+		exit(1); // Exit with error
+	}
+	if(!policy->paging) {
+		// address space only; the kernel gives it memory as it is touched
+		shim.space = mmap(NULL, shim.arenaBytes * shim.arenaCount, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(shim.space == MAP_FAILED) {
+			fprintf(stderr, "ERROR! Cannot map %d arenas of %lld bytes\n", shim.arenaCount, shim.arenaBytes);
+			exit(1); // Exit with error
+		}
+	}
+	shim.telemetryName = getenv("MEMALLOC_TELEMETRY");
+	shim.telemetryEvery = shimSetting("MEMALLOC_TELEMETRY_EVERY", 1);
+	shim.stats = getenv("MEMALLOC_STATS") != NULL;
+	pthread_key_create(&shim.cacheKey, flushCache);
+	pthread_atfork(prepareFork, parentFork, childFork);
+	shim.started = true;
+}
+
+/**
+ * Set up an arena for its first thread, with shim.lock held.
+ *
+ * @param k number of the arena.
+ * @return the arena.
+ */
+ShimArena *createArena(int k) {
+	ShimArena *arena = calloc(1, sizeof(ShimArena));
+	if(arena == NULL || (arena->sim = simulatorCreate(&shim.config)) == NULL) {
+		fprintf(stderr, "ERROR! Cannot create arena %d\n", k);
+		exit(1); // Exit with error
+	}
+	pthread_mutex_init(&arena->lock, NULL);
+	arena->memoryFd = -1;
+	arena->forkFd = -1;
+	arena->nextId = 1;
+	if(arena->sim->policy->paging) {
+		arena->memoryFd = memfd_create("memalloc", MFD_CLOEXEC);
+		if(arena->memoryFd == -1 || ftruncate(arena->memoryFd, shim.arenaBytes) != 0) {
+			fprintf(stderr, "ERROR! Cannot create the frames of arena %d\n", k);
+			exit(1); // Exit with error
+		}
+	} else {
+		arena->base = shim.space + k * shim.arenaBytes;
+		arena->cacheClass = mmap(NULL, arena->sim->memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(arena->cacheClass == MAP_FAILED) {
+			fprintf(stderr, "ERROR! Cannot map the size classes of arena %d\n", k);
+			exit(1); // Exit with error
+		}
+	}
+	if(shim.telemetryName != NULL) {
+		char name[4096];
+		snprintf(name, sizeof(name), k == 0 ? "%s" : "%s.%d", shim.telemetryName, k);
+		if(!simulatorTelemetry(arena->sim, name, false, shim.telemetryEvery)) {
+			fprintf(stderr, "ERROR! Cannot write telemetry to %s\n", name);
+			exit(1); // Exit with error
+		}
+	}
+	return arena;
+}
+
+/**
+ * Find the arena of the calling thread, which must be inside the shim,
+ * dealing it one on its first call.
+ */
+ShimArena *threadArena() {
+	if(threadCache.arena == 0) {
+		pthread_mutex_lock(&shim.lock);
+		if(!shim.started) {
+			startShim();
+		}
+		int k = shim.nextArena;
+		shim.nextArena = (shim.nextArena + 1) % shim.arenaCount;
+		if(shim.arenas[k] == NULL) {
+			shim.arenas[k] = createArena(k);
+		}
+		pthread_mutex_unlock(&shim.lock);
+		threadCache.arena = k + 1;
+	}
+	return shim.arenas[threadCache.arena - 1];
+}
+
+/**
+ * Map the frames of an allocation of the pages policy side by side into a
+ * window of address space, so its pages are contiguous to the program even
+ * though its frames need not be.
+ *
+ * @param id the allocation, which has just been placed.
+ * @return the start of the window, or NULL if the kernel refuses a mapping.
+ */
+char *mapWindow(ShimArena *arena, int id) {
+	Simulator *sim = arena->sim;
+	Process *process = &sim->processTable[id];
+	long long bytes = process->pageCount * shim.frameBytes;
+	char *window = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(window == MAP_FAILED) {
+		return NULL;
+	}
+	long long page = 0;
+	while(page < process->pageCount) { // frames that follow each other share one mapping
+		long long run = 1;
+		while(page + run < process->pageCount && process->pageTable[page + run] == process->pageTable[page] + run) {
+			run++;
+		}
+		if(mmap(window + page * shim.frameBytes, run * shim.frameBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, arena->memoryFd, process->pageTable[page] * shim.frameBytes) == MAP_FAILED) {
+			munmap(window, bytes);
+			return NULL;
+		}
+		page += run;
+	}
+	insertByAddress(sim, &arena->windows, (long long)(uintptr_t)window, id);
+	return window;
+}
+
+/**
+ * Give the pages of the free extent around blocks that were just freed back
+ * to the kernel, if that extent is at least MEMALLOC_TRIM bytes long. Only the
+ * pages that overlap the freed blocks are given back; the rest of the extent
+ * went back when it was freed.
+ *
+ * @param first first block freed.
+ * @param length number of blocks freed.
+ */
+void trimArena(ShimArena *arena, long long first, long long length) {
+	Extent *hole = extentAtOrBefore(arena->sim->addressRoot, first);
+	if(hole == NULL || (hole->length << shim.blockShift) < shim.trimBytes) {
+		return;
+	}
+	uintptr_t pageMask = shim.pageBytes - 1;
+	uintptr_t low = (uintptr_t)(arena->base + (first << shim.blockShift)) & ~pageMask;
+	uintptr_t high = ((uintptr_t)(arena->base + ((first + length) << shim.blockShift)) + pageMask) & ~pageMask;
+	uintptr_t holeLow = (uintptr_t)(arena->base + (hole->start << shim.blockShift));
+	uintptr_t holeHigh = (uintptr_t)(arena->base + ((hole->start + hole->length) << shim.blockShift));
+	if(low < holeLow) { // pages shared with an allocation before the hole stay
+		low = (holeLow + pageMask) & ~pageMask;
+	}
+	if(high > holeHigh) { // and so do pages shared with one after it
+		high = holeHigh & ~pageMask;
+	}
+	if(low < high) {
+		madvise((void *)low, high - low, MADV_DONTNEED);
+	}
+}
+
+/**
+ * Place a new allocation, with the arena's lock held.
+ *
+ * @param bytes bytes asked for.
+ * @param alignment power of two, at least the bytes of a block, that the address must be a multiple of.
+ * @return the address, or NULL if the policy cannot place the allocation.
+ */
+void *allocateShim(ShimArena *arena, size_t bytes, size_t alignment) {
+	Simulator *sim = arena->sim;
+	size_t blockBytes = (size_t)1 << shim.blockShift;
+	size_t slack = alignment - blockBytes; // the address may have to move up this far to be aligned
+	if(bytes == 0) { // malloc(0) still returns an address of its own, which must lie inside the allocation
+		bytes = 1;
+	}
+	if(bytes > (size_t)shim.arenaBytes || slack > (size_t)shim.arenaBytes - bytes) {
+		arena->failures++;
+		return NULL;
+	}
+	long long blocks = (bytes + slack + blockBytes - 1) >> shim.blockShift;
+	int id;
+	bool spare = arena->spareIdCount > 0;
+	if(spare) {
+		id = arena->spareIds[--arena->spareIdCount];
+	} else if(arena->nextId <= sim->memory->maxId) {
+		id = arena->nextId++;
+	} else {
+		arena->failures++; // every id the store can hold is in use
+		return NULL;
+	}
+	char *start = NULL;
+	if(placeProcess(sim, id, blocks)) {
+		sim->processTable[id].arrival = ++sim->arrivals;
+		if(!sim->policy->paging) {
+			long long first = sim->processTable[id].extents[0].start;
+			start = arena->base + (first << shim.blockShift);
+			arena->cacheClass[first] = alignment == blockBytes && blocks <= CACHE_CLASSES ? blocks : 0;
+		} else if((start = mapWindow(arena, id)) == NULL) {
+			releaseProcess(sim, id);
+		}
+	}
+	if(start == NULL) {
+		if(spare) {
+			arena->spareIdCount++; // the id is still where it was taken from
+		} else {
+			arena->nextId--;
+		}
+		arena->failures++;
+		return NULL;
+	}
+	arena->bytesInUse += blocks << shim.blockShift;
+	if(arena->bytesInUse > arena->peakBytesInUse) {
+		arena->peakBytesInUse = arena->bytesInUse;
+	}
+	return (void *)(((uintptr_t)start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+/**
+ * Find the allocation an address lies in, with the arena's lock held.
+ *
+ * @param address any address inside an allocation, such as the one malloc returned.
+ * @param start receives the address of the allocation's first block.
+ * @return the id of the allocation, or 0 if the arena did not hand the address out.
+ */
+int findAllocation(ShimArena *arena, const char *address, char **start) {
+	Simulator *sim = arena->sim;
+	int id = 0;
+	if(sim->policy->paging) {
+		Extent *window = extentAtOrBefore(arena->windows, (long long)(uintptr_t)address);
+		if(window != NULL && (uintptr_t)address < (uintptr_t)window->start + sim->processTable[window->length].pageCount * shim.frameBytes) {
+			id = window->length;
+			*start = (char *)(uintptr_t)window->start;
+		}
+	} else if(address >= arena->base && address < arena->base + shim.arenaBytes) {
+		id = sim->memory->get(sim, (address - arena->base) >> shim.blockShift);
+		if(id != 0) {
+			*start = arena->base + (sim->processTable[id].extents[0].start << shim.blockShift);
+		}
+	}
+	return id;
+}
+
+/**
+ * Free an allocation, with the arena's lock held, and give its id back.
+ *
+ * @param id the allocation.
+ * @param start the address of its first block.
+ */
+void releaseShim(ShimArena *arena, int id, char *start) {
+	Simulator *sim = arena->sim;
+	Process *process = &sim->processTable[id];
+	arena->bytesInUse -= process->size << shim.blockShift;
+	arena->frees++;
+	if(sim->policy->paging) {
+		long long bytes = process->pageCount * shim.frameBytes;
+		long long page = 0;
+		while(bytes >= shim.trimBytes && page < process->pageCount) { // frames that follow each other go back at once
+			long long run = 1;
+			while(page + run < process->pageCount && process->pageTable[page + run] == process->pageTable[page] + run) {
+				run++;
+			}
+			fallocate(arena->memoryFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, process->pageTable[page] * shim.frameBytes, run * shim.frameBytes);
+			page += run;
+		}
+		munmap(start, bytes);
+		removeByAddress(sim, &arena->windows, extentAtOrBefore(arena->windows, (long long)(uintptr_t)start));
+		releaseProcess(sim, id);
+	} else {
+		long long first = process->extents[0].start;
+		long long length = process->size;
+		arena->cacheClass[first] = 0;
+		releaseProcess(sim, id);
+		trimArena(arena, first, length);
+	}
+	if(arena->spareIdCount == arena->spareIdCapacity) {
+		arena->spareIdCapacity = arena->spareIdCapacity == 0 ? 1024 : arena->spareIdCapacity * 2;
+		arena->spareIds = realloc(arena->spareIds, arena->spareIdCapacity * sizeof(int));
+		if(arena->spareIds == NULL) {
+			fprintf(stderr, "ERROR! Out of memory for the ids of the malloc shim\n");
+			exit(1); // Exit with error
+		}
+	}
+	arena->spareIds[arena->spareIdCount++] = id;
+}
+
+/**
+ * Free the allocation an address lies in, with the arena's lock held.
+ */
+void releaseAddress(ShimArena *arena, void *address) {
+	char *start;
+	int id = findAllocation(arena, address, &start);
+	if(id != 0) {
+		releaseShim(arena, id, start);
+	}
+}
+
+/**
+ * Take an arena's lock, and free what other threads left on its remote-free stack.
+ */
+void enterArena(ShimArena *arena) {
+	pthread_mutex_lock(&arena->lock);
+	void *address = __atomic_exchange_n(&arena->remoteFrees, NULL, __ATOMIC_ACQUIRE);
+	while(address != NULL) {
+		void *next = *(void **)address;
+		releaseAddress(arena, address);
+		arena->remoteFreed++;
+		address = next;
+	}
+}
+
+/**
+ * Let go of an arena's lock, counting the call for telemetry if it changed memory.
+ */
+void leaveArena(ShimArena *arena, bool step) {
+	if(step) {
+		telemetryStep(arena->sim);
 	}
-
+	pthread_mutex_unlock(&arena->lock);
+}
 
 /**
- * next-fit allocation according to specification above.
+ * Find the arena an address belongs to, from the calling thread, which must be inside the shim.
  *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
- * @return true if allocation succeeds, false if it fails.
+ * @return the arena, or NULL if no arena handed the address out.
  */
-bool nextFit(int id, int size) {
-	// variables to store the starting index and the size of the contiguous empty blocks
-    int start = -1;
-    int count = 0;
-	// set the current iteration to the last checked value
-    int i = lastAllocationPoint;
-	// this flag is used to check if we have gone through the memory completely
-	// if this is true, we know that we have failed next fit
-    bool wrappedAround = false; 
-
-	if(vacantSpace() > size) {
-		if(lastAllocationPoint + vacantSpace() > MEM_SIZE){
-			lastAllocationPoint = 0;
-		}
-		// iterate through the memory array starting from lastChecked
-		while (i < MEM_SIZE) {
-			// if the memory at the current index is empty
-			if (memory[i] == 0) {
-				// if start has not yet been set, set it to the current index
-				if (start == -1) {
-					start = i;
-				}
-				// increment count for each empty memory location
-				count++;
-				// if count equals the size of the process, we have enough space to insert the process
-				if (count == size) {
-					// fill the memory with the process
-					fillMemory(start, id, size);
-					// update lastChecked to the next position in memory
-					lastAllocationPoint = (i + 1) % MEM_SIZE;
-					return true;
-				}
-			} else {
-				// if the current contiguous region does not have enough space, reset start and count
-				start = -1;
-				count = 0;
+ShimArena *ownerArena(void *address) {
+	int k;
+	if(shim.space != NULL) { // the arenas lie one after another
+		uintptr_t offset = (uintptr_t)address - (uintptr_t)shim.space;
+		if(offset >= (uintptr_t)shim.arenaBytes * shim.arenaCount) {
+			return NULL;
+		}
+		return shim.arenas[offset / shim.arenaBytes];
+	}
+	for(k = 0; k < shim.arenaCount; k++) { // windows can be anywhere, so ask each arena
+		ShimArena *arena = shim.arenas[k];
+		char *start;
+		if(arena != NULL) {
+			pthread_mutex_lock(&arena->lock);
+			int id = findAllocation(arena, address, &start);
+			pthread_mutex_unlock(&arena->lock);
+			if(id != 0) {
+				return arena;
 			}
+		}
+	}
+	return NULL;
+}
 
-			// move to the next block of memory and wrap around if needed
-			i++;
-		} 
-	} else {
-		return false;
+/**
+ * Give every allocation in the calling thread's cache back to its arena, when the thread ends.
+ */
+void flushCache(void *unused) {
+	insideShim = true;
+	ShimArena *arena = shim.arenas[threadCache.arena - 1];
+	enterArena(arena);
+	int blocks;
+	for(blocks = 1; blocks <= CACHE_CLASSES; blocks++) {
+		while(threadCache.lists[blocks] != NULL) {
+			void *address = threadCache.lists[blocks];
+			threadCache.lists[blocks] = *(void **)address;
+			releaseAddress(arena, address);
+		}
+		threadCache.counts[blocks] = 0;
 	}
+	leaveArena(arena, false);
+	threadCache.registered = false;
+	insideShim = false;
 }
 
 /**
- * best-fit allocation according to specification above.
+ * Resize an allocation, with the arena's lock held. The policy grows or
+ * shrinks it in place if it can, as reallocate does; the pages policy only
+ * does so while the number of pages stays the same, because its window cannot
+ * grow. Otherwise the allocation moves, within the same arena, and its
+ * contents are copied.
  *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
- * @return true if allocation succeeds, false if it fails.
+ * @param address the address malloc returned for the allocation.
+ * @param id the allocation.
+ * @param start the address of its first block.
+ * @param bytes bytes the allocation should have after address.
+ * @return the new address, or NULL if the allocation has to move and there is no room.
  */
-bool bestFit(int id, int size) {
-	// starting index and size of best fitting contiguous region
-	int bestStart = -1; 
-	int bestSize = MEM_SIZE + 1;
-	// starting index and size of the current process being accounted for in the loop
-	int start = -1; 
-	int count = 0; 
-	
-	// loops through the memory and takes into account size the the empty regions of contiguous memory
-	int i;
-	for(i = 0; i < MEM_SIZE; i++){
-		// if the current index of memory is empty
-		if(memory[i] == 0){
-			// we set the starting index to the current iteration index if we were not already counting contiguous spaces
-			if(start == -1) {
-				start = i; 
-			}
-			// increment the count while there are empty contiguous spaces
-			count++;
-		}
-		// if we enounter a process at the next iteration in memory, reset the contiguous block counter to 0 and the starting index to -1 
-		// to indicate that we have come accross allocated memory
-		else {
-			// if the count is large enough to hold the process
-			if(count >= size) {
-				// if the current count is less then the best size, the current count is a better fit for the process
-				// so we update the best start and best size to the current start and size of ideal contiguous region 
-				if(count < bestSize) {
-					bestStart = start;
-					bestSize = count;
-				}
+void *reallocateShim(ShimArena *arena, char *address, int id, char *start, size_t bytes) {
+	Simulator *sim = arena->sim;
+	Process *process = &sim->processTable[id];
+	long long offset = address - start;
+	long long old = process->size;
+	if(bytes > (size_t)shim.arenaBytes) {
+		arena->failures++;
+		return NULL;
+	}
+	long long blocks = (offset + bytes + ((1LL << shim.blockShift) - 1)) >> shim.blockShift;
+	sim->reallocations++;
+	if(blocks == old) {
+		return address;
+	}
+	bool samePages = !sim->policy->paging || (blocks + sim->frameSize - 1) / sim->frameSize == process->pageCount;
+	if(samePages && sim->policy->resize(sim, id, blocks)) {
+		arena->bytesInUse += (blocks - old) << shim.blockShift;
+		if(arena->bytesInUse > arena->peakBytesInUse) {
+			arena->peakBytesInUse = arena->bytesInUse;
+		}
+		if(!sim->policy->paging) {
+			long long first = process->extents[0].start;
+			arena->cacheClass[first] = offset == 0 && blocks <= CACHE_CLASSES ? blocks : 0;
+			if(blocks < old) {
+				trimArena(arena, first + blocks, old - blocks);
 			}
-			start = -1;
-			count = 0;
 		}
+		return address;
 	}
-	// if the count is large enough to hold the process
-	if(count >= size) {
-		// if the current count is less then the best size, the current count is a better fit for the process
-		// so we update the best start and best size to the current start and size of ideal contiguous region 
-		if(count < bestSize) {
-			bestStart = start;
-			bestSize = count;
-		}
+	char *moved = allocateShim(arena, bytes, (size_t)1 << shim.blockShift); // may move the process table
+	if(moved == NULL) {
+		return NULL;
 	}
-	// if best start has an index
-	if(bestStart != -1){
-		fillMemory(bestStart, id, size);
-		return true;
+	long long copied = (old << shim.blockShift) - offset;
+	if(copied > (long long)bytes) {
+		copied = bytes;
 	}
-	// if the code reaches this point, best fit has failed
-	return false;
+	memcpy(moved, address, copied);
+	sim->reallocationsMoved++;
+	sim->blocksCopied += old;
+	releaseShim(arena, id, start);
+	return moved;
 }
 
 /**
- * worst-fit allocation according to specification above.
+ * Place a new allocation for malloc or one of its relatives, from the
+ * calling thread's cache if it holds one of the right size.
  *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
- * @return true if allocation succeeds, false if it fails.
+ * @param size bytes asked for.
+ * @param alignment power of two the address must be a multiple of; malloc's own alignment is that of a block.
+ * @return the address, or NULL with errno set.
  */
-bool worstFit(int id, int size) { 
-	// stores the starting index and size of the worst fit contiguous region
-	int worstStart = -1; 
-	int worstSize = -1; 
-	// stores the starting index and count of contiguous empty blocks
-	int start = -1; 
-	int count = 0; 
-
-	// loops through the memory and takes into size the the empty regions of contiguous memory
-	int i;
-	int vacant = vacantSpace();
-	if(vacant >= size){
-		for(i = 0; i < MEM_SIZE; i++){
-			// if the memory location at the current iteration is empty
-			if(memory[i] == 0){
-				// if the start has not been set, set it at the first empty spot in memory
-				if(start == -1) {
-					start = i; 
-				}
-				// increment the count of contiguous blocks while the memory location at the current iteration is empty
-				count++;
-			}
-			else {
-				// if the count fits the size of the policy
-				if(count >= size) {
-					// if the current count is greater then the worst size, the current count is a worse fit for the process
-					// so we update the worst start and worst size to the current start and size of ideal contiguous region  
-					if(count > worstSize) {
-						worstStart = start;
-						worstSize = count;
-					}
-				}
-				// reset the start and count if we find a memory location with a process being stored
-				start = -1;
-				count = 0;
-			}
+void *newAllocation(size_t size, size_t alignment) {
+	insideShim = true;
+	ShimArena *arena = threadArena();
+	size_t blockBytes = (size_t)1 << shim.blockShift;
+	void *address = NULL;
+	if(alignment <= blockBytes && size <= (size_t)CACHE_CLASSES << shim.blockShift) {
+		int blocks = size == 0 ? 1 : (size + blockBytes - 1) >> shim.blockShift;
+		if(threadCache.counts[blocks] > 0) {
+			address = threadCache.lists[blocks];
+			threadCache.lists[blocks] = *(void **)address;
+			threadCache.counts[blocks]--;
 		}
 	}
-	// if the count fits the size of the policy
-	if(count >= size) {
-		// if the current count is greater then the worst size, the current count is a worse fit for the process
-		// so we update the worst start and worst size to the current start and size of ideal contiguous region  
-		if(count > worstSize) {
-			worstStart = start;
-			worstSize = count;
-			}
-		}	
-
-	// if we found an index for worst start, fill the memory starting at this index
-	if(worstStart != -1){
-		fillMemory(worstStart, id, size);
-		return true;
+	if(address == NULL) {
+		enterArena(arena);
+		address = allocateShim(arena, size, alignment > blockBytes ? alignment : blockBytes);
+		arena->mallocs++;
+		leaveArena(arena, address != NULL);
 	}
-
-	// if we did not find a location to insert the process, we return false as worst fit failed
-	return false;
-} 
+	insideShim = false;
+	if(address == NULL) {
+		errno = ENOMEM;
+	}
+	return address;
+}
 
 /**
- * Implements simple paging memory allocation.
- * The pages policy is special in that it may allocate
- * non-contiguous regions of memory to the process id.
- * However, a full frame must be reserved for each chunk
- * of allocation, even if it is not used by the process.
+ * Allocate with an alignment larger than malloc's, for the aligned relatives of malloc.
  *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
- * @return true if allocation succeeds, false if it fails.
+ * @return the address, or NULL with errno set.
  */
-bool pages(int id, int size) {
-    int requiredFrames = size / FRAME_SIZE; // Calculate number of frames required
-    int remainingBlocks = size % FRAME_SIZE; // Calculate the number of remaining blocks after required frames
-    
-    // Iterate through memory to find available frames
-    int framesToAllocate = requiredFrames; // Tracks the number of frames still needed
-    int i = 0; // Index for iterating through memory
+void *alignedShim(size_t alignment, size_t size) {
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if(insideShim) {
+		return __libc_memalign(alignment, size);
+	}
+	return newAllocation(size, alignment);
+}
 
-	// counts the number of current allocated blocks of memory
-	int free = 0;
-	// loops through the memory blocks
-	for(i = 0; i < MEM_SIZE; i++){
-		// if the memory at the current iteration index is filled, swap the value stored at the current counter of allocated blocks 
-		// with current iteration index with the loop
-		// this moves the allocated blocks to the front of memory
-		if(memory[i] == 0){
-			free++;
-		}
-	}  
-
-	i = 0;
-	if(free >= size){
-		while (framesToAllocate > 0 && i < MEM_SIZE) {
-			if (memory[i] == 0) { // Found a free frame 
-				// Check if the current index is not at the beginning of a frame
-				if (i % FRAME_SIZE != 0) {
-					// Move to the beginning of the next frame
-					i += FRAME_SIZE - (i % FRAME_SIZE);
-				}
-				
-				int availableBlocks = 1; // Tracks the number of consecutive free blocks
-				int j = i + 1; // Index for checking consecutive blocks
-				
-				// Count consecutive free blocks
-				while (j < MEM_SIZE && memory[j] == 0 && availableBlocks < FRAME_SIZE) {
-					availableBlocks++;
-					j++;
-				}
-				
-				if (availableBlocks == FRAME_SIZE) {
-					// Allocate a frame to the process
-					fillMemory(i, id, FRAME_SIZE);
-					framesToAllocate--; 
-					i = j; // Move to the next available index after the allocated frame  
+SHIM_EXPORT void *malloc(size_t size) {
+	if(insideShim) {
+		return __libc_malloc(size);
+	}
+	return newAllocation(size, 1);
+}
 
-				} else {
-					i++; // Move to the next index if contiguous empty slots are not enough
-				}
-			} else { // Move to the next index if current index is not empty
-				i++;
-			}
+SHIM_EXPORT void free(void *pointer) {
+	if(pointer == NULL) {
+		return;
+	}
+	if(insideShim) {
+		__libc_free(pointer);
+		return;
+	}
+	insideShim = true;
+	ShimArena *own = threadArena();
+	ShimArena *arena = ownerArena(pointer);
+	int blocks = arena != NULL && arena->cacheClass != NULL ? arena->cacheClass[((char *)pointer - arena->base) >> shim.blockShift] : 0;
+	if(arena == NULL) { // glibc handed it out while its thread was inside the shim
+		__libc_free(pointer);
+	} else if(arena == own && blocks != 0 && threadCache.counts[blocks] < CACHE_DEPTH) {
+		if(!threadCache.registered) { // so the cache is given back when the thread ends
+			pthread_setspecific(shim.cacheKey, &threadCache);
+			threadCache.registered = true;
 		}
+		*(void **)pointer = threadCache.lists[blocks];
+		threadCache.lists[blocks] = pointer;
+		threadCache.counts[blocks]++;
+	} else if(arena != own && arena->cacheClass != NULL) {
+		void *head = __atomic_load_n(&arena->remoteFrees, __ATOMIC_RELAXED);
+		do {
+			*(void **)pointer = head;
+		} while(!__atomic_compare_exchange_n(&arena->remoteFrees, &head, pointer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	} else {
+		enterArena(arena);
+		releaseAddress(arena, pointer);
+		leaveArena(arena, true);
+	}
+	insideShim = false;
+}
 
-		// Allocate remaining blocks in the next frame if needed
-		if (remainingBlocks > 0 && i < MEM_SIZE) {
-			fillMemory(i, id, remainingBlocks);   
-		}  
-		if(framesToAllocate == 0) {
-			return true;
-		}
+SHIM_EXPORT void *calloc(size_t count, size_t size) {
+	if(insideShim) {
+		return __libc_calloc(count, size);
 	}
-	 else {
-		return false;
-	} 
+	if(size != 0 && count > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	// not malloc, which the compiler would turn back into a call of calloc
+	void *address = newAllocation(count * size, 1);
+	if(address != NULL) { // freed blocks are handed out again as they are, so clear them
+		memset(address, 0, count * size);
+	}
+	return address;
+}
+
+SHIM_EXPORT void *realloc(void *pointer, size_t size) {
+	if(insideShim) {
+		return __libc_realloc(pointer, size);
+	}
+	if(pointer == NULL) {
+		return malloc(size);
+	}
+	if(size == 0) { // as glibc does
+		free(pointer);
+		return NULL;
+	}
+	insideShim = true;
+	threadArena();
+	ShimArena *arena = ownerArena(pointer);
+	void *address = NULL;
+	if(arena != NULL) {
+		enterArena(arena);
+		char *start;
+		int id = findAllocation(arena, pointer, &start);
+		address = reallocateShim(arena, pointer, id, start, size);
+		arena->reallocs++;
+		leaveArena(arena, true);
+	}
+	insideShim = false;
+	if(arena == NULL) {
+		return __libc_realloc(pointer, size);
+	}
+	if(address == NULL) {
+		errno = ENOMEM;
+	}
+	return address;
+}
+
+SHIM_EXPORT int posix_memalign(void **pointer, size_t alignment, size_t size) {
+	if(alignment < sizeof(void *)) {
+		return EINVAL;
+	}
+	int saved = errno;
+	void *address = alignedShim(alignment, size);
+	if(address == NULL) {
+		int error = errno;
+		errno = saved;
+		return error;
+	}
+	*pointer = address;
+	return 0;
 }
 
+SHIM_EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+	return alignedShim(alignment, size);
+}
 
+SHIM_EXPORT void *memalign(size_t alignment, size_t size) {
+	return alignedShim(alignment, size);
+}
 
+SHIM_EXPORT void *valloc(size_t size) {
+	return alignedShim(sysconf(_SC_PAGESIZE), size);
+}
 
+SHIM_EXPORT void *pvalloc(size_t size) {
+	size_t pageBytes = sysconf(_SC_PAGESIZE);
+	return alignedShim(pageBytes, (size + pageBytes - 1) & ~(pageBytes - 1));
+}
 
-// Track the number of compaction events
-int compactionEvents = 0;
+SHIM_EXPORT size_t malloc_usable_size(void *pointer) {
+	if(pointer == NULL || insideShim) {
+		return 0;
+	}
+	insideShim = true;
+	threadArena();
+	ShimArena *arena = ownerArena(pointer);
+	size_t usable = 0;
+	if(arena != NULL) {
+		enterArena(arena);
+		char *start;
+		int id = findAllocation(arena, pointer, &start);
+		usable = (arena->sim->processTable[id].size << shim.blockShift) - ((char *)pointer - start);
+		leaveArena(arena, false);
+	}
+	insideShim = false;
+	return usable;
+}
 
 /**
- * Compact memory: This function should never be used in
- * conjunction with the paging policy, but all of the others
- * need it.
+ * Print the counters of each arena at exit if MEMALLOC_STATS is set, and
+ * write out what is left of the telemetry. The simulations are not
+ * destroyed, since destructors that run later may still free memory.
  */
-void compaction() { 
-	// counts the number of current allocated blocks of memory
-	int count = 0;
-	// loops through the memory blocks
-	int i;
-	for(i = 0; i < MEM_SIZE; i++){
-		// if the memory at the current iteration index is filled, swap the value stored at the current counter of allocated blocks 
-		// with current iteration index with the loop
-		// this moves the allocated blocks to the front of memory
-		if(memory[i] != 0){
-			memory[count] = memory[i]; 
-			memory[i] = 0;
-			count++;
+__attribute__((destructor)) void stopShim() {
+	if(!shim.started || pthread_mutex_trylock(&shim.lock) != 0) { // never started, or ending on an error inside the shim
+		return;
+	}
+	bool inside = insideShim;
+	insideShim = true;
+	int k;
+	for(k = 0; k < shim.arenaCount; k++) {
+		ShimArena *arena = shim.arenas[k];
+		if(arena == NULL || pthread_mutex_trylock(&arena->lock) != 0) {
+			continue;
 		}
-	} 
-
-	printf("Memory Compacted");
-	compactionEvents++;
+		Simulator *sim = arena->sim;
+		if(sim->telemetry != NULL) {
+			if(sim->steps % sim->telemetryEvery != 0) { // the last sample shows how the program ended
+				writeTelemetrySample(sim);
+			}
+			fflush(sim->telemetry);
+		}
+		if(shim.stats) {
+			Extent *longest = largestExtent(sim);
+			fprintf(stderr, "memalloc %s arena %d: %lld mallocs, %lld frees (%lld remote), %lld reallocs (%lld moved), %lld failed\n",
+				sim->policy->name, k, arena->mallocs, arena->frees, arena->remoteFreed, arena->reallocs, sim->reallocationsMoved, arena->failures);
+			fprintf(stderr, "memalloc %s arena %d: %lld bytes in use at peak, %lld at exit, %lld bytes wasted, %lld free extents, the longest %lld bytes\n",
+				sim->policy->name, k, arena->peakBytesInUse, arena->bytesInUse, sim->wastedBlocks << shim.blockShift,
+				sim->freeExtentCount, longest != NULL ? longest->length << shim.blockShift : 0);
+		}
+		pthread_mutex_unlock(&arena->lock);
+	}
+	pthread_mutex_unlock(&shim.lock);
+	insideShim = inside;
 }
+#endif
 
+/**
+ * Write a checkpoint of a replay after its latest request, to NAME.N for request N.
+ *
+ * @return false if it cannot be written.
+ */
+bool checkpointReplay(Simulator *sim, const Trace *trace, const char *name, LogLevel level) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s.%lld", name, sim->steps);
+	flushLog(&sim->log); // everything logged so far goes out before the checkpoint is announced
+	if(level >= LOG_SUMMARY) {
+		printf("Writing checkpoint: %s\n", path);
+	}
+	if(!writeCheckpoint(sim, path, trace)) {
+		printf("Problem writing checkpoint %s\n", path);
+		return false;
+	}
+	return true;
+}
 
-// Used to track whether the paging policy was chosen, so compaction can be avoided
-bool paging = false;
+// Most events read from the trace for each round of a banked replay
+#define BANK_ROUND (1 << 16)
 
 /**
- * Allocate memory of appropriate size to the process with id using the
- * chosen policy. For paging, allocation should only fail if there are not
- * enough free frames, in which case the process occupying the most memory
- * should be vacated before trying again. 
- *
- * For policies that allocate in contiguous space,
- * failure to allocate should result first in a check on the number of
- * remaining free blocks in memory. If there is enough space to hold the
- * process, but the space is fragmented, then compaction should occur.
- * Otherwise, the policy occupying the most space in memory should be
- * vacated before repeating the attempt to allocate.
- *
- * @param id process id being placed into memory in the allocated slots.
- * @param size number of blocks in the process being allocated.
+ * A banked replay gives each process of the trace a home bank, its id modulo
+ * the number of banks, and a worker per bank replays the events of the
+ * processes homed there. The trace is replayed in rounds: the main thread
+ * deals up to BANK_ROUND events out to the workers, which then replay them on
+ * a pool of threads. Every event of a process goes to the same worker, so
+ * those keep their order. With more than one thread the banks a request
+ * spills over to, and so the final memory, depend on how the threads interleave.
  */
-void allocate(int id, int size) { 
+typedef struct BankWorker {
+	TraceEvent *events; // events of this round
+	long long count;
+	long long capacity;
+	int *bankOf; // 1 + the bank each process of the worker got its memory in, 0 for none
+	int bankOfCapacity;
+} BankWorker;
 
-	if(!paging) { 
-			while(!policy(id,size)){
-				// checks if the process was successfully allocated
-				// counts the number of current allocated blocks of memory
-				int vacant = vacantSpace();
+typedef struct BankReplay {
+	MemoryBanks *banks;
+	BankWorker *workers; // one per bank
+} BankReplay;
 
-				if(size <= vacant){
-					// if we have space to allocate the process, perform compaction
-					compaction();
-					lastAllocationPoint = 0;
-					policy(id,size);
-					break; 
-				}
-				else {
-					// create variables to keep track of the largest process id and how many spots in memory it takes up
-					int largestProcessId = -1;
-					int largestSize = -1;
-					// creates variables to keep track of the id and size of the current process being counted 
-					int currentProcessId = -1;
-					int currentSize = 0;
-					// loops through the memory and counts the size of the largest process 
-					for (int i = 0; i < MEM_SIZE; i++) { 
-						// when we encounter a region which is not contiguous with the last
-						if (memory[i] != currentProcessId) {
-							// set the largest size if it is greater than the current largest size
-							if (currentSize > largestSize) {
-								largestSize = currentSize;
-								largestProcessId = currentProcessId;
-							}
-							// set the current process id and size 
-							currentProcessId = memory[i];
-							currentSize = 1;
-						} else {
-							currentSize++;
-						}
-					} 
-					if (currentSize > largestSize) {
-						largestSize = currentSize;
-						largestProcessId = currentProcessId;
-					}
-					if (largestProcessId != -1) {
-						// vacate largest process if the one has been found
-						vacateProcess(largestProcessId);
-					}
-				} 
+void bankJob(void *context, int index) {
+	BankReplay *replay = context;
+	BankWorker *worker = &replay->workers[index];
+	long long e;
+	for(e = 0; e < worker->count; e++) {
+		const TraceEvent *event = &worker->events[e];
+		int id = event->id;
+		if(id >= worker->bankOfCapacity) {
+			int capacity = id < INT_MAX / 2 ? 2 * id : INT_MAX;
+			int *bankOf = realloc(worker->bankOf, capacity * sizeof(int));
+			if(bankOf == NULL) {
+				printf("ERROR! Out of memory for the processes of bank %d\n", index);
+				exit(1); // Exit with error
 			}
+			memset(bankOf + worker->bankOfCapacity, 0, (capacity - worker->bankOfCapacity) * sizeof(int));
+			worker->bankOf = bankOf;
+			worker->bankOfCapacity = capacity;
 		}
-		else {
+		int bank = worker->bankOf[id] - 1;
+		switch(event->type) {
+		case TRACE_ALLOC:
+			worker->bankOf[id] = banksAllocate(replay->banks, index, id, event->size) + 1;
+			break;
+		case TRACE_REALLOC:
+			if(bank == -1) { // like realloc of a null pointer
+				worker->bankOf[id] = banksAllocate(replay->banks, index, id, event->size) + 1;
+			} else {
+				banksReallocate(replay->banks, bank, id, event->size);
+			}
+			break;
+		case TRACE_FREE:
+			banksFree(replay->banks, bank, id);
+			worker->bankOf[id] = 0;
+			break;
+		}
+	}
+	worker->count = 0;
+}
 
-			while(!policy(id, size)) {
-				// create variables to keep track of the largest process id and how many spots in memory it takes up
-				int largestProcessId = -1;
-				int largestSize = -1;
-				// creates variables to keep track of the id and size of the current process being counted 
-				int currentProcessId = -1;
-				int currentSize = 0;
-				// keeps track of the size of the current process which we are counting
-				int occurrences = 0; 
-
-				for (int i = 0; i < MEM_SIZE; i++) {
-					if (memory[i] != 0) {
-					// if the size of the current process exceeds the largest process size, set largest process to the current process
-						if (occurrences > largestSize) {
-							largestSize = occurrences;
-							largestProcessId = currentProcessId;
-						}
-					// set the current proces id to the process found
-					currentProcessId = memory[i];
-					
-					// initialize the counter for the size of the current process
-					occurrences = 1; 
-					
-					// Nested loop to count occurrences of currentProcessId
-					for (int j = i + 1; j < MEM_SIZE; j++) {
-						if (memory[j] == currentProcessId) {
-							occurrences++;
-						}
-						}
-					}
-				}
-				// if the last process exceeds the size of the largest process
-				if (occurrences > largestSize) {
-					largestSize = occurrences;
-					largestProcessId = currentProcessId;
+/**
+ * Replay a trace on banks, as described above.
+ *
+ * @param threads number of workers that replay at once.
+ * @return what nextEvent returned last: 0 at the end of the trace, -1 if it is malformed.
+ */
+int replayBanks(MemoryBanks *banks, Trace *input, int threads) {
+	BankReplay replay = {banks, calloc(banks->count, sizeof(BankWorker))};
+	if(replay.workers == NULL) {
+		printf("ERROR! Out of memory for the workers of the banks\n");
+		exit(1); // Exit with error
+	}
+	ThreadPool pool = {banks->count, bankJob, &replay};
+	TraceEvent event;
+	int status;
+	do {
+		long long round = 0;
+		// a streamed trace ends the round early rather than wait for more of it
+		while(round < BANK_ROUND && (input->fd < 0 || round == 0 || holdsEvent(input)) && (status = nextEvent(input, &event)) == 1) {
+			BankWorker *worker = &replay.workers[event.id % banks->count];
+			if(worker->count == worker->capacity) {
+				worker->capacity = worker->capacity > 0 ? 2 * worker->capacity : 1024;
+				worker->events = realloc(worker->events, worker->capacity * sizeof(TraceEvent));
+				if(worker->events == NULL) {
+					printf("ERROR! Out of memory for the events of bank %lld\n", (long long)(worker - replay.workers));
+					exit(1); // Exit with error
 				}
+			}
+			worker->events[worker->count++] = event;
+			round++;
+		}
+		runPool(&pool, threads);
+		int k;
+		for(k = 0; k < banks->count; k++) { // the events of each bank go out together
+			flushSimulator(banks->banks[k]->sim);
+		}
+	} while(status == 1);
+	int k;
+	for(k = 0; k < banks->count; k++) {
+		free(replay.workers[k].events);
+		free(replay.workers[k].bankOf);
+	}
+	free(replay.workers);
+	return status;
+}
 
-				if (largestProcessId != -1) {
-					// vacate largest process if one has been found
-					vacateProcess(largestProcessId);
-				}
+/**
+ * Replay a trace on memory split into banks, print the counters of every
+ * bank and write the final memory of all of them to one file, for main.
+ *
+ * @param config settings of all of memory; each bank gets an equal share of it.
+ * @return Success returns 0, failure returns 1.
+ */
+int runBanks(const char *inputName, const char *outputName, const SimulatorConfig *config, int count, BankPlacement placement, int threads,
+		const char *telemetryName, bool telemetryJson, long long telemetryEvery, bool imageRuns) {
+	SimulatorConfig bankConfig = *config;
+	bankConfig.memorySize = config->memorySize / count;
+	if(config->memorySize % count != 0) {
+		printf("The memory size must be a multiple of the number of banks\n");
+		return 1; // Error
+	}
+	if(config->logLevel >= LOG_SUMMARY) {
+		printf("%s\n", findPolicy(config->policy)->description);
+		printf("Reading from file: %s\n", inputName);
+	}
+	Trace input;
+	if(!openTrace(inputName, &input)) { // Failed to read file
+		printf("Problem reading file %s\n", inputName);
+		return 1; // Error
+	}
+	MemoryBanks *banks = banksCreate(&bankConfig, count, placement);
+	if(banks == NULL) {
+		printf("Problem creating %d banks of %lld blocks\n", count, bankConfig.memorySize);
+		closeTrace(&input);
+		return 1; // Error
+	}
+	if(telemetryName != NULL && !banksTelemetry(banks, telemetryName, telemetryJson, telemetryEvery)) {
+		printf("Problem writing telemetry %s\n", telemetryName);
+		closeTrace(&input);
+		banksDestroy(banks);
+		return 1; // Error
+	}
+	int status = replayBanks(banks, &input, threads);
+	if(status < 0) { // stop rather than simulate part of a trace as if it were all of it
+		reportMalformed(&input);
+		closeTrace(&input);
+		banksDestroy(banks);
+		return 1; // Error
+	}
+	closeTrace(&input); // Close the file
+
+	if(config->logLevel >= LOG_SUMMARY) {
+		BankStats total = {{0}};
+		BankStats stats;
+		int k;
+		for(k = 0; k < count; k++) {
+			banksStats(banks, k, &stats);
+			total.sim.processesVacated += stats.sim.processesVacated;
+			total.sim.compactionEvents += stats.sim.compactionEvents;
+			total.sim.blocksMoved += stats.sim.blocksMoved;
+			total.sim.wastedBlocks += stats.sim.wastedBlocks;
+			total.spilledOut += stats.spilledOut;
+		}
+		printf("%d processes vacated\n", total.sim.processesVacated);
+		printf("%d compaction events\n", total.sim.compactionEvents);
+		if(banks->banks[0]->sim->policy->compacts) {
+			printf("%lld blocks moved by compaction\n", total.sim.blocksMoved);
+		}
+		if(banks->banks[0]->sim->policy->release != NULL) {
+			printf("%lld blocks wasted by rounding\n", total.sim.wastedBlocks);
+		}
+		if(banks->banks[0]->sim->policy->place == autoPlace) {
+			long long switches = 0;
+			for(k = 0; k < count; k++) {
+				switches += banks->banks[k]->sim->autoSwitches;
 			}
+			printf("%lld switches between the fits\n", switches);
+		}
+		printf("%lld requests spilled over to another bank\n", total.spilledOut);
+		for(k = 0; k < count; k++) {
+			banksStats(banks, k, &stats);
+			printf("Bank %d: %.1f%% used, %lld requests, %lld spilled in, %lld spilled out, %d vacated, %d compactions\n", k,
+				100.0 - 100.0 * stats.sim.freeBlocks / stats.sim.memorySize, stats.requests, stats.spilledIn, stats.spilledOut,
+				stats.sim.processesVacated, stats.sim.compactionEvents);
+			printf("Bank %d: %lld lock acquisitions, %lld of them waited (%.2f%%), %.3f ms waiting\n", k,
+				stats.lockAcquisitions, stats.lockContended, stats.lockAcquisitions > 0 ? 100.0 * stats.lockContended / stats.lockAcquisitions : 0.0,
+				stats.lockWaitNanos / 1e6);
 		}
+
+		// Output the state of memory at the end of the simulation
+		printf("Writing to file: %s\n", outputName);
+	}
+	if(!writeBanksImage(banks, outputName, imageRuns)) {
+		printf("Problem writing file %s\n", outputName);
+		banksDestroy(banks);
+		return 1; // Error
+	}
+	banksDestroy(banks);
+	return 0;
 }
 
 /**
@@ -578,73 +8015,389 @@ void allocate(int id, int size) {
  * @param argv elements of this array are string representations of each command line parameter.
  * @return Success returns 0, crash/failure returns -1.
  */
+#ifndef MEMORY_ALLOCATION_LIBRARY
 int main(int argc, char *argv[]) {
-	// Proper usage consists of 4 arguments:
+	// Proper usage consists of at least 4 arguments:
 	// 0: C file: name of program being run
-	// 1: input fiename: file with sequence of memory requests (one int per line)
+	// 1: input fiename: file with sequence of memory requests (one int per line, alloc/free/realloc events, or a binary trace), or - for standard input
 	// 2: output filename: file that final memory contents will be (over)written to
-	// 3: memory allocation policy: ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging 
-	if(argc != 4) {
-		printf("Incorrect arguments. Expected:\n");
-		printf(" 0: C file: name of program being run\n");
-		printf(" 1: input fiename: file with sequence of memory requests (one int per line)\n");
-		printf(" 2: output filename: file that final memory contents will be (over)written to\n");
-		printf(" 3: memory allocation policy: ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging\n");
-		return 1; // Error
-	}
-
-	// Check for valid memory allocation policy, using strcmp, then assign policy variable
-	if(strcmp(argv[3], "ff") == 0) { 
-		printf("first-fit allocation\n");
-		policy = &firstFit;
-	} else if(strcmp(argv[3], "nf") == 0) { 
-		printf("next-fit allocation\n");
-		policy = &nextFit;
-	} else if(strcmp(argv[3], "bf") == 0) { 
-		printf("best-fit allocation\n");
-		policy = &bestFit;
-	} else if(strcmp(argv[3], "wf") == 0) { 
-		printf("worst-fit allocation\n");
-		policy = &worstFit;
-	} else if(strcmp(argv[3], "pages") == 0) { 
-		printf("simple paging\n");
-		policy = &pages;
-		paging = true; // indicates that compaction should not occur
-	} else {
+	// 3: memory allocation policy: ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits
+	// 4 and later: options that change the size and layout of memory, and how much is printed
+	// A binary event log can also be decoded on its own with --decode=FILE,
+	// and a request trace converted to a binary trace with --convert=TEXT BINARY,
+	// and many configurations compared on one trace with --sweep=FILE,
+	// and many traces replayed with --batch=DIR|MANIFEST,
+	// and the policies timed on generated workloads with --bench,
+	// and malloc timed on more and more threads with --stress;
+	// --banks=N splits memory into banks replayed on threads of their own
+	if(argc == 2 && strncmp(argv[1], "--decode=", 9) == 0) {
+		return decodeEventLog(argv[1] + 9);
+	}
+	if(argc == 3 && strncmp(argv[1], "--convert=", 10) == 0) {
+		return convertTrace(argv[1] + 10, argv[2]);
+	}
+	if(argc >= 2 && strncmp(argv[1], "--sweep=", 8) == 0) {
+		return sweepTrace(argc, argv);
+	}
+	if(argc >= 2 && strncmp(argv[1], "--batch=", 8) == 0) {
+		return batchTraces(argc, argv);
+	}
+	if(argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+		return benchPolicies(argc, argv);
+	}
+	if(argc >= 2 && strcmp(argv[1], "--stress") == 0) {
+		return stressMalloc(argc, argv);
+	}
+	if(argc < 4) {
+		printUsage();
+		return 1; // Error
+	}
+	SimulatorConfig config;
+	simulatorDefaults(&config);
+	config.logLevel = LOG_FULL; // the command line prints every event unless --log says otherwise
+	const char *accessName = NULL; // access trace for the translation model, if any
+	const char *telemetryName = NULL; // telemetry samples, if any
+	long long telemetryEvery = 1;
+	const char *deltasName = NULL; // change records of memory, if any
+	bool imageRuns = false; // the output file has a line per run rather than per block
+	const char *checkpointName = NULL; // checkpoints are written to checkpointName.N, if set
+	long long *checkpointAt = NULL; // requests after which they are written, in increasing order
+	int checkpointCount = 0;
+	const char *restoreName = NULL; // checkpoint to start from, if any
+	int bankCount = 0; // banks memory is split into, 0 for one memory without banks
+	BankPlacement placement = BANK_HOME; // which bank a new process tries first
+	int bankThreads = processorCount(); // banks replayed at once
+	bool telemetryJson = false;
+	long long value;
+	int arg;
+	for(arg = 4; arg < argc; arg++) {
+		if(strncmp(argv[arg], "--memory=", 9) == 0) {
+			if(!parseCount(argv[arg] + 9, &config.memorySize)) {
+				printf("Invalid memory size %s\n", argv[arg] + 9);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--frame=", 8) == 0) {
+			if(!parseCount(argv[arg] + 8, &config.frameSize)) {
+				printf("Invalid frame size %s\n", argv[arg] + 8);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--engine=", 9) == 0) {
+			config.engine = argv[arg] + 9;
+			if(findEngine(config.engine) == NULL) {
+				printf("Invalid engine %s\n", argv[arg] + 9);
+				printf(" extent=free-extent index, bitmap=occupancy bitmap\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--compaction=", 13) == 0) {
+			config.compaction = argv[arg] + 13;
+			if(findCompactor(config.compaction) == NULL) {
+				printf("Invalid compaction %s\n", argv[arg] + 13);
+				printf(" full=slide everything to the front, window=empty the cheapest window\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--eviction=", 11) == 0) {
+			config.eviction = argv[arg] + 11;
+			if(findEvictor(config.eviction) == NULL) {
+				printf("Invalid eviction %s\n", argv[arg] + 11);
+				printf(" largest=most blocks, fifo=resident longest, smallest=smallest that covers the shortfall, adjacent=next to the longest hole, plan=cheapest of adjacent and smallest\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--accesses=", 11) == 0) {
+			accessName = argv[arg] + 11;
+		} else if(strncmp(argv[arg], "--tlb=", 6) == 0) {
+			if(!parseCount(argv[arg] + 6, &config.tlbEntries)) {
+				printf("Invalid TLB size %s\n", argv[arg] + 6);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--tlb-ways=", 11) == 0) {
+			if(!parseCount(argv[arg] + 11, &value) || value > INT_MAX) {
+				printf("Invalid TLB associativity %s\n", argv[arg] + 11);
+				return 1; // Error
+			}
+			config.tlbWays = value;
+		} else if(strncmp(argv[arg], "--tlb-replacement=", 18) == 0) {
+			config.tlbReplacement = argv[arg] + 18;
+			if(strcmp(config.tlbReplacement, "lru") != 0 && strcmp(config.tlbReplacement, "random") != 0) {
+				printf("Invalid TLB replacement %s\n", argv[arg] + 18);
+				printf(" lru=least recently used, random=any entry of the set\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--page-levels=", 14) == 0) {
+			if(!parseCount(argv[arg] + 14, &value) || value > 8) {
+				printf("Invalid page-table levels %s\n", argv[arg] + 14);
+				return 1; // Error
+			}
+			config.pageTableLevels = value;
+		} else if(strncmp(argv[arg], "--page-bits=", 12) == 0) {
+			if(!parseCount(argv[arg] + 12, &value) || value > 30) {
+				printf("Invalid page-table bits %s\n", argv[arg] + 12);
+				return 1; // Error
+			}
+			config.pageTableBits = value;
+		} else if(strncmp(argv[arg], "--log=", 6) == 0) {
+			if(strcmp(argv[arg] + 6, "off") == 0) {
+				config.logLevel = LOG_OFF;
+			} else if(strcmp(argv[arg] + 6, "summary") == 0) {
+				config.logLevel = LOG_SUMMARY;
+			} else if(strcmp(argv[arg] + 6, "full") == 0) {
+				config.logLevel = LOG_FULL;
+			} else {
+				printf("Invalid log level %s\n", argv[arg] + 6);
+				printf(" off=errors only, summary=final counters, full=every event\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--event-log=", 12) == 0) {
+			config.eventLogName = argv[arg] + 12;
+		} else if(strncmp(argv[arg], "--deltas=", 9) == 0) {
+			deltasName = argv[arg] + 9;
+		} else if(strncmp(argv[arg], "--checkpoint=", 13) == 0) {
+			checkpointName = argv[arg] + 13;
+		} else if(strncmp(argv[arg], "--checkpoint-at=", 16) == 0) {
+			free(checkpointAt);
+			if(!parseCountList(argv[arg] + 16, &checkpointAt, &checkpointCount)) {
+				printf("Invalid checkpoint requests %s\n", argv[arg] + 16);
+				return 1; // Error
+			}
+			qsort(checkpointAt, checkpointCount, sizeof(long long), compareLongLongs);
+		} else if(strncmp(argv[arg], "--restore=", 10) == 0) {
+			restoreName = argv[arg] + 10;
+		} else if(strncmp(argv[arg], "--banks=", 8) == 0) {
+			if(!parseCount(argv[arg] + 8, &value) || value > INT_MAX) {
+				printf("Invalid number of banks %s\n", argv[arg] + 8);
+				return 1; // Error
+			}
+			bankCount = value;
+		} else if(strncmp(argv[arg], "--placement=", 12) == 0) {
+			if(strcmp(argv[arg] + 12, "home") == 0) {
+				placement = BANK_HOME;
+			} else if(strcmp(argv[arg] + 12, "round-robin") == 0) {
+				placement = BANK_ROUND_ROBIN;
+			} else if(strcmp(argv[arg] + 12, "least-loaded") == 0) {
+				placement = BANK_LEAST_LOADED;
+			} else {
+				printf("Invalid placement %s\n", argv[arg] + 12);
+				printf(" home=the bank of the process, round-robin=each bank in turn, least-loaded=the bank with the most free blocks\n");
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--bank-threads=", 15) == 0) {
+			if(!parseCount(argv[arg] + 15, &value) || value > INT_MAX) {
+				printf("Invalid number of bank threads %s\n", argv[arg] + 15);
+				return 1; // Error
+			}
+			bankThreads = value;
+		} else if(strncmp(argv[arg], "--image=", 8) == 0) {
+			if(strcmp(argv[arg] + 8, "blocks") != 0 && strcmp(argv[arg] + 8, "runs") != 0) {
+				printf("Invalid image format %s\n", argv[arg] + 8);
+				printf(" blocks=a process id per block, runs=START LENGTH ID per run\n");
+				return 1; // Error
+			}
+			imageRuns = strcmp(argv[arg] + 8, "runs") == 0;
+		} else if(strncmp(argv[arg], "--telemetry=", 12) == 0) {
+			telemetryName = argv[arg] + 12;
+		} else if(strncmp(argv[arg], "--telemetry-every=", 18) == 0) {
+			if(!parseCount(argv[arg] + 18, &telemetryEvery)) {
+				printf("Invalid telemetry interval %s\n", argv[arg] + 18);
+				return 1; // Error
+			}
+		} else if(strncmp(argv[arg], "--telemetry-format=", 19) == 0) {
+			if(strcmp(argv[arg] + 19, "csv") != 0 && strcmp(argv[arg] + 19, "json") != 0) {
+				printf("Invalid telemetry format %s\n", argv[arg] + 19);
+				printf(" csv=a header and one line per sample, json=one object per line\n");
+				return 1; // Error
+			}
+			telemetryJson = strcmp(argv[arg] + 19, "json") == 0;
+		} else if(strncmp(argv[arg], "--store=", 8) == 0) {
+			config.store = argv[arg] + 8;
+			if(findStore(config.store) == NULL) {
+				printf("Invalid store %s\n", argv[arg] + 8);
+				printf(" u16=16-bit cells, u32=32-bit cells, rle=run-length runs\n");
+				return 1; // Error
+			}
+		} else {
+			printUsage();
+			return 1; // Error
+		}
+	}
+
+	// Check for valid memory allocation policy
+	config.policy = argv[3];
+	const Policy *policy = findPolicy(config.policy);
+	if(policy == NULL) {
 		printf("Invalid memory allocation policy\n");
-		printf(" ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging\n");
+		printf(" ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits\n");
+		return 1; // Error
+	}
+	if(config.tlbEntries % config.tlbWays != 0) {
+		printf("The TLB size must be a multiple of its associativity\n");
+		return 1; // Error
+	}
+	// the translation model measures something when there is a TLB or an access trace
+	bool translating = config.tlbEntries > 0 || accessName != NULL;
+	if(translating && !policy->paging) {
+		printf("The translation model needs the pages policy\n");
 		return 1; // Error
 	}
+	if(accessName != NULL && (checkpointName != NULL || restoreName != NULL)) { // a checkpoint does not say where the access trace was
+		printf("Checkpoints cannot be used with an access trace\n");
+		return 1; // Error
+	}
+	if(bankCount > 0) {
+		if(translating || checkpointName != NULL || restoreName != NULL || deltasName != NULL || config.eventLogName != NULL) {
+			printf("Banks cannot be used with the translation model, checkpoints, deltas or an event log\n");
+			return 1; // Error
+		}
+		return runBanks(argv[1], argv[2], &config, bankCount, placement, bankThreads, telemetryName, telemetryJson, telemetryEvery, imageRuns);
+	}
 
-	printf("Reading from file: %s\n", argv[1]); // Second argument is input filename from user
-	FILE *input, *output;
-	input = fopen(argv[1], "r"); // Open file in read mode
-	if(input == NULL) { // Failed to read file
+	if(config.logLevel >= LOG_SUMMARY) {
+		printf("%s\n", policy->description);
+		printf("Reading from file: %s\n", argv[1]); // Second argument is input filename from user
+	}
+	Trace input;
+	if(!openTrace(argv[1], &input)) { // Failed to read file
 		printf("Problem reading file %s\n", argv[1]);
 		return 1; // Error
 	}
+	Simulator *sim = simulatorCreate(&config); // memory starts out clear
+	if(sim == NULL) {
+		printf("Problem writing event log %s\n", config.eventLogName);
+		return 1; // Error
+	}
+	if(telemetryName != NULL && !simulatorTelemetry(sim, telemetryName, telemetryJson, telemetryEvery)) {
+		printf("Problem writing telemetry %s\n", telemetryName);
+		closeTrace(&input);
+		simulatorDestroy(sim);
+		return 1; // Error
+	}
+	if(deltasName != NULL && !simulatorDeltas(sim, deltasName)) {
+		printf("Problem writing file %s\n", deltasName);
+		closeTrace(&input);
+		simulatorDestroy(sim);
+		return 1; // Error
+	}
+	input.flushing = sim; // whoever reads the output of a streamed trace sees every request that has arrived
+	if(restoreName != NULL) {
+		if(config.logLevel >= LOG_SUMMARY) {
+			printf("Restoring from checkpoint: %s\n", restoreName);
+		}
+		int restored = readCheckpoint(sim, restoreName, &input);
+		if(restored == 0) {
+			printf("Problem reading checkpoint %s\n", restoreName);
+		} else if(restored < 0) {
+			printf("Checkpoint %s is of another memory size, or of a policy %s cannot go on from\n", restoreName, policy->name);
+		}
+		if(restored != 1) {
+			closeTrace(&input);
+			simulatorDestroy(sim);
+			return 1; // Error
+		}
+	}
+	int nextCheckpoint = 0; // the first checkpoint still to be written
+	while(nextCheckpoint < checkpointCount && checkpointAt[nextCheckpoint] <= sim->steps) { // the restored requests are past these
+		nextCheckpoint++;
+	}
+
+	FILE *accesses = NULL;
+	if(accessName != NULL && (accesses = fopen(accessName, "r")) == NULL) {
+		printf("Problem reading file %s\n", accessName);
+		closeTrace(&input);
+		simulatorDestroy(sim);
+		return 1; // Error
+	}
+	int accessId; // next access of the access trace, if accessStatus is 1
+	long long accessOffset;
+	long long accessCount = 0;
+	int accessStatus = accesses != NULL ? nextAccess(accesses, &accessId, &accessOffset) : 0;
 
-	clearMemory(); // Clear memory before allocating it for processes
-	int requestID = 1; // Start IDs at 1 because 0 indicates empty memory
-	int requestSize; // Holds values read from file
-	while (fscanf(input, "%d", &requestSize) != EOF) { // Scan numbers into requestSize until end of file
-		printf("%d requested %d blocks\n", requestID, requestSize); // Announce the request
-		allocate(requestID, requestSize); // Claim space for "process"
-		requestID++; // For simplicity, each request is from a new "process"
+	TraceEvent event; // Holds the events read from file; process ids start at 1 because 0 indicates empty memory
+	int status;
+	while ((status = nextEvent(&input, &event)) == 1) { // Parse events until end of file
+		bool placed = replayEvent(sim, &event); // Claim or give back space for "process"
+		if(nextCheckpoint < checkpointCount && checkpointAt[nextCheckpoint] == sim->steps) {
+			nextCheckpoint++;
+			if(!checkpointReplay(sim, &input, checkpointName, config.logLevel)) {
+				closeTrace(&input);
+				simulatorDestroy(sim);
+				return 1; // Error
+			}
+		}
+		if(placed && translating && accesses == NULL) { // a process touches each of its pages when it gets memory
+			long long offset;
+			for(offset = 0; offset < event.size; offset += config.frameSize) {
+				simulatorAccess(sim, event.id, offset);
+			}
+		}
+		while(accessStatus == 1 && accessId <= input.lastId) { // the accesses that come before the next request
+			simulatorAccess(sim, accessId, accessOffset);
+			accessCount++;
+			accessStatus = nextAccess(accesses, &accessId, &accessOffset);
+		}
+	}
+	while(accessStatus == 1) { // accesses after the last request
+		simulatorAccess(sim, accessId, accessOffset);
+		accessCount++;
+		accessStatus = nextAccess(accesses, &accessId, &accessOffset);
+	}
+	flushLog(&sim->log); // everything logged so far goes out before the summary
+	if(status < 0 || accessStatus < 0) { // stop rather than simulate part of a trace as if it were all of it
+		if(status < 0) {
+			reportMalformed(&input);
+		} else {
+			printf("Malformed access %lld in %s: expected a process id and a block offset\n", accessCount + 1, accessName);
+		}
+		closeTrace(&input);
+		if(accesses != NULL) {
+			fclose(accesses);
+		}
+		simulatorDestroy(sim);
+		return 1; // Error
+	}
+	if(checkpointName != NULL && checkpointCount == 0 && !checkpointReplay(sim, &input, checkpointName, config.logLevel)) {
+		closeTrace(&input);
+		simulatorDestroy(sim);
+		return 1; // Error
+	}
+	free(checkpointAt);
+	closeTrace(&input); // Close the file
+	if(accesses != NULL) {
+		fclose(accesses);
 	}
-	fclose(input); // Close the file
 
-	printf("%d processes vacated\n", processesVacated);
-	printf("%d compaction events\n", compactionEvents);
+	if(config.logLevel >= LOG_SUMMARY) {
+		printf("%d processes vacated\n", sim->processesVacated);
+		printf("%d compaction events\n", sim->compactionEvents);
+		if(sim->policy->place == autoPlace) {
+			printf("%lld switches between the fits\n", sim->autoSwitches);
+		}
+		if(sim->policy->compacts) {
+			printf("%lld blocks moved by compaction\n", sim->blocksMoved);
+		}
+		if(sim->policy->release != NULL) { // policies with free lists of their own may round requests up
+			printf("%lld blocks wasted by rounding\n", sim->wastedBlocks);
+		}
+		if(translating) {
+			printf("%lld accesses, %lld TLB hits (%.2f%%), %lld page walks of %d levels\n", sim->accesses, sim->tlbHits,
+				sim->accesses > 0 ? 100.0 * sim->tlbHits / sim->accesses : 0.0, sim->pageWalks, sim->pageTableLevels);
+			printf("%lld accesses to blocks the process did not own\n", sim->faults);
+			printf("%lld bytes of page tables at the end, %lld at most\n", sim->pageTableBytes, sim->peakPageTableBytes);
+		}
+		if(input.lifetimes) { // fragmentation is only steady when processes come and go
+			SimulatorStats stats;
+			simulatorStats(sim, &stats);
+			printf("%lld reallocations, %lld of them moved, %lld blocks copied\n", stats.reallocations, stats.reallocationsMoved, stats.blocksCopied);
+			printf("%lld free blocks in %lld free extents, the longest %lld blocks\n", stats.freeBlocks, stats.freeExtents, stats.largestFreeExtent);
+		}
 
-	// Output the state of memory at the end of the simulation
-	printf("Writing to file: %s\n", argv[2]); // Third argument is output filename from user
-	output = fopen(argv[2], "w"); // Open file in write mode
-	int i;
-	for(i = 0; i < MEM_SIZE; i++) {
-		fprintf(output, "%d\n", memory[i]);
+		// Output the state of memory at the end of the simulation
+		printf("Writing to file: %s\n", argv[2]); // Third argument is output filename from user
+	}
+	if(!writeMemoryImage(sim, argv[2], imageRuns)) {
+		printf("Problem writing file %s\n", argv[2]);
+		simulatorDestroy(sim);
+		return 1; // Error
 	}
-	fclose(output); // Close the file
+	simulatorDestroy(sim);
 
 	return 0;
-}
\ No newline at end of file
+}
+#endif
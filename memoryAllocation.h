@@ -0,0 +1,120 @@
+#ifndef MEMORY_ALLOCATION_H
+#define MEMORY_ALLOCATION_H
+
+#include <stdbool.h> // For bool type
+
+/**
+ * Library interface to the memory allocation simulator. Every simulation is a
+ * Simulator of its own, so independent simulations can run side by side in one
+ * process, one thread per Simulator. To embed the simulator, compile
+ * memoryAllocation.c with -DMEMORY_ALLOCATION_LIBRARY, which leaves out main.
+ * With -DMEMORY_ALLOCATION_PRELOAD it instead becomes a malloc that places
+ * real allocations with the same policies, for LD_PRELOAD (see memoryAllocation.c).
+ * MemoryBanks splits memory into banks, each a Simulator behind its own lock,
+ * and unlike a Simulator it can be used by many threads at once.
+ */
+
+/**
+ * How much a simulation prints:
+ *   LOG_OFF      nothing but errors
+ *   LOG_SUMMARY  the policy, the file names and the final counters (command line only)
+ *   LOG_FULL     also every request, allocation, vacate and compaction
+ */
+typedef enum LogLevel { LOG_OFF, LOG_SUMMARY, LOG_FULL } LogLevel;
+
+// One simulation; its contents are private to memoryAllocation.c
+typedef struct Simulator Simulator;
+
+// Settings of a simulation, filled in with simulatorDefaults and then changed as needed
+typedef struct SimulatorConfig {
+	long long memorySize; // number of memory blocks
+	long long frameSize; // number of memory blocks in each frame/page
+	const char *policy; // ff=first-fit, bf=best-fit, nf=next-fit, wf=worst-fit, pages=paging, buddy=buddy system, tlsf=two-level segregated fit, auto=switching between the fits
+	const char *store; // u16, u32 or rle cells for memory
+	const char *engine; // extent or bitmap free-space search
+	const char *compaction; // full or window compaction
+	const char *eviction; // largest, fifo, smallest, adjacent or plan: which process is vacated
+	long long tlbEntries; // entries of the simulated TLB, 0 for none
+	int tlbWays; // entries in each set of the TLB; tlbEntries for fully associative, 1 for direct mapped
+	const char *tlbReplacement; // lru or random replacement within a set
+	int pageTableLevels; // levels of the page tables of each process
+	int pageTableBits; // bits of the page number each level of the page tables looks up
+	LogLevel logLevel; // events printed to stdout
+	const char *eventLogName; // file for binary event records instead of text, or NULL
+} SimulatorConfig;
+
+// Counters of a simulation
+typedef struct SimulatorStats {
+	long long memorySize; // number of memory blocks
+	long long freeBlocks; // number of blocks no process owns, or reserves like wastedBlocks
+	int residentProcesses; // number of processes that own memory
+	int processesVacated; // number of processes vacated to make room
+	long long blocksVacated; // number of blocks the vacated processes owned
+	int compactionEvents; // number of times memory was compacted
+	long long blocksMoved; // number of blocks compaction copied to another place
+	long long reallocations; // reallocations of processes that owned memory
+	long long reallocationsMoved; // of those, the ones that could not grow in place
+	long long blocksCopied; // number of blocks those moves copied
+	long long freeExtents; // number of runs of free blocks
+	long long largestFreeExtent; // blocks in the longest of them
+	long long holeSizes[64]; // holeSizes[k] runs of free blocks are 2^k to 2^(k+1) - 1 blocks long
+	long long wastedBlocks; // blocks handed out by rounding requests up that the processes do not use
+	long long accesses; // accesses translated with simulatorAccess
+	long long tlbHits; // of those, the ones the TLB translated
+	long long pageWalks; // of those, the ones that walked the page tables
+	long long faults; // accesses to blocks the process did not own
+	long long pageTableBytes; // size of the page tables of the resident processes (pages policy)
+	long long peakPageTableBytes; // largest that size has been
+	long long searchNanos; // time spent looking for free space, while telemetry is written
+	long long compactionNanos; // time spent compacting, while telemetry is written
+	long long evictionNanos; // time spent choosing and vacating processes, while telemetry is written
+} SimulatorStats;
+
+void simulatorDefaults(SimulatorConfig *config);
+Simulator *simulatorCreate(const SimulatorConfig *config);
+bool simulatorAllocate(Simulator *sim, int id, long long size);
+bool simulatorFree(Simulator *sim, int id);
+bool simulatorReallocate(Simulator *sim, int id, long long size);
+void simulatorStats(const Simulator *sim, SimulatorStats *stats);
+long long simulatorTranslate(const Simulator *sim, int id, long long offset);
+bool simulatorAccess(Simulator *sim, int id, long long offset);
+bool simulatorTelemetry(Simulator *sim, const char *name, bool json, long long every);
+bool simulatorDeltas(Simulator *sim, const char *name);
+bool simulatorSave(Simulator *sim, const char *name);
+bool simulatorRestore(Simulator *sim, const char *name);
+long long simulatorRun(Simulator *sim, long long block, int *id);
+void simulatorDestroy(Simulator *sim);
+
+// Memory of several banks; its contents are private to memoryAllocation.c
+typedef struct MemoryBanks MemoryBanks;
+
+/**
+ * Which bank a new process tries first; when that bank does not have the
+ * blocks free, the process spills over to the next bank that does:
+ *   BANK_HOME          the bank of the calling thread
+ *   BANK_ROUND_ROBIN   each bank in turn
+ *   BANK_LEAST_LOADED  the bank with the most free blocks
+ */
+typedef enum BankPlacement { BANK_HOME, BANK_ROUND_ROBIN, BANK_LEAST_LOADED } BankPlacement;
+
+// Counters of one bank
+typedef struct BankStats {
+	SimulatorStats sim; // counters of the simulation of the bank
+	long long requests; // requests that tried this bank first
+	long long spilledIn; // processes placed here because the bank they tried first was full
+	long long spilledOut; // requests that tried this bank first and were placed in another
+	long long lockAcquisitions; // times a thread took the lock of the bank
+	long long lockContended; // of those, the ones that had to wait for another thread
+	long long lockWaitNanos; // time those waited
+} BankStats;
+
+MemoryBanks *banksCreate(const SimulatorConfig *config, int count, BankPlacement placement);
+int banksAllocate(MemoryBanks *banks, int home, int id, long long size);
+bool banksFree(MemoryBanks *banks, int bank, int id);
+bool banksReallocate(MemoryBanks *banks, int bank, int id, long long size);
+void banksStats(MemoryBanks *banks, int bank, BankStats *stats);
+bool banksTelemetry(MemoryBanks *banks, const char *name, bool json, long long every);
+long long banksRun(MemoryBanks *banks, long long block, int *id);
+void banksDestroy(MemoryBanks *banks);
+
+#endif
@@ -0,0 +1,416 @@
+#!/bin/sh
+# Regression checks for the simulator: each replays a generated trace in two
+# ways that must leave the same memory and print the same counters, then small
+# traces are checked against the memory and counters they must give.
+# Usage: sh regression.sh [PATH TO memoryAllocation [PATH TO memoryAllocationPreload.so]]
+
+program=${1:-./memoryAllocation}
+shim=$2
+if [ -n "$shim" ]; then
+	# LD_PRELOAD looks up a bare name in the library path, so make it absolute
+	shim=$(cd "$(dirname "$shim")" && pwd)/$(basename "$shim") || exit 1
+fi
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+failures=0
+policies="ff nf bf wf pages buddy tlsf auto"
+
+# Run the simulator on a trace with a policy and options, keeping the final
+# memory in $work/NAME.mem and the counters, without file names, in $work/NAME.out
+run() {
+	name=$1
+	trace=$2
+	policy=$3
+	shift 3
+	if ! "$program" "$trace" "$work/$name.mem" "$policy" --memory=1024 --log=summary "$@" > "$work/$name.raw" 2>&1; then
+		cat "$work/$name.raw"
+		echo "FAIL: $policy $* on $trace did not run"
+		failures=$((failures + 1))
+	fi
+	grep -v "^Reading from file\|^Writing to file\|^Restoring from checkpoint" "$work/$name.raw" > "$work/$name.out"
+}
+
+# Compare the memory, and with "counters" also the counters, of two runs
+same() {
+	what=$1
+	if cmp -s "$work/$2.mem" "$work/$3.mem" && { [ "$4" != counters ] || cmp -s "$work/$2.out" "$work/$3.out"; }; then
+		echo "ok: $what"
+	else
+		echo "FAIL: $what"
+		failures=$((failures + 1))
+	fi
+}
+
+# Run the simulator on a small trace read from standard input, keeping it in
+# $work/NAME.txt, the final memory as runs in $work/NAME.mem and the counters in $work/NAME.out
+trial() {
+	name=$1
+	shift
+	cat > "$work/$name.txt"
+	run "$name" "$work/$name.txt" "$@" --image=runs
+}
+
+# Compare a file a run wrote with what it must hold, read from standard input
+expect() {
+	if diff "$2" - > "$work/diff"; then
+		echo "ok: $1"
+	else
+		echo "FAIL: $1"
+		cat "$work/diff"
+		failures=$((failures + 1))
+	fi
+}
+
+# Processes that come and go: allocations by id and bare sizes, frees and
+# reallocations, from a linear congruential generator so every awk makes the same trace
+awk 'BEGIN {
+	x = 1
+	for(n = 0; n < 4000; n++) {
+		x = (x * 69069 + 1) % 4294967296
+		r = int(x / 65536)
+		if(live > 0 && r % 10 < 3) {
+			print "free " ids[r % live]
+			ids[r % live] = ids[--live]
+		} else if(live > 0 && r % 10 == 3) {
+			print "realloc " ids[r % live] " " (r % 61 + 1)
+		} else {
+			ids[live++] = ++id
+			print (r % 10 < 6 ? "alloc " id " " (r % 47 + 1) : r % 29 + 1)
+		}
+	}
+}' > "$work/trace.txt"
+"$program" --convert="$work/trace.txt" "$work/trace.bin" > /dev/null || exit 1
+
+for policy in $policies; do
+	run "$policy" "$work/trace.txt" "$policy"
+	run "$policy-binary" "$work/trace.bin" "$policy"
+	same "$policy text and binary traces" "$policy" "$policy-binary" counters
+
+	for store in u16 u32 rle; do
+		for engine in extent bitmap; do
+			run "$policy-$store-$engine" "$work/trace.txt" "$policy" --store=$store --engine=$engine
+			same "$policy with --store=$store --engine=$engine" "$policy" "$policy-$store-$engine" counters
+		done
+	done
+
+	run "$policy-checkpoint" "$work/trace.txt" "$policy" --checkpoint="$work/$policy.checkpoint" --checkpoint-at=1500
+	run "$policy-restore" "$work/trace.txt" "$policy" --restore="$work/$policy.checkpoint.1500"
+	same "$policy restored from a checkpoint" "$policy" "$policy-restore" counters
+
+	# banks print counters of their own, so only memory is compared
+	run "$policy-banks" "$work/trace.txt" "$policy" --banks=1
+	same "$policy with --banks=1" "$policy" "$policy-banks"
+done
+
+# Small traces with the memory and counters they must give
+trial buddy buddy --memory=16 <<'EOF'
+alloc 1 3
+alloc 2 5
+alloc 3 1
+free 1
+alloc 4 2
+EOF
+expect "buddy places by halving and merging" "$work/buddy.mem" <<'EOF'
+4 1 3
+6 2 4
+8 5 2
+EOF
+expect "buddy counts rounding as waste, not free" "$work/buddy.out" <<'EOF'
+buddy-system allocation
+0 processes vacated
+0 compaction events
+3 blocks wasted by rounding
+0 reallocations, 0 of them moved, 0 blocks copied
+5 free blocks in 2 free extents, the longest 4 blocks
+EOF
+
+# the free block of 33 is in a class below the request's rounded one, so tlsf
+# skips it where best fit would take it
+trial tlsf tlsf --memory=128 <<'EOF'
+alloc 1 33
+alloc 2 10
+alloc 3 40
+alloc 4 5
+free 1
+alloc 5 33
+EOF
+expect "tlsf places by class" "$work/tlsf.mem" <<'EOF'
+33 10 2
+43 40 3
+83 5 4
+88 33 5
+EOF
+
+# Process 7 fits nowhere, and each evictor makes room another way
+cat > "$work/evict.txt" <<'EOF'
+alloc 1 3
+alloc 2 2
+alloc 3 4
+alloc 4 3
+alloc 5 6
+alloc 6 2
+free 2
+free 4
+alloc 7 6
+EOF
+for eviction in largest fifo smallest adjacent plan; do
+	run "evict-$eviction" "$work/evict.txt" ff --memory=20 --image=runs --eviction=$eviction
+done
+expect "--eviction=largest vacates the largest process" "$work/evict-largest.mem" <<'EOF'
+0 3 1
+5 4 3
+9 6 7
+18 2 6
+EOF
+expect "--eviction=fifo vacates the oldest process and compacts" "$work/evict-fifo.mem" <<'EOF'
+0 4 3
+4 6 5
+10 2 6
+12 6 7
+EOF
+expect "--eviction=fifo counters" "$work/evict-fifo.out" <<'EOF'
+first-fit allocation
+1 processes vacated
+1 compaction events
+12 blocks moved by compaction
+0 reallocations, 0 of them moved, 0 blocks copied
+2 free blocks in 1 free extents, the longest 2 blocks
+EOF
+expect "--eviction=smallest vacates the smallest process and compacts" "$work/evict-smallest.mem" <<'EOF'
+0 3 1
+3 4 3
+7 6 5
+13 6 7
+EOF
+expect "--eviction=adjacent vacates the process between two holes" "$work/evict-adjacent.mem" <<'EOF'
+0 3 1
+3 6 7
+12 6 5
+18 2 6
+EOF
+expect "--eviction=plan vacates the process that needs no compaction" "$work/evict-plan.mem" <<'EOF'
+0 3 1
+3 6 7
+12 6 5
+18 2 6
+EOF
+expect "--eviction=plan counters" "$work/evict-plan.out" <<'EOF'
+first-fit allocation
+1 processes vacated
+0 compaction events
+0 blocks moved by compaction
+0 reallocations, 0 of them moved, 0 blocks copied
+3 free blocks in 1 free extents, the longest 3 blocks
+EOF
+
+# Compaction of the whole memory against a window of the holes needed
+cat > "$work/window.txt" <<'EOF'
+alloc 1 2
+alloc 2 5
+alloc 3 2
+alloc 4 3
+alloc 5 2
+alloc 6 6
+free 1
+free 3
+free 5
+alloc 7 4
+EOF
+run compaction-full "$work/window.txt" ff --memory=20 --image=runs --compaction=full
+run compaction-window "$work/window.txt" ff --memory=20 --image=runs --compaction=window --deltas="$work/window.deltas"
+expect "--compaction=full moves everything down" "$work/compaction-full.mem" <<'EOF'
+0 5 2
+5 3 4
+8 6 6
+14 4 7
+EOF
+expect "--compaction=full blocks moved" "$work/compaction-full.out" <<'EOF'
+first-fit allocation
+0 processes vacated
+1 compaction events
+14 blocks moved by compaction
+0 reallocations, 0 of them moved, 0 blocks copied
+2 free blocks in 1 free extents, the longest 2 blocks
+EOF
+expect "--compaction=window moves only the window" "$work/compaction-window.mem" <<'EOF'
+2 5 2
+7 3 4
+10 4 7
+14 6 6
+EOF
+expect "--compaction=window blocks moved" "$work/compaction-window.out" <<'EOF'
+first-fit allocation
+0 processes vacated
+1 compaction events
+3 blocks moved by compaction
+0 reallocations, 0 of them moved, 0 blocks copied
+2 free blocks in 1 free extents, the longest 2 blocks
+EOF
+
+# Pages with a TLB of 4 entries and two blocks to a frame, so every access
+# after the first to a frame hits
+printf '1 0\n1 1\n1 2\n1 0\n2 0\n' > "$work/tlb.accesses"
+trial tlb pages --memory=16 --frame=2 --tlb=4 --accesses="$work/tlb.accesses" <<'EOF'
+alloc 1 4
+alloc 2 2
+EOF
+expect "--tlb counts hits and page walks" "$work/tlb.out" <<'EOF'
+simple paging
+0 processes vacated
+0 compaction events
+0 blocks wasted by rounding
+5 accesses, 2 TLB hits (40.00%), 3 page walks of 4 levels
+0 accesses to blocks the process did not own
+32768 bytes of page tables at the end, 32768 at most
+EOF
+
+# Ids are dealt to two banks of 8 blocks; process 3 does not fit in bank 1 and
+# spills over to bank 0. With one thread the banks run in turn.
+trial banks ff --memory=16 --banks=2 --bank-threads=1 <<'EOF'
+alloc 1 6
+alloc 2 4
+alloc 3 3
+alloc 4 1
+EOF
+expect "--banks=2 spills over to the other bank" "$work/banks.mem" <<'EOF'
+0 4 2
+4 1 4
+5 3 3
+8 6 1
+EOF
+expect "--banks=2 counters" "$work/banks.out" <<'EOF'
+first-fit allocation
+0 processes vacated
+0 compaction events
+0 blocks moved by compaction
+1 requests spilled over to another bank
+Bank 0: 100.0% used, 2 requests, 1 spilled in, 0 spilled out, 0 vacated, 0 compactions
+Bank 0: 3 lock acquisitions, 0 of them waited (0.00%), 0.000 ms waiting
+Bank 1: 75.0% used, 2 requests, 0 spilled in, 1 spilled out, 0 vacated, 0 compactions
+Bank 1: 2 lock acquisitions, 0 of them waited (0.00%), 0.000 ms waiting
+EOF
+
+# A free, a reallocation that grows in place and a vacate, as the full log
+# and the deltas
+trial deltas ff --memory=8 --log=full --deltas="$work/deltas.deltas" <<'EOF'
+alloc 1 3
+alloc 2 2
+free 1
+realloc 2 4
+alloc 3 5
+EOF
+expect "full log of a free, a reallocation and a vacate" "$work/deltas.out" <<'EOF'
+first-fit allocation
+1 requested 3 blocks
+Allocate 0 through 2 to 1
+2 requested 2 blocks
+Allocate 3 through 4 to 2
+free 1
+2 resized to 4 blocks
+Allocate 5 through 6 to 2
+3 requested 5 blocks
+vacate 2
+Allocate 0 through 4 to 3
+1 processes vacated
+0 compaction events
+0 blocks moved by compaction
+1 reallocations, 0 of them moved, 0 blocks copied
+3 free blocks in 1 free extents, the longest 3 blocks
+EOF
+expect "--deltas of a free, a reallocation and a vacate" "$work/deltas.deltas" <<'EOF'
++ 1 0 3
++ 2 3 2
+- 1 0 3
++ 2 5 2
+- 2 3 4
++ 3 0 5
+EOF
+expect "--deltas of window compaction" "$work/window.deltas" <<'EOF'
++ 1 0 2
++ 2 2 5
++ 3 7 2
++ 4 9 3
++ 5 12 2
++ 6 14 6
+- 1 0 2
+- 3 7 2
+- 5 12 2
+> 4 9 7 3
++ 7 10 4
+EOF
+
+# --decode prints the events of an event log as the full log printed them
+run events "$work/deltas.txt" ff --memory=8 --log=full --event-log="$work/deltas.events"
+"$program" --decode="$work/deltas.events" > "$work/decode.out" 2>&1
+grep -v " processes vacated$\| events$\| by compaction$\| reallocations, \| free extents, \|allocation$" "$work/deltas.out" > "$work/events.expected"
+expect "--decode gives the events of the full log" "$work/decode.out" < "$work/events.expected"
+
+# and rejects a log it cannot read all of: a record cut short, a record of no
+# known type, and a policy switch to a policy that does not exist
+printf 'MEMEVT1\000abc' > "$work/short.events"
+printf 'MEMEVT1\000\052\000\000\000\001\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000' > "$work/type.events"
+printf 'MEMEVT1\000\010\000\000\000\000\341\365\005\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000' > "$work/switch.events"
+for log in short type switch; do
+	if "$program" --decode="$work/$log.events" > "$work/decode.out" 2>&1 || ! grep -q "^Problem reading event log" "$work/decode.out"; then
+		echo "FAIL: --decode of a malformed log ($log) did not fail"
+		failures=$((failures + 1))
+	else
+		echo "ok: --decode rejects a malformed log ($log)"
+	fi
+done
+
+# A trace streamed on standard input replays as the file does
+run ff-stdin - ff < "$work/trace.txt"
+same "ff with the trace on standard input" ff ff-stdin counters
+
+# Next fit must neither place a request of all of memory nor lose a process
+# whose reallocation cannot be placed
+trial next-fit-full nf --memory=16 <<'EOF'
+alloc 1 16
+alloc 2 3
+alloc 3 15
+EOF
+expect "nf turns away a request for all of memory" "$work/next-fit-full.mem" <<'EOF'
+0 15 3
+EOF
+trial next-fit-realloc nf --memory=16 <<'EOF'
+alloc 1 8
+alloc 2 4
+realloc 1 12
+EOF
+expect "nf keeps a process whose reallocation needs a vacate" "$work/next-fit-realloc.mem" <<'EOF'
+0 12 1
+EOF
+
+# The shim must run a program, here the simulator itself, as glibc does, and
+# carry on in the children of a fork
+if [ -n "$shim" ]; then
+	for policy in ff nf bf wf pages buddy tlsf; do
+		export LD_PRELOAD="$shim" MEMALLOC_POLICY=$policy
+		run "shim-$policy" "$work/trace.txt" ff
+		unset LD_PRELOAD MEMALLOC_POLICY
+		same "ff under the shim with MEMALLOC_POLICY=$policy" ff "shim-$policy" counters
+	done
+	# the counters show that the shim, not glibc, did the allocating
+	if MEMALLOC_STATS=1 MEMALLOC_POLICY=bf LD_PRELOAD="$shim" "$program" "$work/trace.txt" "$work/shim.mem" ff --log=off 2> "$work/shim.err" \
+			&& grep -q "^memalloc bf arena 0: .* 0 failed$" "$work/shim.err"; then
+		echo "ok: MEMALLOC_STATS under the shim"
+	else
+		echo "FAIL: MEMALLOC_STATS under the shim"
+		failures=$((failures + 1))
+	fi
+	if [ "$(LD_PRELOAD="$shim" sh -c 'echo $(echo forked)')" = forked ]; then
+		echo "ok: a shell forking under the shim"
+	else
+		echo "FAIL: a shell forking under the shim"
+		failures=$((failures + 1))
+	fi
+else
+	echo "skipped: the shim, as no memoryAllocationPreload.so was given"
+fi
+
+if [ $failures -ne 0 ]; then
+	echo "$failures checks failed"
+	exit 1
+fi
+echo "All checks passed"